@@ -9,10 +9,23 @@ out VS_OUT {
     vec2 TexCoords;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
+//Shared by every program, must match FrameData in include/uniform_buffer.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPositions[4];
+    vec4 lightColors[4];
+    vec4 sunDirection;
+    vec4 sunColor;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 lightSpaceMatrices[4];
+};
+
 void main()
 {
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
@@ -0,0 +1,32 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+
+//13 bilinear taps (36 texels) over a 4x4 texel footprint of the level above: a box filter made of
+//overlapping boxes, wide enough that thin bright lines don't flicker when they move
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+
+    vec3 a = texture(source, TexCoords + texel * vec2(-2.0,  2.0)).rgb;
+    vec3 b = texture(source, TexCoords + texel * vec2( 0.0,  2.0)).rgb;
+    vec3 c = texture(source, TexCoords + texel * vec2( 2.0,  2.0)).rgb;
+    vec3 d = texture(source, TexCoords + texel * vec2(-2.0,  0.0)).rgb;
+    vec3 e = texture(source, TexCoords).rgb;
+    vec3 f = texture(source, TexCoords + texel * vec2( 2.0,  0.0)).rgb;
+    vec3 g = texture(source, TexCoords + texel * vec2(-2.0, -2.0)).rgb;
+    vec3 h = texture(source, TexCoords + texel * vec2( 0.0, -2.0)).rgb;
+    vec3 i = texture(source, TexCoords + texel * vec2( 2.0, -2.0)).rgb;
+    vec3 j = texture(source, TexCoords + texel * vec2(-1.0,  1.0)).rgb;
+    vec3 k = texture(source, TexCoords + texel * vec2( 1.0,  1.0)).rgb;
+    vec3 l = texture(source, TexCoords + texel * vec2(-1.0, -1.0)).rgb;
+    vec3 m = texture(source, TexCoords + texel * vec2( 1.0, -1.0)).rgb;
+
+    FragColor = e * 0.125
+              + (a + c + g + i) * 0.03125
+              + (b + d + f + h) * 0.0625
+              + (j + k + l + m) * 0.125;
+}
@@ -0,0 +1,25 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform float filterRadius;
+
+//3x3 tent filter on the smaller level, added on top of the current one by the blending
+void main()
+{
+    vec2 offset = filterRadius / vec2(textureSize(source, 0));
+
+    vec3 a = texture(source, TexCoords + vec2(-offset.x,  offset.y)).rgb;
+    vec3 b = texture(source, TexCoords + vec2( 0.0,       offset.y)).rgb;
+    vec3 c = texture(source, TexCoords + vec2( offset.x,  offset.y)).rgb;
+    vec3 d = texture(source, TexCoords + vec2(-offset.x,  0.0)).rgb;
+    vec3 e = texture(source, TexCoords).rgb;
+    vec3 f = texture(source, TexCoords + vec2( offset.x,  0.0)).rgb;
+    vec3 g = texture(source, TexCoords + vec2(-offset.x, -offset.y)).rgb;
+    vec3 h = texture(source, TexCoords + vec2( 0.0,      -offset.y)).rgb;
+    vec3 i = texture(source, TexCoords + vec2( offset.x, -offset.y)).rgb;
+
+    FragColor = (e * 4.0 + (b + d + f + h) * 2.0 + (a + c + g + i)) / 16.0;
+}
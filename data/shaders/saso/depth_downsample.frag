@@ -0,0 +1,14 @@
+#version 330 core
+out float FragColor;
+
+uniform sampler2D depthBuffer;
+uniform int scale;
+uniform mat4 projection;
+
+//Linear view depth at the SSAO resolution, 0 where nothing was drawn. Point sampled: the bilateral upsample
+//compares against exactly the texels the occlusion was computed for.
+void main()
+{
+    float depth = texelFetch(depthBuffer, ivec2(gl_FragCoord.xy) * scale, 0).r;
+    FragColor = depth >= 1.0 ? 0.0 : projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+}
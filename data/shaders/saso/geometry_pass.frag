@@ -1,20 +1,33 @@
-#version 300 es
+#version 430 core
 precision highp float;
 
-layout (location = 0) out vec3 gPosition;
-layout (location = 1) out vec3 gNormal;
-layout (location = 2) out vec3 gAlbedo;
+// the position is rebuilt from the depth buffer, only normals and material go to color targets
+layout (location = 0) out vec2 gNormal;
+layout (location = 1) out vec4 gAlbedoSpec;
 
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
 
+uniform sampler2D texture_diffuse1;
+uniform float specularIntensity;
+
+// octahedral mapping: the unit sphere folded on the [-1, 1] square, two signed 16 bit channels
+vec2 OctWrap(vec2 v)
+{
+return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n)
+{
+n /= abs(n.x) + abs(n.y) + abs(n.z);
+return n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+}
+
 void main()
 {
-// store the fragment position vector in the first gbuffer texture
-gPosition = FragPos;
-// also store the per-fragment normals into the gbuffer
-gNormal = normalize(Normal);
-// and the diffuse per-fragment color
-gAlbedo.rgb = vec3(0.95);
-}
\ No newline at end of file
+// store the per-fragment view space normal
+gNormal = EncodeNormal(normalize(Normal));
+// and the diffuse per-fragment color, the specular intensity in alpha
+gAlbedoSpec = vec4(texture(texture_diffuse1, TexCoords).rgb, specularIntensity);
+}
@@ -1,49 +1,135 @@
-﻿#version 300 es
-precision highp float;
+﻿#version 430 core
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
+uniform sampler2D gDepth;
 uniform sampler2D gNormal;
-uniform sampler2D gAlbedo;
+uniform sampler2D gAlbedoSpec;
 uniform sampler2D ssao;
+uniform sampler2DArrayShadow shadowMap;
 
-struct Light {
-vec3 Position;
-vec3 Color;
+//Shared by every program, must match FrameData in include/uniform_buffer.h
+layout (std140) uniform FrameData
+{
+mat4 projection;
+mat4 view;
+vec4 viewPos;
+vec4 lightPositions[4];
+vec4 lightColors[4];
+vec4 sunDirection;
+vec4 sunColor;
+vec4 cascadeSplits;
+vec4 cascadeTexelSizes;
+mat4 lightSpaceMatrices[4];
+};
 
-float Linear;
-float Quadratic;
+//Clustered lights, must match include/light_clusters.h
+const uvec3 kClusterGrid = uvec3(16u, 9u, 24u);
+struct PointLight
+{
+vec4 positionRadius;
+vec4 color;
 };
-uniform Light light;
+layout (std430, binding = 0) readonly buffer PointLights { PointLight pointLights[]; };
+layout (std430, binding = 1) readonly buffer LightClusters { uvec2 lightClusters[]; }; // offset, count
+layout (std430, binding = 2) readonly buffer LightIndices { uint lightIndices[]; };
+
+uint ClusterIndex(vec3 viewPosition)
+{
+float near = projection[3][2] / (projection[2][2] - 1.0);
+float far = projection[3][2] / (projection[2][2] + 1.0);
+float depth = -viewPosition.z;
+vec2 ndc = vec2(projection[0][0] * viewPosition.x, projection[1][1] * viewPosition.y) / depth;
+uvec2 tile = uvec2(clamp((ndc * 0.5 + 0.5) * vec2(kClusterGrid.xy), vec2(0.0), vec2(kClusterGrid.xy) - 1.0));
+float slice = log(max(depth, near) / near) * float(kClusterGrid.z) / log(far / near);
+return tile.x + kClusterGrid.x * (tile.y + kClusterGrid.y * uint(clamp(slice, 0.0, float(kClusterGrid.z) - 1.0)));
+}
+
+// distance falloff, faded to zero at the radius the light was binned with
+float Attenuation(float distance, float radius)
+{
+float window = clamp(1.0 - pow(distance / radius, 4.0), 0.0, 1.0);
+return window * window / (1.0 + 0.09 * distance + 0.032 * distance * distance);
+}
+
+vec3 DecodeNormal(vec2 f)
+{
+vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+float t = clamp(-n.z, 0.0, 1.0);
+n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+return normalize(n);
+}
+
+// 1 lit, 0 in shadow of the sun. The cascade comes from the view depth, every comparison is filtered over 2x2
+// texels by the hardware and the 4 of them cover 3x3 texels
+float SunShadow(vec3 worldPosition, vec3 worldNormal, float viewDepth)
+{
+if (sunDirection.w == 0.0)
+return 1.0;
+int cascade = 0;
+while (cascade < 4 && viewDepth > cascadeSplits[cascade])
+cascade++;
+if (cascade == 4)
+return 1.0;
+// normal offset: a texel off the surface, the depth texels slanted by the surface don't shadow it
+vec3 position = worldPosition + worldNormal * cascadeTexelSizes[cascade] * 1.5;
+vec4 lightSpace = lightSpaceMatrices[cascade] * vec4(position, 1.0);
+vec3 coords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+float lit = 0.0;
+lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5, -0.5) * texelSize, float(cascade), coords.z));
+lit += texture(shadowMap, vec4(coords.xy + vec2(0.5, -0.5) * texelSize, float(cascade), coords.z));
+lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5, 0.5) * texelSize, float(cascade), coords.z));
+lit += texture(shadowMap, vec4(coords.xy + vec2(0.5, 0.5) * texelSize, float(cascade), coords.z));
+return lit * 0.25;
+}
 
 void main()
 {
-// retrieve data from gbuffer
-vec3 FragPos = texture(gPosition, TexCoords).rgb;
-vec3 Normal = texture(gNormal, TexCoords).rgb;
-vec3 Diffuse = texture(gAlbedo, TexCoords).rgb;
+// retrieve data from gbuffer, the view position is rebuilt from the depth buffer
+float hardwareDepth = texture(gDepth, TexCoords).r;
+if (hardwareDepth >= 1.0)
+discard;
+float depth = projection[3][2] / (hardwareDepth * 2.0 - 1.0 + projection[2][2]);
+vec2 viewRay = vec2(1.0 / projection[0][0], 1.0 / projection[1][1]);
+vec3 FragPos = vec3((TexCoords * 2.0 - 1.0) * viewRay * depth, -depth);
+vec3 Normal = DecodeNormal(texture(gNormal, TexCoords).rg);
+vec4 AlbedoSpec = texture(gAlbedoSpec, TexCoords);
+vec3 Diffuse = AlbedoSpec.rgb;
 float AmbientOcclusion = texture(ssao, TexCoords).r;
 
-// then calculate lighting as usual
+// then calculate lighting as usual, for the lights binned in this fragment's cluster only
 vec3 ambient = vec3(0.3 * Diffuse * AmbientOcclusion);
 vec3 lighting  = ambient;
 vec3 viewDir  = normalize(-FragPos); // viewpos is (0.0.0)
+uvec2 cluster = lightClusters[ClusterIndex(FragPos)];
+for (uint i = cluster.x; i < cluster.x + cluster.y; i++)
+{
+PointLight light = pointLights[lightIndices[i]];
+vec3 lightPosition = vec3(view * vec4(light.positionRadius.xyz, 1.0));
 // diffuse
-vec3 lightDir = normalize(light.Position - FragPos);
-vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Diffuse * light.Color;
+vec3 lightDir = normalize(lightPosition - FragPos);
+vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Diffuse * light.color.rgb;
 // specular
 vec3 halfwayDir = normalize(lightDir + viewDir);
 float spec = pow(max(dot(Normal, halfwayDir), 0.0), 8.0);
-vec3 specular = light.Color * spec;
+vec3 specular = light.color.rgb * spec * AlbedoSpec.a;
 // attenuation
-float distance = length(light.Position - FragPos);
-float attenuation = 1.0 / (1.0 + light.Linear * distance + light.Quadratic * distance * distance);
-diffuse *= attenuation;
-specular *= attenuation;
-lighting += diffuse + specular;
+float attenuation = Attenuation(length(lightPosition - FragPos), light.positionRadius.w);
+lighting += (diffuse + specular) * attenuation;
+}
+
+// the sun, the only light casting shadows. The view is rigid: its inverse is the transposed rotation
+mat3 viewRotation = mat3(view);
+vec3 worldPosition = transpose(viewRotation) * (FragPos - view[3].xyz);
+vec3 sunDir = normalize(viewRotation * -sunDirection.xyz);
+vec3 sunDiffuse = max(dot(Normal, sunDir), 0.0) * Diffuse;
+vec3 sunSpecular = vec3(pow(max(dot(Normal, normalize(sunDir + viewDir)), 0.0), 8.0) * AlbedoSpec.a);
+lighting += (sunDiffuse + sunSpecular) * sunColor.rgb * SunShadow(worldPosition, transpose(viewRotation) * Normal, depth);
 
 FragColor = vec4(lighting, 1.0);
+BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
 }
\ No newline at end of file
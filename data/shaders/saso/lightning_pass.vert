@@ -1,5 +1,4 @@
-#version 300 es
-precision highp float;
+#version 430 core
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
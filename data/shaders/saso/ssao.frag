@@ -1,60 +1,68 @@
-
-#version 300 es
-precision highp float;
-
+#version 330 core
 out float FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
-uniform sampler2D gNormal;
+uniform sampler2D linearDepth; //view space distance at the SSAO resolution, 0 where nothing was drawn
+uniform sampler2D gNormal;     //octahedral encoded, view space
 uniform sampler2D texNoise;
 
-uniform vec3 samples[32];
-
-// parameters (you'd probably want to use them as uniforms to more easily tweak the effect)
-int kernelSize = 32;
-float radius = 0.5;
-float bias = 0.025;
-
-// tile noise texture over screen based on screen dimensions divided by noise size
-const vec2 noiseScale = vec2(800.0/4.0, 600.0/4.0);
+const int kMaxKernelSize = 64;
+uniform vec3 samples[kMaxKernelSize];
+uniform int kernelSize;
+uniform float radius;
+uniform float bias;
 
 uniform mat4 projection;
 
-void main()
+//The view position is rebuilt from the depth: x and y scale with the distance along the view ray
+vec3 ViewPosition(vec2 uv, float depth)
 {
-// get input for SSAO algorithm
-vec3 fragPos = texture(gPosition, TexCoords).xyz;
-vec3 normal = normalize(texture(gNormal, TexCoords).rgb);
-vec3 randomVec = normalize(texture(texNoise, TexCoords * noiseScale).xyz);
-// create TBN change-of-basis matrix: from tangent-space to view-space
-vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
-vec3 bitangent = cross(normal, tangent);
-mat3 TBN = mat3(tangent, bitangent, normal);
-// iterate over the sample kernel and calculate occlusion factor
-float occlusion = 0.0;
-for(int i = 0; i < kernelSize; ++i)
+    vec2 viewRay = vec2(1.0 / projection[0][0], 1.0 / projection[1][1]);
+    return vec3((uv * 2.0 - 1.0) * viewRay * depth, -depth);
+}
+
+vec3 DecodeNormal(vec2 f)
 {
-// get sample position
-vec3 samplePos = TBN * samples[i]; // from tangent to view-space
-samplePos = fragPos + samplePos * radius;
-
-// project sample position (to sample texture) (to get position on screen/texture)
-vec4 offset = vec4(samplePos, 1.0);
-offset = projection * offset; // from view to clip-space
-offset.xyz /= offset.w; // perspective divide
-offset.xyz = offset.xyz * 0.5 + 0.5; // transform to range 0.0 - 1.0
-
-// get sample depth
-float sampleDepth = texture(gPosition, offset.xy).z; // get depth value of kernel sample
-
-// range check & accumulate
-float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
-occlusion += (sampleDepth >= samplePos.z + bias ? 1.0 : 0.0) * rangeCheck;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
 }
-occlusion = 1.0 - (occlusion / float(kernelSize));
-float power = 2.0;
 
-FragColor = pow(occlusion, power);
+void main()
+{
+    float depth = texture(linearDepth, TexCoords).r;
+    if (depth <= 0.0)
+    {
+        FragColor = 1.0;
+        return;
+    }
+    vec3 fragPos = ViewPosition(TexCoords, depth);
+    vec3 normal = DecodeNormal(texture(gNormal, TexCoords).rg);
+    // tile the 4x4 noise texture over the target, whatever its resolution
+    vec2 noiseScale = vec2(textureSize(linearDepth, 0)) / 4.0;
+    vec3 randomVec = normalize(texture(texNoise, TexCoords * noiseScale).xyz);
+    // create TBN change-of-basis matrix: from tangent-space to view-space
+    vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(normal, tangent);
+    mat3 TBN = mat3(tangent, bitangent, normal);
+
+    float occlusion = 0.0;
+    for (int i = 0; i < kernelSize; ++i)
+    {
+        vec3 samplePos = fragPos + TBN * samples[i] * radius;
+
+        // project sample position (to sample texture) (to get position on screen/texture)
+        vec4 offset = projection * vec4(samplePos, 1.0);
+        offset.xy = offset.xy / offset.w * 0.5 + 0.5;
+
+        float sampleDepth = -texture(linearDepth, offset.xy).r;
+
+        // range check & accumulate
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        occlusion += (sampleDepth >= samplePos.z + bias ? 1.0 : 0.0) * rangeCheck;
+    }
+    occlusion = 1.0 - (occlusion / float(kernelSize));
+    FragColor = pow(occlusion, 2.0);
 }
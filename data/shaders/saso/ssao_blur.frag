@@ -1,23 +1,22 @@
-#version 300 es
-precision highp float;
-
+#version 330 core
 out float FragColor;
 
 in vec2 TexCoords;
 
 uniform sampler2D ssaoInput;
 
+// 4x4 box, the size of the noise tile, so the rotation pattern averages out
 void main()
 {
-vec2 texelSize = 1.0 / vec2(textureSize(ssaoInput, 0));
-float result = 0.0;
-for (int x = -2; x < 2; ++x)
-{
-for (int y = -2; y < 2; ++y)
-{
-vec2 offset = vec2(float(x), float(y)) * texelSize;
-result += texture(ssaoInput, TexCoords + offset).r;
-}
+    vec2 texelSize = 1.0 / vec2(textureSize(ssaoInput, 0));
+    float result = 0.0;
+    for (int x = -2; x < 2; ++x)
+    {
+        for (int y = -2; y < 2; ++y)
+        {
+            vec2 offset = vec2(float(x), float(y)) * texelSize;
+            result += texture(ssaoInput, TexCoords + offset).r;
+        }
+    }
+    FragColor = result / (4.0 * 4.0);
 }
-FragColor = result / (4.0 * 4.0);
-}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#version 330 core
+out float FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D ssaoInput;  //blurred occlusion at the SSAO resolution
+uniform sampler2D lowDepth;   //depth the occlusion was computed for
+uniform sampler2D depthBuffer; //full resolution hardware depth
+uniform mat4 projection;
+
+//Bilinear weights of the 4 nearest low resolution texels, scaled down when their depth doesn't match ours:
+//the occlusion of the background doesn't bleed over the edges of the objects in front of it
+void main()
+{
+    float hardwareDepth = texelFetch(depthBuffer, ivec2(gl_FragCoord.xy), 0).r;
+    if (hardwareDepth >= 1.0)
+    {
+        FragColor = 1.0;
+        return;
+    }
+    float depth = projection[3][2] / (hardwareDepth * 2.0 - 1.0 + projection[2][2]);
+
+    ivec2 lowSize = textureSize(ssaoInput, 0);
+    vec2 lowPosition = TexCoords * vec2(lowSize) - 0.5;
+    ivec2 base = ivec2(floor(lowPosition));
+    vec2 f = fract(lowPosition);
+    vec4 bilinear = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+
+    float occlusion = 0.0;
+    float weightSum = 0.0;
+    float nearestDifference = 1e30;
+    float nearestOcclusion = 1.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 texel = clamp(base + ivec2(i & 1, i >> 1), ivec2(0), lowSize - 1);
+        float sampleOcclusion = texelFetch(ssaoInput, texel, 0).r;
+        float difference = abs(texelFetch(lowDepth, texel, 0).r - depth);
+        // relative difference, the same tolerance near and far
+        float weight = bilinear[i] / (1e-3 + difference / depth);
+        occlusion += sampleOcclusion * weight;
+        weightSum += weight;
+        if (difference < nearestDifference)
+        {
+            nearestDifference = difference;
+            nearestOcclusion = sampleOcclusion;
+        }
+    }
+    FragColor = weightSum > 1e-4 ? occlusion / weightSum : nearestOcclusion;
+}
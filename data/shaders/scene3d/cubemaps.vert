@@ -5,12 +5,24 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+//Shared by every program, must match FrameData in include/uniform_buffer.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPositions[4];
+    vec4 lightColors[4];
+    vec4 sunDirection;
+    vec4 sunColor;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 lightSpaceMatrices[4];
+};
 
 void main()
 {
     TexCoords = aPos;
-    vec4 pos = (projection * view) * vec4(aPos, 1.0);
+    vec4 pos = (projection * mat4(mat3(view))) * vec4(aPos, 1.0); // Remove translation
     gl_Position = pos.xyww;
 }
\ No newline at end of file
@@ -7,11 +7,32 @@ layout (location = 3) in mat4 aInstanceMatrix;
 
 out vec2 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+//Compact meshes (CompactVertex in include/mesh.h): unorm16 positions in the mesh box
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 DecodePosition(vec3 position)
+{
+    return positionOffset + position * positionScale;
+}
+
+//Shared by every program, must match FrameData in include/uniform_buffer.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPositions[4];
+    vec4 lightColors[4];
+    vec4 sunDirection;
+    vec4 sunColor;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 lightSpaceMatrices[4];
+};
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * aInstanceMatrix * vec4(aPos, 1.0);
+    gl_Position = projection * view * aInstanceMatrix * vec4(DecodePosition(aPos), 1.0);
 }
\ No newline at end of file
@@ -1,5 +1,4 @@
-#version 300 es
-precision highp float;
+#version 430 core
 
 out vec4 FragColor;
 
@@ -9,41 +8,116 @@ in vec3 Normal;
 
 
 uniform sampler2D texture_diffuse1;
-uniform vec3 lightPos[4];
-uniform vec3 lightColor[4];
-uniform vec3 viewPos;
+uniform sampler2DArrayShadow shadowMap;
+
+//Shared by every program, must match FrameData in include/uniform_buffer.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPositions[4];
+    vec4 lightColors[4];
+    vec4 sunDirection;
+    vec4 sunColor;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 lightSpaceMatrices[4];
+};
+
+//Clustered lights, must match include/light_clusters.h
+const uvec3 kClusterGrid = uvec3(16u, 9u, 24u);
+struct PointLight
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+layout (std430, binding = 0) readonly buffer PointLights { PointLight pointLights[]; };
+layout (std430, binding = 1) readonly buffer LightClusters { uvec2 lightClusters[]; }; // offset, count
+layout (std430, binding = 2) readonly buffer LightIndices { uint lightIndices[]; };
+
+uint ClusterIndex(vec3 viewPosition)
+{
+    float near = projection[3][2] / (projection[2][2] - 1.0);
+    float far = projection[3][2] / (projection[2][2] + 1.0);
+    float depth = -viewPosition.z;
+    vec2 ndc = vec2(projection[0][0] * viewPosition.x, projection[1][1] * viewPosition.y) / depth;
+    uvec2 tile = uvec2(clamp((ndc * 0.5 + 0.5) * vec2(kClusterGrid.xy), vec2(0.0), vec2(kClusterGrid.xy) - 1.0));
+    float slice = log(max(depth, near) / near) * float(kClusterGrid.z) / log(far / near);
+    return tile.x + kClusterGrid.x * (tile.y + kClusterGrid.y * uint(clamp(slice, 0.0, float(kClusterGrid.z) - 1.0)));
+}
+
+// distance falloff, faded to zero at the radius the light was binned with
+float Attenuation(float distance, float radius)
+{
+    float window = clamp(1.0 - pow(distance / radius, 4.0), 0.0, 1.0);
+    return window * window / (1.0 + 0.09 * distance + 0.032 * (distance * distance));
+}
+
+// 1 lit, 0 in shadow of the sun. The cascade comes from the view depth, every comparison is filtered over 2x2
+// texels by the hardware and the 4 of them cover 3x3 texels
+float SunShadow(vec3 worldPosition, vec3 worldNormal, float viewDepth)
+{
+    if (sunDirection.w == 0.0)
+        return 1.0;
+    int cascade = 0;
+    while (cascade < 4 && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == 4)
+        return 1.0;
+    // normal offset: a texel off the surface, the depth texels slanted by the surface don't shadow it
+    vec3 position = worldPosition + worldNormal * cascadeTexelSizes[cascade] * 1.5;
+    vec4 lightSpace = lightSpaceMatrices[cascade] * vec4(position, 1.0);
+    vec3 coords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5, -0.5) * texelSize, float(cascade), coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2(0.5, -0.5) * texelSize, float(cascade), coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5, 0.5) * texelSize, float(cascade), coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2(0.5, 0.5) * texelSize, float(cascade), coords.z));
+    return lit * 0.25;
+}
 
 void main()
 {
     vec3 textureColor = texture(texture_diffuse1, TexCoords).rgb;
     vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
     vec3 result = vec3(0.0); // Accumulate the light contributions
 
-    for (int i = 0; i < 4; i++) {
-        vec3 lightDir = normalize(lightPos[i] - FragPos);
+    // only the lights binned in this fragment's cluster
+    uvec2 cluster = lightClusters[ClusterIndex(vec3(view * vec4(FragPos, 1.0)))];
+    for (uint i = cluster.x; i < cluster.x + cluster.y; i++) {
+        PointLight light = pointLights[lightIndices[i]];
+        vec3 lightDir = normalize(light.positionRadius.xyz - FragPos);
 
         // Diffuse lighting
         float diff = max(dot(norm, lightDir), 0.0);
 
-        // View direction
-        vec3 viewDir = normalize(viewPos - FragPos);
         vec3 reflectDir = reflect(-lightDir, norm);
 
         // Specular lighting
         float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16.0);
 
         // Light Attenuation (distance-based falloff)
-        float distance = length(lightPos[i] - FragPos);
-        float attenuation = 1.0 / (1.0 + 0.09 * distance + 0.032 * (distance * distance));
+        float distance = length(light.positionRadius.xyz - FragPos);
+        float attenuation = Attenuation(distance, light.positionRadius.w);
 
         // Lighting components
         vec3 ambient = 0.2 * textureColor;
-        vec3 diffuse = diff * textureColor * lightColor[i];
-        vec3 specular = spec * lightColor[i];
+        vec3 diffuse = diff * textureColor * light.color.rgb;
+        vec3 specular = spec * light.color.rgb;
 
         // Accumulate lighting from all lights
         result += (ambient + diffuse + specular) * attenuation;
     }
 
+    // the sun, the only light casting shadows
+    vec3 sunDir = normalize(-sunDirection.xyz);
+    float sunDiff = max(dot(norm, sunDir), 0.0);
+    float sunSpec = pow(max(dot(viewDir, reflect(-sunDir, norm)), 0.0), 16.0);
+    float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+    result += (sunDiff * textureColor + sunSpec) * sunColor.rgb * SunShadow(FragPos, norm, viewDepth);
+
     FragColor = vec4(result, 1.0);
 }
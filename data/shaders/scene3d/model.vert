@@ -1,5 +1,5 @@
-#version 300 es
-precision highp float;
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : enable
 
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
@@ -10,13 +10,70 @@ out vec3 FragPos;
 out vec3 Normal;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+//Compact meshes (CompactVertex in include/mesh.h): unorm16 positions in the mesh box, octahedral normals
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+//Arena meshes drawn with glMultiDrawElementsIndirect (GeometryArena in include/geometry_arena.h): the transform and
+//the dequantization come from the draw data, must match DrawData
+uniform bool indirect;
+uniform int drawOffset;
+struct DrawData
+{
+    mat4 model;
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+layout (std430, binding = 3) readonly buffer DrawDataBlock { DrawData draws[]; };
+
+int DrawIndex()
+{
+#ifdef GL_ARB_shader_draw_parameters
+    return drawOffset + gl_DrawIDARB;
+#else
+    return drawOffset;
+#endif
+}
+
+vec3 DecodePosition(vec3 position)
+{
+    if (indirect)
+        return draws[DrawIndex()].positionOffset.xyz + position * draws[DrawIndex()].positionScale.xyz;
+    return positionOffset + position * positionScale;
+}
+
+vec3 DecodeNormal(vec3 normal)
+{
+    if (!compactVertices && !indirect)
+        return normal;
+    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+//Shared by every program, must match FrameData in include/uniform_buffer.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPositions[4];
+    vec4 lightColors[4];
+    vec4 sunDirection;
+    vec4 sunColor;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 lightSpaceMatrices[4];
+};
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = normalize(mat3(transpose(inverse(model))) * aNormal);
+    mat4 world = indirect ? draws[DrawIndex()].model : model;
+    FragPos = vec3(world * vec4(DecodePosition(aPos), 1.0));
+    Normal = normalize(mat3(transpose(inverse(world))) * DecodeNormal(aNormal));
     TexCoords = aTexCoords;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -15,15 +15,12 @@ in VS_OUT {
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-
 void main()
 {
-    // obtain normal from normal map in range [0,1]
-    vec3 normal = texture(normalMap, fs_in.TexCoords).rgb;
-    // transform normal vector to range [-1,1]
-    normal = normalize(normal * 2.0 - 1.0);  // this normal is in tangent space
+    // obtain normal from normal map: BC5 only stores x and y in range [0,1]
+    vec2 xy = texture(normalMap, fs_in.TexCoords).rg * 2.0 - 1.0;
+    // z is rebuilt from the unit length, it always faces out of the surface
+    vec3 normal = normalize(vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0))));  // this normal is in tangent space
 
     // get diffuse color
     vec3 color = texture(diffuseMap, fs_in.TexCoords).rgb;
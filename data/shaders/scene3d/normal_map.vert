@@ -16,12 +16,22 @@ out VS_OUT {
     vec3 TangentFragPos;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+//Shared by every program, must match FrameData in include/uniform_buffer.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPositions[4];
+    vec4 lightColors[4];
+    vec4 sunDirection;
+    vec4 sunColor;
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    mat4 lightSpaceMatrices[4];
+};
 
 void main()
 {
@@ -35,8 +45,8 @@ void main()
     vec3 B = cross(N, T);
 
     mat3 TBN = transpose(mat3(T, B, N));
-    vs_out.TangentLightPos = TBN * lightPos;
-    vs_out.TangentViewPos  = TBN * viewPos;
+    vs_out.TangentLightPos = TBN * lightPositions[0].xyz;
+    vs_out.TangentViewPos  = TBN * viewPos.xyz;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
 
     gl_Position = projection * view * model * vec4(aPos, 1.0);
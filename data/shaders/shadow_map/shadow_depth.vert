@@ -1,10 +1,47 @@
-﻿#version 330 core
+﻿#version 430 core
+#extension GL_ARB_shader_draw_parameters : enable
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aInstanceMatrix;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+//The instanced trees take their matrix from the instance buffer
+uniform bool instanced;
+
+//Compact meshes (CompactVertex in include/mesh.h): unorm16 positions in the mesh box
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+//Arena meshes drawn with glMultiDrawElementsIndirect (GeometryArena in include/geometry_arena.h): the transform and
+//the dequantization come from the draw data, must match DrawData
+uniform bool indirect;
+uniform int drawOffset;
+struct DrawData
+{
+    mat4 model;
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+layout (std430, binding = 3) readonly buffer DrawDataBlock { DrawData draws[]; };
+
+int DrawIndex()
+{
+#ifdef GL_ARB_shader_draw_parameters
+    return drawOffset + gl_DrawIDARB;
+#else
+    return drawOffset;
+#endif
+}
+
+vec3 DecodePosition(vec3 position)
+{
+    if (indirect)
+        return draws[DrawIndex()].positionOffset.xyz + position * draws[DrawIndex()].positionScale.xyz;
+    return positionOffset + position * positionScale;
+}
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    mat4 world = instanced ? aInstanceMatrix : indirect ? draws[DrawIndex()].model : model;
+    gl_Position = lightSpaceMatrix * world * vec4(DecodePosition(aPos), 1.0);
 }
\ No newline at end of file
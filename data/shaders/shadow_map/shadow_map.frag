@@ -9,7 +9,7 @@ in VS_OUT {
 } fs_in;
 
 uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;
+uniform sampler2DShadow shadowMap; // compares in hardware, GL_TEXTURE_COMPARE_MODE set on the texture
 
 uniform vec3 lightPos;
 uniform vec3 viewPos;
@@ -20,28 +20,21 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
     // get depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
     // calculate bias (based on depth map resolution and slope)
     vec3 normal = normalize(fs_in.Normal);
     vec3 lightDir = normalize(lightPos - fs_in.FragPos);
     float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
-    float shadow = 0.0;
+    // PCF: each comparison is filtered over 2x2 texels, 4 of them half a texel apart cover the 3x3 texels
+    // the 9 manual taps did
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
-    {
-        for(int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;
-        }
-    }
-    shadow /= 9.0;
+    float lit = 0.0;
+    lit += texture(shadowMap, vec3(projCoords.xy + vec2(-0.5, -0.5) * texelSize, currentDepth - bias));
+    lit += texture(shadowMap, vec3(projCoords.xy + vec2(0.5, -0.5) * texelSize, currentDepth - bias));
+    lit += texture(shadowMap, vec3(projCoords.xy + vec2(-0.5, 0.5) * texelSize, currentDepth - bias));
+    lit += texture(shadowMap, vec3(projCoords.xy + vec2(0.5, 0.5) * texelSize, currentDepth - bias));
+    float shadow = 1.0 - lit * 0.25;
 
     // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
     if(projCoords.z > 1.0)
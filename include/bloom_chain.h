@@ -0,0 +1,44 @@
+#ifndef BLOOM_CHAIN_H_
+#define BLOOM_CHAIN_H_
+
+#include <vector>
+#include <GL/glew.h>
+
+#include "render_target_pool.h"
+#include "shader.h"
+
+//Progressive bloom: the bright pixels are downsampled from half resolution through a chain of smaller targets,
+//then every level is upsampled with a tent filter and added to the one above it. The wide blur comes from the
+//small levels, so no pass ever touches more than a quarter of the screen's pixels. The levels are transient
+//targets of the pool, sized from the source every frame.
+class BloomChain
+{
+ public:
+  static constexpr int kMaxLevels = 6;
+  //Levels smaller than this add nothing visible
+  static constexpr int kMinLevelSize = 8;
+
+  void Create();
+  void Delete();
+
+  //Blurs the thresholded width x height source into output, an R11F_G11F_B10F target of half that size: the top
+  //level of the chain, the smaller ones come from the pool. Output is black if the source is too small. Leaves a
+  //chain framebuffer bound, the viewport is restored.
+  void Render(RenderTargetPool& pool, GLuint bright_texture, GLuint output, int width, int height,
+              float filter_radius = 1.0f);
+
+ private:
+  struct Level
+  {
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+  };
+
+  std::vector<Level> levels_;
+  GLuint vao_ = 0;
+  Shader downsample_;
+  Shader upsample_;
+};
+
+#endif //BLOOM_CHAIN_H_
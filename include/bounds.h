@@ -0,0 +1,69 @@
+#ifndef BOUNDS_H_
+#define BOUNDS_H_
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+//Axis aligned box, empty (min > max) until something is added to it
+struct BoundingBox
+{
+  glm::vec3 min = glm::vec3(FLT_MAX);
+  glm::vec3 max = glm::vec3(-FLT_MAX);
+
+  void Extend(const glm::vec3& point)
+  {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+  void Extend(const BoundingBox& box)
+  {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+
+  [[nodiscard]] bool empty() const { return min.x > max.x; }
+  [[nodiscard]] glm::vec3 center() const { return (min + max) * 0.5f; }
+  [[nodiscard]] glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+  //Box around this one once transformed, the extents go through the absolute value of the linear part (Arvo)
+  [[nodiscard]] BoundingBox Transformed(const glm::mat4& matrix) const
+  {
+    if (empty())
+      return *this;
+    const glm::vec3 new_center = glm::vec3(matrix * glm::vec4(center(), 1.0f));
+    const glm::mat3 linear(matrix);
+    const glm::vec3 half = extents();
+    const glm::vec3 new_extents = glm::abs(linear[0]) * half.x + glm::abs(linear[1]) * half.y + glm::abs(linear[2]) * half.z;
+    return {new_center - new_extents, new_center + new_extents};
+  }
+};
+
+struct Sphere {
+ private:
+  glm::vec3 center_{0.f, 0.f, 0.f};
+  float radius_{10.f};
+
+ public:
+  Sphere() = default;
+  Sphere(const glm::vec3 &inCenter, float inRadius) : center_{inCenter}, radius_{inRadius} {}
+
+  [[nodiscard]] glm::vec3 center() const{return center_;}
+  [[nodiscard]] float radius() const{return radius_;}
+
+  //Non uniform scales keep the sphere conservative by using the largest axis
+  [[nodiscard]] Sphere Transformed(const glm::mat4& matrix) const
+  {
+    const float scale = std::max({glm::length(glm::vec3(matrix[0])),
+                                  glm::length(glm::vec3(matrix[1])),
+                                  glm::length(glm::vec3(matrix[2]))});
+    return {glm::vec3(matrix * glm::vec4(center_, 1.0f)), radius_ * scale};
+  }
+};
+
+#endif //BOUNDS_H_
@@ -0,0 +1,57 @@
+#ifndef CASCADED_SHADOW_MAP_H_
+#define CASCADED_SHADOW_MAP_H_
+
+#include <array>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "free_camera.h"
+#include "uniform_buffer.h"
+
+//Shadows of a directional light over the camera frustum. The frustum is split in kShadowCascades slices, closer
+//slices are smaller so they get more shadow texels per pixel on screen. Each cascade covers the bounding sphere of
+//its slice, its size doesn't change when the camera turns, and its origin is snapped to whole texels, so the
+//shadow edges don't shimmer when the camera moves. All cascades are layers of one depth array texture sampled with
+//hardware comparison.
+class CascadedShadowMap
+{
+ public:
+  //Casters this far behind a cascade, towards the light, still land in it
+  static constexpr float kCasterDistance = 50.0f;
+
+  void Create(int resolution);
+  void Delete();
+
+  //light_direction: where the light goes, from the light to the scene
+  void Update(const glm::mat4& view, float fov_y, float aspect, float z_near, float z_far,
+              const glm::vec3& light_direction);
+
+  //Binds the cascade layer with its viewport and clears it
+  void BeginCascade(int cascade) const;
+
+  [[nodiscard]] GLuint texture() const { return texture_; }
+  [[nodiscard]] int resolution() const { return resolution_; }
+  [[nodiscard]] const glm::mat4& light_space_matrix(int cascade) const { return light_space_matrices_[cascade]; }
+  //Volume of the cascade for the caster culling, extended towards the light
+  [[nodiscard]] const Frustum& frustum(int cascade) const { return frustums_[cascade]; }
+
+  //Fills the cascade part of the frame data
+  void Fill(FrameData& frame_data) const;
+
+  void DrawImGui();
+
+ private:
+  int resolution_ = 0;
+  //0 splits the frustum evenly, 1 logarithmically
+  float split_lambda_ = 0.75f;
+  GLuint texture_ = 0;
+  GLuint framebuffer_ = 0;
+
+  std::array<glm::mat4, kShadowCascades> light_space_matrices_{};
+  std::array<Frustum, kShadowCascades> frustums_{};
+  std::array<float, kShadowCascades> splits_{};
+  std::array<float, kShadowCascades> texel_sizes_{};
+};
+
+#endif //CASCADED_SHADOW_MAP_H_
@@ -0,0 +1,131 @@
+#ifndef CPU_PROFILER_H_
+#define CPU_PROFILER_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gpr5300
+{
+
+struct CpuZoneEvent
+{
+  const char* name;
+  std::uint64_t begin_ns;
+  std::uint64_t end_ns;
+};
+
+//Single producer (the owning thread), single consumer (the collecting thread). When it is full new events are
+//dropped, the producer never waits.
+class CpuEventRing
+{
+ public:
+  static constexpr std::size_t kCapacity = 1 << 14;
+
+  bool Push(const CpuZoneEvent& event)
+  {
+    const std::uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == kCapacity)
+      return false;
+    events_[head & (kCapacity - 1)] = event;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  template<typename Function>
+  void Drain(Function&& function)
+  {
+    const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const std::uint64_t head = head_.load(std::memory_order_acquire);
+    for (std::uint64_t i = tail; i < head; i++)
+    {
+      function(events_[i & (kCapacity - 1)]);
+    }
+    tail_.store(head, std::memory_order_release);
+  }
+
+ private:
+  std::array<CpuZoneEvent, kCapacity> events_;
+  alignas(64) std::atomic<std::uint64_t> head_ = 0;
+  alignas(64) std::atomic<std::uint64_t> tail_ = 0;
+};
+
+//Collects the zones of every thread while a capture runs, outside of a capture a zone costs one atomic load.
+//Zone names must outlive the capture (literals).
+class CpuProfiler
+{
+ public:
+  static std::uint64_t Now();
+
+  void BeginCapture();
+  //Stops recording and drains what is left, the capture stays available for WriteChromeTrace
+  void EndCapture();
+  [[nodiscard]] bool capturing() const { return capturing_.load(std::memory_order_relaxed); }
+
+  void Record(const char* name, std::uint64_t begin_ns, std::uint64_t end_ns);
+  //Moves the events of every thread out of their rings, to be called regularly (once per frame) while capturing
+  void Collect();
+  //Shown instead of the thread index in the trace
+  void SetThreadName(std::string_view name);
+
+  //chrome://tracing or Perfetto JSON
+  bool WriteChromeTrace(std::string_view path) const;
+
+ private:
+  struct ThreadEntry
+  {
+    std::unique_ptr<CpuEventRing> ring = std::make_unique<CpuEventRing>();
+    std::string name;
+  };
+
+  struct CollectedEvent
+  {
+    CpuZoneEvent zone;
+    std::size_t thread;
+  };
+
+  CpuEventRing& ThreadRing();
+  std::size_t ThreadIndex();
+
+  std::atomic<bool> capturing_ = false;
+  std::atomic<std::uint64_t> dropped_ = 0;
+  std::uint64_t capture_start_ns_ = 0;
+
+  mutable std::mutex mutex_;
+  //Threads are never unregistered, a ring outlives its thread so late events can still be drained
+  std::vector<ThreadEntry> threads_;
+  std::vector<CollectedEvent> events_;
+};
+
+CpuProfiler& GlobalCpuProfiler();
+
+//Zone closed at the end of the scope
+class CpuZone
+{
+ public:
+  explicit CpuZone(const char* name)
+      : name_(name), begin_ns_(GlobalCpuProfiler().capturing() ? CpuProfiler::Now() : 0)
+  {
+  }
+  ~CpuZone()
+  {
+    if (begin_ns_ != 0)
+      GlobalCpuProfiler().Record(name_, begin_ns_, CpuProfiler::Now());
+  }
+  CpuZone(const CpuZone&) = delete;
+  CpuZone& operator=(const CpuZone&) = delete;
+
+ private:
+  const char* name_;
+  std::uint64_t begin_ns_;
+};
+
+} // namespace gpr5300
+
+#endif //CPU_PROFILER_H_
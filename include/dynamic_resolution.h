@@ -0,0 +1,46 @@
+#ifndef DYNAMIC_RESOLUTION_H_
+#define DYNAMIC_RESOLUTION_H_
+
+namespace gpr5300
+{
+
+struct DynamicResolutionSettings
+{
+  bool enabled = false;
+  float target_ms = 16.0f;
+  //Fraction of the output size on each axis
+  float min_scale = 0.5f;
+  float max_scale = 1.0f;
+  //Hysteresis: the scale only goes up once the frame is under this fraction of the target
+  float headroom = 0.85f;
+  //Frames the scale is held after a change, the GPU times need that long to reflect it
+  int cooldown_frames = 30;
+};
+
+//Picks the render scale that keeps the GPU frame time under the target. The cost of a frame goes with its pixel
+//count, so the scale is corrected with the square root of the time ratio. Between headroom * target and the target
+//the scale is left alone, and every change waits for the cooldown, so the resolution doesn't oscillate.
+class DynamicResolution
+{
+ public:
+  static constexpr float kScaleStep = 0.05f; //changes are quantized, each new size means new render targets
+  static constexpr float kSmoothing = 0.1f;
+
+  //Feeds the last GPU frame time and returns the scale to render the next frame at, 1 when disabled
+  float Update(float gpu_frame_ms);
+
+  [[nodiscard]] float scale() const { return scale_; }
+  DynamicResolutionSettings& settings() { return settings_; }
+
+  void DrawImGui();
+
+ private:
+  DynamicResolutionSettings settings_;
+  float scale_ = 1.0f;
+  float smoothed_ms_ = 0.0f;
+  int frames_since_change_ = 0;
+};
+
+} // namespace gpr5300
+
+#endif //DYNAMIC_RESOLUTION_H_
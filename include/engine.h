@@ -1,18 +1,44 @@
 #pragma once
+#include <string>
+
+#include <glm/vec3.hpp>
+
+#include "dynamic_resolution.h"
 #include "scene3d.h"
 
 namespace gpr5300
 {
 
+//Offscreen benchmark run, for machines without a GPU nor a display (e.g. Mesa llvmpipe on the build servers)
+struct HeadlessSettings
+{
+    int frame_count = 300;
+    int width = 1280;
+    int height = 720;
+    //The camera does one turn around the center over the measured frames, every run sees the same images
+    glm::vec3 orbit_center = glm::vec3(0.0f, 1.0f, 0.0f);
+    float orbit_radius = 10.0f;
+    float orbit_height = 3.0f;
+    std::string image_path; //PNG of the last frame, skipped when empty
+    std::string stats_path; //CSV summary of the frame times, skipped when empty
+    std::string trace_path; //Chrome trace of the CPU zones over the measured frames, skipped when empty
+};
+
+//--headless [--frames N] [--size WxH] [--image file.png] [--stats file.csv] [--trace file.json],
+//false when --headless is missing
+bool ParseHeadlessArguments(int argc, char* argv[], HeadlessSettings& settings);
+
 class Engine
 {
 public:
     Engine(Scene* scene);
     void Run();
+    bool RunHeadless(const HeadlessSettings& settings);
 private:
     void Begin();
     void End();
     Scene* scene_ = nullptr;
+    DynamicResolution dynamic_resolution_;
     SDL_Window* window_ = nullptr;
     SDL_GLContext glRenderContext_{};
 };
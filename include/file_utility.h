@@ -1,8 +1,12 @@
 #pragma once
 
+#include <string>
 #include <string_view>
 
 namespace gpr5300
 {
     std::string LoadFile(std::string_view path);
+    //Path next to final_path to write it aside before renaming, unique to the caller so concurrent writers of the
+    //same file never share it
+    std::string TemporaryPath(std::string_view final_path);
 } // namespace gpr5300
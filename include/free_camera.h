@@ -1,9 +1,13 @@
 ﻿#ifndef FREE_CAMERA_H
 #define FREE_CAMERA_H
+#include <algorithm>
+#include <cmath>
 #include <glm/fwd.hpp>
 #include <glm/vec3.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/quaternion_geometric.hpp>
+#include "bounds.h"
+#include "frustum_culling.h"
 #include "model.h"
 
 enum Camera_Movement { FORWARD, BACKWARD, LEFT, RIGHT, UP, DOWN };
@@ -87,6 +91,16 @@ struct FreeCamera {
     view_ = glm::lookAt(camera_position_, camera_position_ + camera_front_, camera_up_);
   }
 
+  //Place the camera directly, yaw and pitch follow so the mouse picks up from there
+  void LookAt(const glm::vec3& position, const glm::vec3& target)
+  {
+    camera_position_ = position;
+    camera_front_ = glm::normalize(target - position);
+    pitch_ = glm::degrees(std::asin(std::clamp(camera_front_.y, -1.0f, 1.0f)));
+    yaw_ = glm::degrees(std::atan2(camera_front_.z, camera_front_.x));
+    view_ = glm::lookAt(camera_position_, camera_position_ + camera_front_, camera_up_);
+  }
+
   glm::mat4 GetViewMatrix() const { return glm::lookAt(camera_position_, camera_position_ + camera_front_, camera_up_);}
 
   glm::mat4 view() const { return view_;}
@@ -94,19 +108,6 @@ struct FreeCamera {
 
 };
 
-struct Sphere {
- private:
-  glm::vec3 center_{0.f, 0.f, 0.f};
-  float radius_{10.f};
-
- public:
-  Sphere(const glm::vec3 &inCenter, float inRadius) : center_{inCenter}, radius_{inRadius} {}
-
-  [[nodiscard]] glm::vec3 center() const{return center_;}
-  [[nodiscard]] float radius() const{return radius_;}
-};
-
-
 struct Plane {
   glm::vec3 normal = {0.f, 1.f, 0.f}; // unit vector
   float distance = 0.f;        // Distance with origin
@@ -117,8 +118,19 @@ struct Plane {
       : normal(glm::normalize(norm)),
         distance(glm::dot(normal, p1)) {}
 
+  //From a plane equation (a, b, c, d) with a * x + b * y + c * z + d >= 0 on the inner side
+  explicit Plane(const glm::vec4 &equation) {
+    const float length = glm::length(glm::vec3(equation));
+    normal = glm::vec3(equation) / length;
+    distance = -equation.w / length;
+  }
+
+  [[nodiscard]] float GetSignedDistance(const glm::vec3 &point) const {
+    return glm::dot(normal, point) - distance;
+  }
+
   [[nodiscard]] float GetSignedDistanceToPlaneFromACircle(const Sphere &circle) const {
-    return glm::dot(normal, circle.center()) - distance;
+    return GetSignedDistance(circle.center());
   }
 };
 
@@ -127,116 +139,72 @@ struct Plane {
 
 struct Frustum {
  private:
-  Plane topFace;
-  Plane bottomFace;
-
-  Plane rightFace;
-  Plane leftFace;
-
-  Plane farFace;
-  Plane nearFace;
-  std::array<Plane, 6> planes_ = {topFace, bottomFace, rightFace, leftFace, nearFace, farFace};
+  //left, right, bottom, top, near, far. Normals point inside
+  std::array<Plane, 6> planes_ = {};
 
 
  public:
 
-  void CreateFrustumFromCamera(const FreeCamera &cam, float aspect, float fovY, float zNear, float zFar) {
-    const float halfVSide = zFar * tanf(fovY * 0.5f);
-    const float halfHSide = halfVSide * aspect;
-    const glm::vec3 frontMultFar = zFar * cam.camera_front_;
-
-    nearFace = {cam.camera_position_ + zNear * cam.camera_front_, cam.camera_front_};
-    farFace = {cam.camera_position_ + frontMultFar, -cam.camera_front_};
-    rightFace = {cam.camera_position_, glm::cross(frontMultFar - cam.camera_right_ * halfHSide, cam.camera_up_)};
-    leftFace = {cam.camera_position_, glm::cross(cam.camera_up_, frontMultFar + cam.camera_right_ * halfHSide)};
-    topFace = {cam.camera_position_, glm::cross(cam.camera_right_, frontMultFar - cam.camera_up_ * halfVSide)};
-    bottomFace = {cam.camera_position_, glm::cross(frontMultFar + cam.camera_up_ * halfVSide, cam.camera_right_)};
+  //Gribb-Hartmann: in clip space every plane is a row of the view-projection matrix added to or removed
+  //from the w row, which gives the world space planes directly
+  void Update(const glm::mat4& projView) {
+    const auto row = [&projView](int i) {
+      return glm::vec4(projView[0][i], projView[1][i], projView[2][i], projView[3][i]);
+    };
+    const glm::vec4 w_row = row(3);
+    planes_[0] = Plane(w_row + row(0));
+    planes_[1] = Plane(w_row - row(0));
+    planes_[2] = Plane(w_row + row(1));
+    planes_[3] = Plane(w_row - row(1));
+    planes_[4] = Plane(w_row + row(2));
+    planes_[5] = Plane(w_row - row(2));
+  }
+
+  //Same planes for the batch kernels of frustum_culling.h
+  [[nodiscard]] gpr5300::FrustumPlanes plane_equations() const {
+    gpr5300::FrustumPlanes equations;
+    for (std::size_t i = 0; i < planes_.size(); i++)
+      equations[i] = glm::vec4(planes_[i].normal, -planes_[i].distance);
+    return equations;
   }
 
-  void Update(const glm::mat4& projView) {
-    // Extraire les plans du frustum à partir de la matrice projetée-vue (projView)
-    glm::mat4 matrix = glm::transpose(projView); // Assurez-vous de transposer la matrice si nécessaire
-
-
-
-    // Plage de valeurs pour les plans
-    topFace.normal = glm::vec3(matrix[0][3] + matrix[0][0], matrix[1][3] + matrix[1][0], matrix[2][3] + matrix[2][0]);
-    bottomFace.normal = glm::vec3(matrix[0][3] - matrix[0][0], matrix[1][3] - matrix[1][0], matrix[2][3] - matrix[2][0]);
-    rightFace.normal = glm::vec3(matrix[0][3] - matrix[0][1], matrix[1][3] - matrix[1][1], matrix[2][3] - matrix[2][1]);
-    leftFace.normal = glm::vec3(matrix[0][3] + matrix[0][1], matrix[1][3] + matrix[1][1], matrix[2][3] + matrix[2][1]);
-    nearFace.normal = glm::vec3(matrix[0][3] + matrix[0][2], matrix[1][3] + matrix[1][2], matrix[2][3] + matrix[2][2]);
-    farFace.normal = glm::vec3(matrix[0][3] - matrix[0][2], matrix[1][3] - matrix[1][2], matrix[2][3] - matrix[2][2]);
-
-    // Calculer les distances de chaque plan à l'origine (le point d'intersection du plan et de la vue)
-    topFace.distance = -(matrix[0][3] + matrix[0][0]);
-    bottomFace.distance = -(matrix[0][3] - matrix[0][0]);
-    rightFace.distance = -(matrix[0][3] - matrix[0][1]);
-    leftFace.distance = -(matrix[0][3] + matrix[0][1]);
-    nearFace.distance = -(matrix[0][3] + matrix[0][2]);
-    farFace.distance = -(matrix[0][3] - matrix[0][2]);
-
-    // Normaliser les vecteurs normaux des plans
-    topFace.normal = glm::normalize(topFace.normal);
-    bottomFace.normal = glm::normalize(bottomFace.normal);
-    rightFace.normal = glm::normalize(rightFace.normal);
-    leftFace.normal = glm::normalize(leftFace.normal);
-    nearFace.normal = glm::normalize(nearFace.normal);
-    farFace.normal = glm::normalize(farFace.normal);
+  //Bounds are cached in model space at load, only moved by the model matrix here
+  bool IsObjectInFrustum(const Model& model, const glm::mat4& transform) const {
+    return IsBoundsInFrustum(model.bounding_box(), model.bounding_sphere(), transform);
   }
 
-  bool IsObjectInFrustum(const Model& model) const {
-    // Calculer la boîte englobante de l'objet (par exemple, avec les coins du modèle)
-    glm::vec3 min, max;
-    model.GetBoundingBox(min, max);
+  bool IsMeshInFrustum(const Mesh& mesh, const glm::mat4& transform) const {
+    return IsBoundsInFrustum(mesh.bounding_box(), mesh.bounding_sphere(), transform);
+  }
 
-    // Vérifier si la boîte est à l'intérieur du frustum (cela dépend de votre implémentation du frustum)
-    return IsAABBInFrustum(min, max);
+  //The sphere test is cheap and rejects most of the invisible objects, the box test refines the rest
+  bool IsBoundsInFrustum(const BoundingBox& box, const Sphere& sphere, const glm::mat4& transform) const {
+    if (box.empty())
+      return false;
+    if (!IsSphereInFrustum(sphere.Transformed(transform)))
+      return false;
+    const BoundingBox world_box = box.Transformed(transform);
+    return IsAABBInFrustum(world_box.min, world_box.max);
   }
 
 
+  //Positive vertex test: the box is out as soon as its corner farthest along a plane normal is behind that plane
   bool IsAABBInFrustum(const glm::vec3& min, const glm::vec3& max) const {
-    for (int i = 0; i < 6; ++i) {
-      const Plane& plane = planes_[i]; // Utilise une référence constante
-
-      // Les 8 coins de la boîte englobante
-      glm::vec3 corners[8] = {
-          glm::vec3(min.x, min.y, min.z), // coin inférieur-gauche-arrière
-          glm::vec3(min.x, min.y, max.z), // coin inférieur-gauche-avant
-          glm::vec3(min.x, max.y, min.z), // coin supérieur-gauche-arrière
-          glm::vec3(min.x, max.y, max.z), // coin supérieur-gauche-avant
-          glm::vec3(max.x, min.y, min.z), // coin inférieur-droit-arrière
-          glm::vec3(max.x, min.y, max.z), // coin inférieur-droit-avant
-          glm::vec3(max.x, max.y, min.z), // coin supérieur-droit-arrière
-          glm::vec3(max.x, max.y, max.z)  // coin supérieur-droit-avant
-      };
-
-      bool inside = false;
-      for (int j = 0; j < 8; ++j) {
-        // Vérifie si un coin de la boîte est à l'intérieur du plan
-        if (glm::dot(plane.normal, corners[j]) + plane.distance > 0) {
-          inside = true;
-          break;
-        }
-      }
-
-      if (!inside)
+    for (const Plane& plane : planes_) {
+      const glm::vec3 positive(plane.normal.x >= 0.f ? max.x : min.x,
+                               plane.normal.y >= 0.f ? max.y : min.y,
+                               plane.normal.z >= 0.f ? max.z : min.z);
+      if (plane.GetSignedDistance(positive) < 0.f)
         return false;
     }
-
     return true;
   }
 
 
   [[nodiscard]] bool IsSphereInFrustum(const Sphere &sphere) const {
-    // Pour chaque plan du frustum
-    std::array<Plane, 6> allPlanes = {topFace, bottomFace, rightFace, leftFace, nearFace, farFace};
-
-    for (const auto &plane : allPlanes) {
-      // Calcul de la distance entre le centre de la sphère et le plan
-      float distance = plane.GetSignedDistanceToPlaneFromACircle(sphere);
-
+    for (const auto &plane : planes_) {
       // Si la distance est plus grande que le rayon de la sphère, la sphère est à l'extérieur du frustum
-      if (distance < -sphere.radius()) {
+      if (plane.GetSignedDistanceToPlaneFromACircle(sphere) < -sphere.radius()) {
         return false;
       }
     }
@@ -244,35 +212,7 @@ struct Frustum {
   }
 
   [[nodiscard]] bool IsCubeInFrustum(const glm::vec3 &center, float halfSize) const {
-    glm::vec3 vertices[8] = {
-        center + glm::vec3(-halfSize, -halfSize, -halfSize),
-        center + glm::vec3(-halfSize, -halfSize,  halfSize),
-        center + glm::vec3(-halfSize,  halfSize, -halfSize),
-        center + glm::vec3(-halfSize,  halfSize,  halfSize),
-        center + glm::vec3( halfSize, -halfSize, -halfSize),
-        center + glm::vec3( halfSize, -halfSize,  halfSize),
-        center + glm::vec3( halfSize,  halfSize, -halfSize),
-        center + glm::vec3( halfSize,  halfSize,  halfSize)
-    };
-
-    const Plane planes[] = {topFace, bottomFace, rightFace, leftFace, nearFace, farFace};
-    for (const auto &plane : planes) {
-      bool allOutside = true;
-
-      for (const auto &vertex : vertices) {
-        float distance = glm::dot(plane.normal, vertex) - plane.distance;
-        if (distance >= 0) {
-          allOutside = false;
-          break; // Au moins un sommet est devant ce plan
-        }
-      }
-
-      if (allOutside) {
-        return false;
-      }
-    }
-
-    return true;
+    return IsAABBInFrustum(center - glm::vec3(halfSize), center + glm::vec3(halfSize));
   }
 
 };
@@ -0,0 +1,51 @@
+#ifndef FRUSTUM_CULLING_H_
+#define FRUSTUM_CULLING_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/vec4.hpp>
+
+#include "bounds.h"
+
+namespace gpr5300
+{
+
+//Plane equations (normal, w) in world space, a point p is inside when dot(normal, p) + w >= 0
+using FrustumPlanes = std::array<glm::vec4, 6>;
+
+//Boxes stored as structure of arrays so that one SIMD lane tests one box
+struct AabbArray
+{
+  std::vector<float> min_x, min_y, min_z;
+  std::vector<float> max_x, max_y, max_z;
+
+  void Add(const BoundingBox& box);
+  void Clear();
+  [[nodiscard]] std::size_t size() const { return min_x.size(); }
+};
+
+struct SphereArray
+{
+  std::vector<float> center_x, center_y, center_z;
+  std::vector<float> radius;
+
+  void Add(const Sphere& sphere);
+  void Clear();
+  [[nodiscard]] std::size_t size() const { return center_x.size(); }
+};
+
+//Write the indices of the objects touching the frustum to visible (at least size() long) and return their count.
+//Boxes use the positive vertex test: per plane only the corner farthest along the normal is checked.
+std::size_t CullAabbs(const FrustumPlanes& planes, const AabbArray& boxes, std::span<std::uint32_t> visible);
+std::size_t CullSpheres(const FrustumPlanes& planes, const SphereArray& spheres, std::span<std::uint32_t> visible);
+
+//One object at a time, the reference the SIMD versions must agree with
+std::size_t CullAabbsScalar(const FrustumPlanes& planes, const AabbArray& boxes, std::span<std::uint32_t> visible);
+std::size_t CullSpheresScalar(const FrustumPlanes& planes, const SphereArray& spheres, std::span<std::uint32_t> visible);
+
+} // namespace gpr5300
+
+#endif //FRUSTUM_CULLING_H_
@@ -0,0 +1,145 @@
+#ifndef GEOMETRY_ARENA_H_
+#define GEOMETRY_ARENA_H_
+
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include "mapped_ring_buffer.h"
+#include "mesh.h"
+#include "shader.h"
+
+//Shader storage binding of the per-draw data, must match the DrawData block of the vertex shaders
+static constexpr GLuint kDrawDataBinding = 3;
+
+//CPU mirror of the std430 DrawData struct in the shaders, read with drawOffset + gl_DrawIDARB
+struct DrawData
+{
+  glm::mat4 model;
+  glm::vec4 position_offset; //w unused, see Mesh::position_offset
+  glm::vec4 position_scale;
+};
+
+//Layout glMultiDrawElementsIndirect reads its commands in
+struct DrawElementsIndirectCommand
+{
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+//First fit over [0, capacity), the freed ranges are merged with their neighbours
+class ArenaFreeList
+{
+ public:
+  void Reset(std::size_t capacity);
+  //Makes [capacity, new_capacity) free
+  void Grow(std::size_t new_capacity);
+
+  bool Allocate(std::size_t size, std::size_t alignment, std::size_t& offset);
+  void Free(std::size_t offset, std::size_t size);
+
+  [[nodiscard]] std::size_t capacity() const { return capacity_; }
+  [[nodiscard]] std::size_t used() const { return used_; }
+
+ private:
+  struct Range
+  {
+    std::size_t offset;
+    std::size_t size;
+  };
+  void Insert(Range range);
+
+  //Sorted by offset, never adjacent
+  std::vector<Range> free_;
+  std::size_t capacity_ = 0;
+  std::size_t used_ = 0;
+};
+
+//Compact meshes of every model in one vertex buffer and one index buffer read by a single VAO, so a whole model is
+//drawn with glMultiDrawElementsIndirect. Each mesh gets a range of both buffers, the buffers grow when full.
+//The commands and the per-draw data are written in persistently mapped rings, one region per frame.
+class GeometryArena
+{
+ public:
+  static constexpr std::size_t kDefaultVertexCapacity = std::size_t{1} << 20;
+  static constexpr std::size_t kDefaultIndexCapacity = std::size_t{8} << 20; //bytes
+  static constexpr std::size_t kMaxDrawsPerFrame = 4096;
+
+  void Create(std::size_t vertex_capacity = kDefaultVertexCapacity,
+              std::size_t index_capacity = kDefaultIndexCapacity);
+  void Delete();
+
+  //Uploads a mesh, with 16 bit indices when its vertices allow it
+  bool Allocate(std::span<const CompactVertex> vertices, std::span<const unsigned int> indices,
+                GeometryAllocation& allocation);
+  //Uploads a mesh whose indices are already 16 bit (see MeshData::Compact) as is
+  bool Allocate(std::span<const CompactVertex> vertices, std::span<const std::uint16_t> indices,
+                GeometryAllocation& allocation);
+  void Free(const GeometryAllocation& allocation);
+
+  //Once per frame around every Submit, after the previous frame's EndFrame
+  void BeginFrame();
+  void EndFrame();
+
+  //Queues a draw of mesh, Submit issues every draw queued since the last one
+  void AddDraw(const Mesh& mesh, const glm::mat4& model);
+  //One multi-draw per index type with shader in use, the textures are the caller's. Shaders without
+  //GL_ARB_shader_draw_parameters get one command per call and their draw index in drawOffset.
+  void Submit(const Shader& shader);
+
+  [[nodiscard]] GLuint vao() const { return vao_; }
+  //Off forces the one command per call path even where the multi-draw is supported
+  void set_draw_parameters(bool enabled) { draw_parameters_ = enabled && draw_parameters_supported_; }
+  [[nodiscard]] bool draw_parameters() const { return draw_parameters_; }
+  //Of the last finished frame
+  [[nodiscard]] std::size_t draws() const { return draws_; }
+  [[nodiscard]] std::size_t draw_calls() const { return draw_calls_; }
+
+  void DrawImGui() const;
+
+ private:
+  struct QueuedDraw
+  {
+    DrawElementsIndirectCommand command;
+    DrawData data;
+  };
+
+  bool Allocate(std::span<const CompactVertex> vertices, const void* indices, std::size_t index_count,
+                GLenum index_type, GeometryAllocation& allocation);
+  void SubmitQueue(const Shader& shader, std::vector<QueuedDraw>& draws, GLenum index_type);
+  bool GrowVertices(std::size_t min_capacity);
+  bool GrowIndices(std::size_t min_capacity);
+  static GLuint CopyToLargerBuffer(GLuint buffer, std::size_t size, std::size_t new_size);
+
+  GLuint vao_ = 0;
+  GLuint vertex_buffer_ = 0;
+  GLuint index_buffer_ = 0;
+  ArenaFreeList vertices_;
+  ArenaFreeList indices_;
+
+  MappedRingBuffer commands_;
+  MappedRingBuffer draw_data_;
+  bool draw_parameters_supported_ = false;
+  bool draw_parameters_ = false;
+  bool in_frame_ = false;
+  DrawElementsIndirectCommand* frame_commands_ = nullptr;
+  DrawData* frame_data_ = nullptr;
+  //Draws written in this frame's region so far
+  std::size_t frame_draws_ = 0;
+  //Queued since the last Submit, per index type
+  std::vector<QueuedDraw> short_draws_;
+  std::vector<QueuedDraw> int_draws_;
+
+  //Last finished frame, for the stats
+  std::size_t draws_ = 0;
+  std::size_t draw_calls_ = 0;
+  std::size_t frame_draw_calls_ = 0;
+};
+
+#endif //GEOMETRY_ARENA_H_
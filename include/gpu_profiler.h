@@ -0,0 +1,99 @@
+#ifndef GPU_PROFILER_H_
+#define GPU_PROFILER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <GL/glew.h>
+
+struct GpuZoneResult
+{
+  const char* name;
+  int depth;
+  float start_ms; //from the start of the frame
+  float duration_ms;
+};
+
+//GPU time of nested passes. Each zone records a timestamp query at its begin and end, and the results are read
+//kFrameLatency frames later, so the CPU never waits on the GPU. Zone names must outlive the profiler (literals).
+class GpuProfiler
+{
+ public:
+  static constexpr std::size_t kFrameLatency = 4;
+  //Frames kept for the CSV and Chrome trace exports
+  static constexpr std::size_t kCaptureFrames = 240;
+  static constexpr std::size_t kHistoryFrames = 120;
+
+  void Delete();
+
+  //Reads back the oldest frame if the GPU is done with it, then opens the root zone of the new frame
+  void BeginFrame();
+  void EndFrame();
+
+  void BeginZone(const char* name);
+  void EndZone();
+
+  //Zones of the last frame read back, in begin order, the root zone first
+  [[nodiscard]] std::span<const GpuZoneResult> results() const { return results_; }
+
+  void DrawImGui();
+  bool WriteCsv(std::string_view path) const;
+  //chrome://tracing or Perfetto JSON
+  bool WriteChromeTrace(std::string_view path) const;
+
+ private:
+  struct PendingZone
+  {
+    const char* name;
+    int depth;
+    std::uint32_t begin_query;
+    std::uint32_t end_query;
+  };
+
+  struct PendingFrame
+  {
+    std::vector<GLuint> queries; //grows to the deepest frame seen, never shrinks
+    std::uint32_t used_queries = 0;
+    std::vector<PendingZone> zones;
+  };
+
+  struct CapturedFrame
+  {
+    std::uint64_t index;
+    GLuint64 start_ns;
+    std::vector<GpuZoneResult> zones;
+  };
+
+  std::uint32_t Timestamp(PendingFrame& frame);
+  void ReadBack(PendingFrame& frame, std::uint64_t frame_index);
+  std::size_t DrawZoneTree(std::size_t index) const;
+
+  std::array<PendingFrame, kFrameLatency> frames_;
+  std::uint64_t frame_index_ = 0;
+  std::vector<std::size_t> open_zones_;
+  std::vector<GLuint64> timestamps_;
+  std::vector<GpuZoneResult> results_;
+  std::array<float, kHistoryFrames> frame_history_ms_ = {};
+  std::size_t history_offset_ = 0;
+
+  bool capturing_ = false;
+  std::vector<CapturedFrame> captured_;
+};
+
+//Zone closed at the end of the scope
+class GpuZone
+{
+ public:
+  GpuZone(GpuProfiler& profiler, const char* name) : profiler_(profiler) { profiler_.BeginZone(name); }
+  ~GpuZone() { profiler_.EndZone(); }
+  GpuZone(const GpuZone&) = delete;
+  GpuZone& operator=(const GpuZone&) = delete;
+
+ private:
+  GpuProfiler& profiler_;
+};
+
+#endif //GPU_PROFILER_H_
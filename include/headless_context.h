@@ -0,0 +1,24 @@
+#ifndef HEADLESS_CONTEXT_H_
+#define HEADLESS_CONTEXT_H_
+
+namespace gpr5300
+{
+
+//GL 4.5 core context without a window nor a display server (EGL surfaceless, e.g. Mesa llvmpipe on a build server).
+//There is no default framebuffer: everything has to be drawn into framebuffers the caller creates.
+//Only available when the build found EGL (GPR5300_HEADLESS), Create fails otherwise.
+class HeadlessContext
+{
+ public:
+  bool Create();
+  void Destroy();
+
+ private:
+  //EGLDisplay and EGLContext, kept opaque so the EGL headers stay out of the engine
+  void* display_ = nullptr;
+  void* context_ = nullptr;
+};
+
+} // namespace gpr5300
+
+#endif //HEADLESS_CONTEXT_H_
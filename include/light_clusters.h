@@ -0,0 +1,98 @@
+#ifndef LIGHT_CLUSTERS_H_
+#define LIGHT_CLUSTERS_H_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "frustum_culling.h"
+
+//Shader storage binding points, must match the blocks declared in model.frag and lightning_pass.frag
+static constexpr GLuint kPointLightsBinding = 0;
+static constexpr GLuint kLightClustersBinding = 1;
+static constexpr GLuint kLightIndicesBinding = 2;
+
+//CPU mirror of the std430 PointLight struct in the shaders
+struct PointLight
+{
+  glm::vec4 position_radius; //world space, the light reaches nothing past the radius
+  glm::vec4 color;
+};
+
+//Distance at which the shaders' attenuation brings a light of this color under kLightCutoff
+float PointLightRadius(const glm::vec3& color);
+
+//Clustered shading: the view frustum is cut in screen tiles and exponential depth slices, every light is binned
+//into the clusters its sphere touches, and a fragment only loops over the lights of its own cluster.
+//The binning runs on the CPU each frame, after the lights outside the frustum were rejected with CullSpheres.
+class LightClusters
+{
+ public:
+  //must match kClusterGrid in the shaders
+  static constexpr int kClusterX = 16;
+  static constexpr int kClusterY = 9;
+  static constexpr int kClusterZ = 24;
+  static constexpr int kClusterCount = kClusterX * kClusterY * kClusterZ;
+  static constexpr std::size_t kMaxPointLights = 1024;
+  static constexpr std::size_t kMaxLightIndices = 64 * 1024;
+
+  void Create();
+  void Delete();
+
+  //Uploads the lights touching the frustum and the cluster lists, the buffers stay on their binding points.
+  //The projection must be a symmetric perspective, as glm::perspective builds.
+  void Update(std::span<const PointLight> lights, const glm::mat4& view, const glm::mat4& projection,
+              const gpr5300::FrustumPlanes& planes);
+  //CPU half of Update, bins the lights without uploading anything
+  void Bin(std::span<const PointLight> lights, const glm::mat4& view, const glm::mat4& projection,
+           const gpr5300::FrustumPlanes& planes);
+
+  //Result of the last binning, the indices refer to visible_lights()
+  [[nodiscard]] std::span<const PointLight> visible_lights() const { return visible_lights_; }
+  //offset, count in light_indices() per cluster, x + kClusterX * (y + kClusterY * z)
+  [[nodiscard]] std::span<const glm::uvec2> clusters() const { return clusters_; }
+  [[nodiscard]] std::span<const std::uint32_t> light_indices() const { return indices_; }
+
+  void DrawImGui() const;
+
+ private:
+  //Inclusive cluster ranges touched by one visible light
+  struct LightBounds
+  {
+    int min_x, max_x;
+    int min_y, max_y;
+    int min_z, max_z;
+  };
+
+  bool ComputeBounds(const glm::vec3& view_position, float radius, LightBounds& bounds) const;
+
+  GLuint lights_buffer_ = 0;
+  GLuint clusters_buffer_ = 0;
+  GLuint indices_buffer_ = 0;
+
+  //Tile boundary planes through the eye, (x or y, z) coefficients of their normalized equations
+  glm::vec2 column_planes_[kClusterX + 1] = {};
+  glm::vec2 row_planes_[kClusterY + 1] = {};
+  float near_ = 0.1f;
+  float far_ = 100.0f;
+  float slice_scale_ = 1.0f;
+
+  gpr5300::SphereArray spheres_;
+  std::vector<std::uint32_t> visible_;
+  std::vector<PointLight> visible_lights_;
+  std::vector<LightBounds> bounds_;
+  //offset, count in indices_ per cluster
+  std::vector<glm::uvec2> clusters_;
+  std::vector<std::uint32_t> cursors_;
+  std::vector<std::uint32_t> indices_;
+
+  std::size_t max_lights_per_cluster_ = 0;
+  std::size_t dropped_indices_ = 0;
+};
+
+#endif //LIGHT_CLUSTERS_H_
@@ -0,0 +1,36 @@
+#ifndef MAPPED_RING_BUFFER_H_
+#define MAPPED_RING_BUFFER_H_
+
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+//Persistently mapped buffer split in regions: the CPU writes one region per frame while the GPU still reads the
+//previous ones. A fence per region keeps the CPU from overwriting data a pending draw hasn't consumed yet.
+class MappedRingBuffer
+{
+ public:
+  static constexpr std::size_t kDefaultRegionCount = 3;
+
+  void Create(GLenum target, std::size_t region_size, std::size_t region_count = kDefaultRegionCount);
+  void Delete();
+
+  //Waits until the current region is free and returns where to write it, nullptr when the buffer isn't mapped
+  void* BeginRegion();
+  //Fences the region, to be called once the draws reading it are issued
+  void EndRegion();
+
+  [[nodiscard]] GLuint buffer() const { return buffer_; }
+  [[nodiscard]] std::size_t region_index() const { return region_; }
+  [[nodiscard]] std::size_t region_offset() const { return region_ * region_size_; }
+
+ private:
+  GLuint buffer_ = 0;
+  GLenum target_ = GL_ARRAY_BUFFER;
+  std::byte* data_ = nullptr;
+  std::size_t region_size_ = 0;
+  std::size_t region_ = 0;
+  std::vector<GLsync> fences_;
+};
+
+#endif //MAPPED_RING_BUFFER_H_
@@ -1,23 +1,192 @@
 ﻿#ifndef MESH_H
 #define MESH_H
+#include <algorithm>
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 #include <GL/glew.h>
+#include <glm/gtc/packing.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
+#include "bounds.h"
+#include "shader.h"
+
 struct Vertex{
   glm::vec3 Position;
   glm::vec3 Normal;
   glm::vec2 TexCoords;
 };
 
+//Layout of a mesh on the GPU
+enum class VertexFormat : std::uint8_t
+{
+  kFloat,  //Vertex as is, 32 bytes, 32 bit indices
+  kCompact //CompactVertex, 16 bytes, 16 bit indices when they fit
+};
+
+//Half the size of Vertex, the vertex shaders dequantize it (see Mesh::BindVertexFormat)
+struct CompactVertex{
+  std::uint16_t position[4]; //unorm16 inside the box of the mesh, w is padding
+  std::uint16_t normal[2];   //snorm16 octahedral, same mapping as the G-buffer normals
+  std::uint16_t tex_coords[2]; //half float
+};
+static_assert(sizeof(CompactVertex) == 16);
+//Compact meshes with up to this many vertices get 16 bit indices
+inline constexpr std::size_t kMaxShortIndexedVertices = 65536;
+
+//Folds the unit sphere on the [-1, 1] square
+inline glm::vec2 OctahedralEncode(const glm::vec3& normal)
+{
+  const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (length <= 0.0f)
+    return glm::vec2(0.0f);
+  const glm::vec3 n = normal / length;
+  if (n.z >= 0.0f)
+    return glm::vec2(n.x, n.y);
+  return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                   (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+//position_scale is the size of the box, a flat axis has a scale of 0 and every vertex at 0 on it
+inline CompactVertex CompressVertex(const Vertex& vertex, const glm::vec3& position_offset,
+                                    const glm::vec3& position_scale)
+{
+  CompactVertex compact{};
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const float t = position_scale[axis] > 0.0f ?
+        (vertex.Position[axis] - position_offset[axis]) / position_scale[axis] : 0.0f;
+    compact.position[axis] = glm::packUnorm1x16(t);
+  }
+  const glm::vec2 normal = OctahedralEncode(vertex.Normal);
+  compact.normal[0] = glm::packSnorm1x16(normal.x);
+  compact.normal[1] = glm::packSnorm1x16(normal.y);
+  compact.tex_coords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+  compact.tex_coords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+  return compact;
+}
+
+//Box the compact positions are quantized in: a 16 bit step is box size / 65535 whatever the model scale
+inline void CompactPositionRange(const BoundingBox& box, glm::vec3& position_offset, glm::vec3& position_scale)
+{
+  position_offset = glm::vec3(0.0f);
+  position_scale = glm::vec3(1.0f);
+  if (!box.empty())
+  {
+    position_offset = box.min;
+    position_scale = box.max - box.min;
+  }
+}
+
+inline std::vector<CompactVertex> CompressVertices(std::span<const Vertex> vertices, const glm::vec3& position_offset,
+                                                   const glm::vec3& position_scale)
+{
+  std::vector<CompactVertex> compact_vertices;
+  compact_vertices.reserve(vertices.size());
+  for (const Vertex& vertex : vertices)
+    compact_vertices.push_back(CompressVertex(vertex, position_offset, position_scale));
+  return compact_vertices;
+}
+
+//Centered on the box, radius from the farthest vertex: tighter than the half diagonal of the box
+inline Sphere ComputeBoundingSphere(const BoundingBox& box, std::span<const Vertex> vertices)
+{
+  const glm::vec3 center = box.center();
+  float radius_squared = 0.0f;
+  for (const Vertex& vertex : vertices)
+  {
+    const glm::vec3 offset = vertex.Position - center;
+    radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+  }
+  return {center, std::sqrt(radius_squared)};
+}
+
+//Where the vertices and indices of a mesh start in its buffers, in elements. Both are 0 when the mesh has buffers of
+//its own, GeometryArena hands out ranges of buffers shared by many meshes.
+struct GeometryAllocation
+{
+  std::size_t first_vertex = 0;
+  std::size_t vertex_count = 0;
+  std::size_t first_index = 0;
+  std::size_t index_count = 0;
+  GLenum index_type = GL_UNSIGNED_INT; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+
+  [[nodiscard]] std::size_t index_size() const
+  {
+    return index_type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+  }
+};
+
 struct Texture{
-  unsigned int id;
+  unsigned int id = 0;
   std::string type;
   std::string path;
 };
 
+//CPU side of a mesh between the import (any thread) and the upload (GL thread)
+struct MeshData
+{
+  //kFloat meshes fill vertices and indices. kCompact ones fill compact_vertices, and short_indices when there are
+  //at most kMaxShortIndexedVertices vertices, indices otherwise
+  VertexFormat vertex_format = VertexFormat::kFloat;
+  std::vector<Vertex> vertices;
+  std::vector<CompactVertex> compact_vertices;
+  std::vector<unsigned int> indices;
+  std::vector<std::uint16_t> short_indices;
+  //Used instead of the vectors when the mesh is read in place from a mapped mesh cache
+  std::span<const Vertex> mapped_vertices;
+  std::span<const CompactVertex> mapped_compact_vertices;
+  std::span<const unsigned int> mapped_indices;
+  std::span<const std::uint16_t> mapped_short_indices;
+  std::vector<Texture> textures; //type and path only, the GL names are given at upload
+  //Model space, computed once at import
+  BoundingBox bounding_box;
+  Sphere bounding_sphere;
+  //Model space position = position_offset + attribute * position_scale for compact vertices
+  glm::vec3 position_offset = glm::vec3(0.0f);
+  glm::vec3 position_scale = glm::vec3(1.0f);
+
+  [[nodiscard]] std::span<const Vertex> vertex_data() const
+  {
+    return mapped_vertices.empty() ? std::span<const Vertex>(vertices) : mapped_vertices;
+  }
+  [[nodiscard]] std::span<const CompactVertex> compact_vertex_data() const
+  {
+    return mapped_compact_vertices.empty() ? std::span<const CompactVertex>(compact_vertices) :
+        mapped_compact_vertices;
+  }
+  [[nodiscard]] std::span<const unsigned int> index_data() const
+  {
+    return mapped_indices.empty() ? std::span<const unsigned int>(indices) : mapped_indices;
+  }
+  [[nodiscard]] std::span<const std::uint16_t> short_index_data() const
+  {
+    return mapped_short_indices.empty() ? std::span<const std::uint16_t>(short_indices) : mapped_short_indices;
+  }
+
+  //Quantizes the float vertices and narrows the indices, meant for the loader thread so the GL thread and the mesh
+  //cache get the layout the GPU reads
+  void Compact()
+  {
+    if (vertex_format == VertexFormat::kCompact)
+      return;
+    CompactPositionRange(bounding_box, position_offset, position_scale);
+    compact_vertices = CompressVertices(vertex_data(), position_offset, position_scale);
+    if (compact_vertices.size() <= kMaxShortIndexedVertices)
+    {
+      const std::span<const unsigned int> wide_indices = index_data();
+      short_indices.assign(wide_indices.begin(), wide_indices.end());
+      indices = {};
+      mapped_indices = {};
+    }
+    vertices = {};
+    mapped_vertices = {};
+    vertex_format = VertexFormat::kCompact;
+  }
+};
+
 class Mesh
 {
  public:
@@ -27,38 +196,105 @@ class Mesh
   std::vector<Texture> textures_;
 
   [[nodiscard]] unsigned int VAO() const {return VAO_;}
+  [[nodiscard]] unsigned int index_count() const {return static_cast<unsigned int>(allocation_.index_count);}
+  //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, for glDrawElements*
+  [[nodiscard]] GLenum index_type() const {return allocation_.index_type;}
+  [[nodiscard]] const GeometryAllocation& allocation() const {return allocation_;}
+  //Model space position = position_offset + attribute * position_scale
+  [[nodiscard]] const glm::vec3& position_offset() const {return position_offset_;}
+  [[nodiscard]] const glm::vec3& position_scale() const {return position_scale_;}
+  [[nodiscard]] VertexFormat vertex_format() const {return vertex_format_;}
+  [[nodiscard]] const BoundingBox& bounding_box() const {return bounding_box_;}
+  [[nodiscard]] const Sphere& bounding_sphere() const {return bounding_sphere_;}
 
-  Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+  Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+       VertexFormat vertex_format = VertexFormat::kCompact)
   {
     this->vertices_ = vertices;
     this->indices_ = indices;
     this->textures_ = textures;
+    AssignSamplerUnits();
+
+    for (const Vertex& vertex : vertices_)
+    {
+      bounding_box_.Extend(vertex.Position);
+    }
+    bounding_sphere_ = ComputeBoundingSphere(bounding_box_, vertices_);
 
-    SetupMesh();
+    SetupMesh(vertices_, indices_, vertex_format);
   }
-  void Draw(GLuint& shader)
+
+  //Upload straight from data in its own layout, which may be memory we don't own (e.g. a mapped mesh cache), no CPU
+  //copy is kept
+  Mesh(const MeshData& data, std::vector<Texture> textures)
   {
-    unsigned int diffuseNr = 1;
-    unsigned int specularNr = 1;
-    for(unsigned int i = 0; i < textures_.size(); i++)
+    this->textures_ = std::move(textures);
+    AssignSamplerUnits();
+    bounding_box_ = data.bounding_box;
+    bounding_sphere_ = data.bounding_sphere;
+
+    if (data.vertex_format == VertexFormat::kCompact)
+    {
+      position_offset_ = data.position_offset;
+      position_scale_ = data.position_scale;
+      SetupCompactMesh(data.compact_vertex_data(), data.short_index_data(), data.index_data());
+    }
+    else
+    {
+      SetupMesh(data.vertex_data(), data.index_data(), VertexFormat::kFloat);
+    }
+  }
+
+  //Compact mesh already uploaded in shared buffers: vao reads them, allocation is where the mesh is in them
+  Mesh(GLuint vao, const GeometryAllocation& allocation, std::vector<Texture> textures,
+       const BoundingBox& bounding_box, const Sphere& bounding_sphere, const glm::vec3& position_offset,
+       const glm::vec3& position_scale)
+  {
+    this->textures_ = std::move(textures);
+    AssignSamplerUnits();
+    bounding_box_ = bounding_box;
+    bounding_sphere_ = bounding_sphere;
+    VAO_ = vao;
+    allocation_ = allocation;
+    vertex_format_ = VertexFormat::kCompact;
+    position_offset_ = position_offset;
+    position_scale_ = position_scale;
+  }
+
+  //Sets the uniforms the vertex shaders dequantize the attributes with, before drawing the VAO with shader
+  void BindVertexFormat(const Shader& shader) const
+  {
+    const DrawUniforms& uniforms = shader.draw_uniforms();
+    shader.SetBool(uniforms.compact_vertices, vertex_format_ == VertexFormat::kCompact);
+    shader.SetVec3(uniforms.position_offset, position_offset_);
+    shader.SetVec3(uniforms.position_scale, position_scale_);
+  }
+  //Binds the textures to the units of their texture_diffuseN, texture_specularN... samplers, which every program got
+  //at link time: no uniform is set
+  void BindTextures() const
+  {
+    for(std::size_t i = 0; i < textures_.size(); i++)
     {
-      glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
-      // retrieve texture number (the N in diffuse_textureN)
-      std::string number;
-      std::string name = textures_[i].type;
-      if(name == "texture_diffuse")
-        number = std::to_string(diffuseNr++);
-      else if(name == "texture_specular")
-        number = std::to_string(specularNr++);
-
-      glUniform1i(glGetUniformLocation(shader, ("material." + name).append(number).c_str()), i);
+      if (sampler_units_[i] < 0)
+        continue;
+      glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(sampler_units_[i]));
       glBindTexture(GL_TEXTURE_2D, textures_[i].id);
     }
     glActiveTexture(GL_TEXTURE0);
-
-    // draw mesh
+  }
+  void Draw(const Shader& shader) const
+  {
+    BindTextures();
+    DrawGeometry(shader);
+  }
+  //Without touching the textures, e.g. for depth only passes
+  void DrawGeometry(const Shader& shader) const
+  {
+    BindVertexFormat(shader);
     glBindVertexArray(VAO_);
-    glDrawElements(GL_TRIANGLES, indices_.size(), GL_UNSIGNED_INT, 0);
+    glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(allocation_.index_count), allocation_.index_type,
+                             reinterpret_cast<const void*>(allocation_.first_index * allocation_.index_size()),
+                             static_cast<GLint>(allocation_.first_vertex));
     glBindVertexArray(0);
   }
 
@@ -69,21 +305,57 @@ class Mesh
 
  private:
   //Render data
-  unsigned int VAO_, VBO_, EBO_;
-  void SetupMesh()
+  //VBO_ and EBO_ stay 0 when the mesh lives in shared buffers
+  unsigned int VAO_ = 0, VBO_ = 0, EBO_ = 0;
+  GeometryAllocation allocation_;
+  VertexFormat vertex_format_ = VertexFormat::kFloat;
+  //Model space position = position_offset_ + attribute * position_scale_, identity for float vertices
+  glm::vec3 position_offset_ = glm::vec3(0.0f);
+  glm::vec3 position_scale_ = glm::vec3(1.0f);
+  BoundingBox bounding_box_;
+  Sphere bounding_sphere_;
+  //Texture unit of each texture, -1 when no sampler has its type and number
+  std::vector<int> sampler_units_;
+
+  //The Nth texture of a type goes to the unit of its texture_typeN sampler, N counting from 1 per type
+  void AssignSamplerUnits()
+  {
+    sampler_units_.clear();
+    for (auto texture = textures_.begin(); texture != textures_.end(); ++texture)
+    {
+      const auto number = std::count_if(textures_.begin(), texture + 1, [&texture](const Texture& other) {
+        return other.type == texture->type;
+      });
+      sampler_units_.push_back(MaterialSamplerUnit(texture->type, static_cast<int>(number)));
+    }
+  }
+  void SetupMesh(std::span<const Vertex> vertices, std::span<const unsigned int> indices, VertexFormat vertex_format)
   {
+    if (vertex_format == VertexFormat::kCompact)
+    {
+      CompactPositionRange(bounding_box_, position_offset_, position_scale_);
+      const std::vector<CompactVertex> compact_vertices = CompressVertices(vertices, position_offset_, position_scale_);
+      std::vector<std::uint16_t> short_indices;
+      if (vertices.size() <= kMaxShortIndexedVertices)
+        short_indices.assign(indices.begin(), indices.end());
+      SetupCompactMesh(compact_vertices, short_indices,
+                       short_indices.empty() ? indices : std::span<const unsigned int>());
+      return;
+    }
+
+    allocation_.vertex_count = vertices.size();
+    allocation_.index_count = indices.size();
+    vertex_format_ = VertexFormat::kFloat;
+
     glGenVertexArrays(1, &VAO_);
     glGenBuffers(1, &VBO_);
     glGenBuffers(1, &EBO_);
 
     glBindVertexArray(VAO_);
     glBindBuffer(GL_ARRAY_BUFFER, VBO_);
-
-    glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(Vertex), &vertices_[0], GL_STATIC_DRAW);
-
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(unsigned int),
-                 &indices_[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size_bytes(), vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), GL_STATIC_DRAW);
 
     // vertex positions
     glEnableVertexAttribArray(0);
@@ -95,6 +367,42 @@ class Mesh
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
 
+    glBindVertexArray(0);
+  }
+  //Uploaded as is: the 16 bit indices when there are some, the 32 bit ones otherwise
+  void SetupCompactMesh(std::span<const CompactVertex> vertices, std::span<const std::uint16_t> short_indices,
+                        std::span<const unsigned int> indices)
+  {
+    allocation_.vertex_count = vertices.size();
+    allocation_.index_count = short_indices.empty() ? indices.size() : short_indices.size();
+    allocation_.index_type = short_indices.empty() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    vertex_format_ = VertexFormat::kCompact;
+
+    glGenVertexArrays(1, &VAO_);
+    glGenBuffers(1, &VBO_);
+    glGenBuffers(1, &EBO_);
+
+    glBindVertexArray(VAO_);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size_bytes(), vertices.data(), GL_STATIC_DRAW);
+    if (short_indices.empty())
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), GL_STATIC_DRAW);
+    else
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size_bytes(), short_indices.data(), GL_STATIC_DRAW);
+
+    // vertex positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex),
+                          (void*)offsetof(CompactVertex, position));
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex),
+                          (void*)offsetof(CompactVertex, tex_coords));
+
     glBindVertexArray(0);
   }
 };
@@ -0,0 +1,111 @@
+#ifndef MESH_CACHE_H_
+#define MESH_CACHE_H_
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+
+namespace gpr5300
+{
+
+//Binary cache of the processed meshes of a model, written next to the source file.
+//The layout is native endian and meant to be mapped in place, so it is only valid on the machine that wrote it:
+//  header | records[mesh_count] | textures[texture_count] | strings | vertices/indices (16 byte aligned)
+//The meshes are stored in the layout they are uploaded in, vertex_size tells which VertexFormat it is and each record
+//its index size and the box its compact positions are quantized in.
+inline constexpr std::string_view kMeshCacheExtension = ".meshcache";
+//Bumped whenever the import pipeline changes what a source turns into
+inline constexpr std::uint32_t kMeshCacheVersion = 4;
+
+struct MeshCacheHeader
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t vertex_size;
+  std::uint64_t source_hash;
+  std::uint32_t import_flags;
+  std::uint32_t mesh_count;
+  std::uint32_t texture_count;
+  std::uint32_t strings_size;
+  std::uint64_t file_size;
+};
+
+struct MeshCacheRecord
+{
+  std::uint64_t vertex_offset;
+  std::uint64_t index_offset;
+  std::uint32_t vertex_count;
+  std::uint32_t index_count;
+  std::uint32_t first_texture;
+  std::uint32_t texture_count;
+  float aabb_min[3];
+  float aabb_max[3];
+  float sphere_center[3];
+  float sphere_radius;
+  std::uint32_t index_size;
+  float position_offset[3];
+  float position_scale[3];
+  std::uint32_t padding;
+};
+
+struct MeshCacheTexture
+{
+  std::uint32_t type_offset;
+  std::uint32_t type_length;
+  std::uint32_t path_offset;
+  std::uint32_t path_length;
+};
+
+struct CachedTexture
+{
+  std::string_view type;
+  std::string_view path;
+};
+
+class MeshCacheReader
+{
+ public:
+  //Maps the cache and checks it was written for this source content, import flags and vertex format
+  bool Open(std::string_view cache_path, std::uint64_t source_hash, std::uint32_t import_flags,
+            VertexFormat vertex_format);
+
+  [[nodiscard]] std::size_t mesh_count() const { return records_.size(); }
+  //Each mesh has either vertices or compact vertices, as the vertex format of the cache says
+  [[nodiscard]] std::span<const Vertex> vertices(std::size_t mesh) const;
+  [[nodiscard]] std::span<const CompactVertex> compact_vertices(std::size_t mesh) const;
+  //Either 32 or 16 bit indices, with the same rule as MeshData::Compact
+  [[nodiscard]] std::span<const unsigned int> indices(std::size_t mesh) const;
+  [[nodiscard]] std::span<const std::uint16_t> short_indices(std::size_t mesh) const;
+  [[nodiscard]] std::vector<CachedTexture> textures(std::size_t mesh) const;
+  [[nodiscard]] BoundingBox bounding_box(std::size_t mesh) const;
+  [[nodiscard]] Sphere bounding_sphere(std::size_t mesh) const;
+  [[nodiscard]] glm::vec3 position_offset(std::size_t mesh) const;
+  [[nodiscard]] glm::vec3 position_scale(std::size_t mesh) const;
+
+ private:
+  MappedFile file_;
+  VertexFormat vertex_format_ = VertexFormat::kFloat;
+  std::span<const MeshCacheRecord> records_;
+  std::span<const MeshCacheTexture> textures_;
+  std::string_view strings_;
+};
+
+//Every mesh must already be in vertex_format
+bool WriteMeshCache(std::string_view cache_path, std::uint64_t source_hash, std::uint32_t import_flags,
+                    VertexFormat vertex_format, std::span<const MeshData> meshes);
+
+//64 bit FNV-1a of the whole file content
+bool HashFile(std::string_view path, std::uint64_t& hash);
+//Same hash of the size and write time of the file only, a warm start can check a large source without reading it
+bool HashFileStamp(std::string_view path, std::uint64_t& hash);
+//HashFile of a model, plus the size and write time of the buffer files a .gltf keeps its geometry in
+bool HashModelSource(std::string_view path, std::uint64_t& hash);
+
+} // namespace gpr5300
+
+#endif //MESH_CACHE_H_
@@ -0,0 +1,50 @@
+#ifndef MESH_OPTIMIZER_H_
+#define MESH_OPTIMIZER_H_
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "mesh.h"
+
+namespace gpr5300
+{
+
+//Post-transform cache size the analysis and the overdraw clustering assume, a FIFO like most GPUs
+inline constexpr std::size_t kVertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+  //Vertex shader invocations per triangle: 0.5 is the best a regular grid gets, 3 is no reuse at all
+  float acmr = 0.0f;
+  //Vertex shader invocations per vertex: 1 is every vertex transformed once
+  float atvr = 0.0f;
+};
+
+struct MeshOptimizationReport
+{
+  std::size_t vertices_before = 0;
+  std::size_t vertices_after = 0;
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+VertexCacheStats AnalyzeVertexCache(std::span<const unsigned int> indices, std::size_t vertex_count);
+
+//Merges the bitwise identical vertices, returns the new vertex count
+std::size_t WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+//Triangle order for post-transform cache hits (Forsyth's linear-speed optimizer)
+void OptimizeVertexCache(std::vector<unsigned int>& indices, std::size_t vertex_count);
+//Splits the cache friendly order in clusters and sorts them outside in, so the triangles facing away from the
+//center of the mesh are drawn first and occlude the rest. A cluster only ends where the cache efficiency stays
+//within threshold of the whole run it belongs to.
+void OptimizeOverdraw(std::vector<unsigned int>& indices, std::span<const Vertex> vertices, float threshold = 1.05f);
+//Renumbers the vertices in the order the triangles first use them, unused vertices are dropped
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+//Every stage above in order, on a triangle list
+MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+} // namespace gpr5300
+
+#endif //MESH_OPTIMIZER_H_
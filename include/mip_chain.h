@@ -0,0 +1,39 @@
+#ifndef MIP_CHAIN_H_
+#define MIP_CHAIN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace gpr5300
+{
+
+struct MipLevel
+{
+  int width = 0;
+  int height = 0;
+  std::size_t offset = 0;
+};
+
+//Every level of an 8 bit image down to 1x1, level 0 first, rows tightly packed
+struct MipChain
+{
+  int channels = 0;
+  std::vector<MipLevel> levels;
+  std::vector<std::uint8_t> data;
+
+  [[nodiscard]] bool empty() const { return levels.empty(); }
+  [[nodiscard]] const std::uint8_t* level_data(std::size_t level) const { return data.data() + levels[level].offset; }
+};
+
+//2x2 box filter computed in float with SSE/AVX2, the last row or column of odd sizes is repeated. With srgb the
+//color channels of 3 and 4 channel images are averaged in linear light, alpha and 1 or 2 channel images never are.
+//The rows of every level are spread over pool when one is given, the caller must not be one of its workers.
+MipChain GenerateMipChain(const std::uint8_t* pixels, int width, int height, int channels, bool srgb,
+                          ThreadPool* pool = nullptr);
+
+} // namespace gpr5300
+
+#endif //MIP_CHAIN_H_
@@ -1,35 +1,120 @@
 ﻿#ifndef MODEL_H
 #define MODEL_H
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <future>
+#include <memory>
 #include <iostream>
 #include <GL/glew.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <glm/gtc/type_ptr.hpp>
 #include <span>
 
+#include "geometry_arena.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "shader.h"
 #include "stb_image.h"
 #include "texture_loader.h"
+#include "thread_pool.h"
 
-unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false);
+inline unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false,
+                                    gpr5300::TextureRole role = gpr5300::TextureRole::kAlbedo);
+
+//Everything an import produces. No GL involved, so it can be built on a loader thread
+struct ModelData
+{
+  std::string directory;
+  std::vector<MeshData> meshes;
+  //Union of the mesh bounds, model space
+  BoundingBox bounding_box;
+  Sphere bounding_sphere;
+  //Keeps alive the mapping the mapped_* spans of the meshes point into
+  gpr5300::MeshCacheReader cache;
+};
 
 class Model
 {
  public:
   Model() = default;
-  explicit Model(const char* path)
+  explicit Model(const char* path, VertexFormat vertex_format = VertexFormat::kCompact)
+      : vertex_format_(vertex_format)
   {
     LoadModel(path);
   }
 
-  void Draw(GLuint& shader)
+  void Draw(const Shader& shader)
   {
     for (auto& meshe : meshes_)
       meshe.Draw(shader);
   }
 
-  [[nodiscard]] std::vector<Mesh> meshes(){return meshes_;}
-  [[nodiscard]] std::vector<Texture> get_textures_loaded(){return textures_loaded;}
+  //Only draws the meshes accepted by is_visible(const Mesh&), e.g. the ones inside the view frustum
+  template<typename Predicate>
+    requires std::predicate<Predicate&, const Mesh&>
+  void Draw(const Shader& shader, Predicate&& is_visible)
+  {
+    for (auto& meshe : meshes_)
+    {
+      if (is_visible(static_cast<const Mesh&>(meshe)))
+        meshe.Draw(shader);
+    }
+  }
+
+  //Arena meshes take model from their draw data, the others from the "model" uniform of shader.
+  //The visible arena meshes sharing their textures are one multi-draw.
+  template<typename Predicate>
+  void Draw(const Shader& shader, const glm::mat4& model, Predicate&& is_visible)
+  {
+    DrawStandalone(shader, model, is_visible, true);
+    for (const MaterialBatch& batch : batches_)
+    {
+      bool visible = false;
+      for (const std::size_t index : batch.meshes)
+      {
+        if (!is_visible(static_cast<const Mesh&>(meshes_[index])))
+          continue;
+        arena_->AddDraw(meshes_[index], model);
+        visible = true;
+      }
+      if (!visible)
+        continue;
+      meshes_[batch.meshes.front()].BindTextures();
+      arena_->Submit(shader);
+    }
+  }
+  void Draw(const Shader& shader, const glm::mat4& model)
+  {
+    Draw(shader, model, [](const Mesh&) { return true; });
+  }
+
+  //Depth only passes: no texture is bound, so every visible arena mesh goes in the same multi-draw
+  template<typename Predicate>
+  void DrawDepth(const Shader& shader, const glm::mat4& model, Predicate&& is_visible)
+  {
+    DrawStandalone(shader, model, is_visible, false);
+    bool visible = false;
+    for (const MaterialBatch& batch : batches_)
+    {
+      for (const std::size_t index : batch.meshes)
+      {
+        if (!is_visible(static_cast<const Mesh&>(meshes_[index])))
+          continue;
+        arena_->AddDraw(meshes_[index], model);
+        visible = true;
+      }
+    }
+    if (visible)
+      arena_->Submit(shader);
+  }
+
+  //Views on the model's own storage, valid until the model loads more meshes
+  [[nodiscard]] std::span<const Mesh> meshes() const {return meshes_;}
+  [[nodiscard]] std::span<const Texture> get_textures_loaded() const {return textures_loaded;}
 
  private:
 
@@ -37,61 +122,275 @@ class Model
   std::vector<Texture> textures_loaded;	//Make sure textures are loaded once.
   std::vector<Mesh> meshes_;
   std::string directory_;
+  VertexFormat vertex_format_ = VertexFormat::kCompact;
+  GeometryArena* arena_ = nullptr;
+
+  //Arena meshes with the same textures, indices in meshes_
+  struct MaterialBatch
+  {
+    std::vector<std::size_t> meshes;
+  };
+  std::vector<MaterialBatch> batches_;
+  //Meshes with buffers of their own: float vertices, no arena, or the arena couldn't take them
+  std::vector<std::size_t> standalone_meshes_;
+
+  //Textures whose GL name is already handed to meshes while their blocks are still loading on the loader pool
+  struct PendingTexture
+  {
+    unsigned int id;
+    std::string path;
+    std::future<gpr5300::CompressedTexture> texture;
+  };
+  std::vector<PendingTexture> pending_textures_;
+
+  //Imported data waiting for UploadStep, released once every mesh is on the GPU. Models of the same import share it
+  std::shared_ptr<const ModelData> upload_data_;
+  std::size_t uploaded_meshes_ = 0;
+
+  //Known as soon as the upload begins, never recomputed
+  BoundingBox bounding_box_;
+  Sphere bounding_sphere_;
 
  public:
   void GetBoundingBox(glm::vec3& min, glm::vec3& max) const {
-    // Initialiser les coordonnées min et max à des valeurs opposées
-    min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX); // Valeurs maximales possibles
-    max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX); // Valeurs minimales possibles
-
-    // Parcours de tous les meshes du modèle
-    for (const Mesh& mesh : meshes_) {
-      for (const Vertex& vertex : mesh.vertices_) {
-        // Mettre à jour min et max pour chaque sommet
-        min = glm::min(min, vertex.Position);
-        max = glm::max(max, vertex.Position);
-      }
-    }
+    min = bounding_box_.min;
+    max = bounding_box_.max;
   }
+  [[nodiscard]] const BoundingBox& bounding_box() const {return bounding_box_;}
+  [[nodiscard]] const Sphere& bounding_sphere() const {return bounding_sphere_;}
 
 
+  static constexpr unsigned int kImportFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+
   void LoadModel(const std::string& path)
   {
+    const auto start = std::chrono::steady_clock::now();
+    auto data = std::make_unique<ModelData>();
+    if (!Import(path, *data, vertex_format_))
+      return;
+    BeginUpload(std::move(data));
+    //Only the uploads are left for the GL thread, decoding overlapped with the import
+    FinishUpload();
+
+    const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+    std::cout << "Loaded " << path << " in " << duration.count() << " ms\n";
+  }
+
+  //CPU only, no GL call: safe to run on a loader thread. The meshes come out in vertex_format, the layout they are
+  //uploaded in
+  static bool Import(const std::string& path, ModelData& data, VertexFormat vertex_format = VertexFormat::kCompact)
+  {
+    data.directory = path.substr(0, path.find_last_of('/'));
+
+    //Warm start: the processed meshes are mapped from the cache and uploaded as is, Assimp is skipped
+    const std::string cache_path = path + std::string(gpr5300::kMeshCacheExtension);
+    std::uint64_t source_hash = 0;
+    const bool hashed = gpr5300::HashModelSource(path, source_hash);
+    if (hashed && data.cache.Open(cache_path, source_hash, kImportFlags, vertex_format))
+    {
+      ReadCache(data, vertex_format);
+      ComputeModelBounds(data);
+      return true;
+    }
+
     //stbi_set_flip_vertically_on_load(true);//uncomment for .obj
     Assimp::Importer import;
 
-    const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    const aiScene* scene = import.ReadFile(path, kImportFlags);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
       std::cerr << "ERROR::ASSIMP::" << import.GetErrorString() << "\n";
+      return false;
+    }
+
+    ProcessNode(scene->mRootNode, scene, data.meshes);
+    ComputeModelBounds(data);
+    if (vertex_format == VertexFormat::kCompact)
+    {
+      for (MeshData& mesh : data.meshes)
+        mesh.Compact();
+    }
+
+    if (hashed && !gpr5300::WriteMeshCache(cache_path, source_hash, kImportFlags, vertex_format, data.meshes))
+    {
+      std::cerr << "Could not write mesh cache " << cache_path << "\n";
+    }
+    return true;
+  }
+
+  //GL thread: reserves the texture names and queues their decoding, the meshes are uploaded by UploadStep
+  void BeginUpload(std::shared_ptr<const ModelData> data)
+  {
+    directory_ = data->directory;
+    bounding_box_ = data->bounding_box;
+    bounding_sphere_ = data->bounding_sphere;
+    meshes_.reserve(meshes_.size() + data->meshes.size());
+    for (const MeshData& mesh : data->meshes)
+    {
+      for (const Texture& texture : mesh.textures)
+        LoadTexture(texture.path, texture.type);
+    }
+    upload_data_ = std::move(data);
+    uploaded_meshes_ = 0;
+  }
+
+  //GL thread: uploads one mesh, or one texture whose decoding is done. Returns false when there was nothing to do yet
+  bool UploadStep()
+  {
+    bool uploaded = false;
+    if (upload_data_ && uploaded_meshes_ < upload_data_->meshes.size())
+    {
+      const MeshData& mesh = upload_data_->meshes[uploaded_meshes_++];
+      std::vector<Texture> textures;
+      textures.reserve(mesh.textures.size());
+      for (const Texture& texture : mesh.textures)
+        textures.push_back(LoadTexture(texture.path, texture.type));
+      if (!arena_ || mesh.vertex_format != VertexFormat::kCompact || !UploadToArena(mesh, textures))
+      {
+        meshes_.emplace_back(mesh, std::move(textures));
+        standalone_meshes_.push_back(meshes_.size() - 1);
+      }
+      uploaded = true;
+    }
+    else
+    {
+      for (auto it = pending_textures_.begin(); it != pending_textures_.end(); ++it)
+      {
+        if (it->texture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+          continue;
+        FinishPendingTexture(*it);
+        pending_textures_.erase(it);
+        uploaded = true;
+        break;
+      }
+    }
+    //Every mesh has its GPU copy, the CPU side (and the cache mapping) can go
+    if (upload_data_ && uploaded_meshes_ == upload_data_->meshes.size())
+      upload_data_.reset();
+    return uploaded;
+  }
+
+  //Blocks until everything queued by BeginUpload is on the GPU
+  void FinishUpload()
+  {
+    while (upload_data_)
+      UploadStep();
+    for (PendingTexture& pending : pending_textures_)
+      FinishPendingTexture(pending);
+    pending_textures_.clear();
+  }
+
+  [[nodiscard]] bool resident() const { return !upload_data_ && pending_textures_.empty(); }
+
+  //Layout the meshes get at upload, set before BeginUpload
+  void set_vertex_format(VertexFormat vertex_format) { vertex_format_ = vertex_format; }
+  //Compact meshes are uploaded in arena when set before BeginUpload, it must outlive the model
+  void set_geometry_arena(GeometryArena* arena) { arena_ = arena; }
+
+ private:
+  template<typename Predicate>
+  void DrawStandalone(const Shader& shader, const glm::mat4& model, Predicate& is_visible, bool textured)
+  {
+    if (standalone_meshes_.empty())
       return;
+    shader.SetMat4(shader.draw_uniforms().model, model);
+    for (const std::size_t index : standalone_meshes_)
+    {
+      if (!is_visible(static_cast<const Mesh&>(meshes_[index])))
+        continue;
+      if (textured)
+        meshes_[index].BindTextures();
+      meshes_[index].DrawGeometry(shader);
+    }
+  }
+
+  //The mesh gets a range of the arena buffers and joins the batch of the meshes with the same textures.
+  //Its data is already compact, the buffers get it as is
+  bool UploadToArena(const MeshData& mesh, std::vector<Texture>& textures)
+  {
+    GeometryAllocation allocation;
+    const bool allocated = mesh.short_index_data().empty() ?
+        arena_->Allocate(mesh.compact_vertex_data(), mesh.index_data(), allocation) :
+        arena_->Allocate(mesh.compact_vertex_data(), mesh.short_index_data(), allocation);
+    if (!allocated)
+      return false;
+    meshes_.emplace_back(arena_->vao(), allocation, std::move(textures), mesh.bounding_box, mesh.bounding_sphere,
+                         mesh.position_offset, mesh.position_scale);
+
+    const std::size_t index = meshes_.size() - 1;
+    const std::vector<Texture>& mesh_textures = meshes_[index].textures_;
+    const auto same_textures = [this, &mesh_textures](const MaterialBatch& batch) {
+      const std::vector<Texture>& batch_textures = meshes_[batch.meshes.front()].textures_;
+      return std::equal(batch_textures.begin(), batch_textures.end(), mesh_textures.begin(), mesh_textures.end(),
+                        [](const Texture& a, const Texture& b) { return a.id == b.id && a.type == b.type; });
+    };
+    const auto batch = std::find_if(batches_.begin(), batches_.end(), same_textures);
+    if (batch != batches_.end())
+      batch->meshes.push_back(index);
+    else
+      batches_.push_back({{index}});
+    return true;
+  }
+
+  static void ReadCache(ModelData& data, VertexFormat vertex_format)
+  {
+    const gpr5300::MeshCacheReader& cache = data.cache;
+    data.meshes.reserve(cache.mesh_count());
+    for (std::size_t i = 0; i < cache.mesh_count(); i++)
+    {
+      MeshData mesh;
+      mesh.vertex_format = vertex_format;
+      mesh.mapped_vertices = cache.vertices(i);
+      mesh.mapped_compact_vertices = cache.compact_vertices(i);
+      mesh.mapped_indices = cache.indices(i);
+      mesh.mapped_short_indices = cache.short_indices(i);
+      mesh.position_offset = cache.position_offset(i);
+      mesh.position_scale = cache.position_scale(i);
+      for (const gpr5300::CachedTexture& cached : cache.textures(i))
+      {
+        mesh.textures.push_back({0, std::string(cached.type), std::string(cached.path)});
+      }
+      mesh.bounding_box = cache.bounding_box(i);
+      mesh.bounding_sphere = cache.bounding_sphere(i);
+      data.meshes.push_back(std::move(mesh));
     }
-    directory_ = path.substr(0, path.find_last_of('/'));
+  }
 
-    ProcessNode(scene->mRootNode, scene);
+  static void ComputeModelBounds(ModelData& data)
+  {
+    data.bounding_box = {};
+    for (const MeshData& mesh : data.meshes)
+      data.bounding_box.Extend(mesh.bounding_box);
+    //Sphere around the mesh spheres rather than the vertices, the model is never walked again
+    const glm::vec3 center = data.bounding_box.center();
+    float radius = 0.0f;
+    for (const MeshData& mesh : data.meshes)
+      radius = std::max(radius, glm::distance(center, mesh.bounding_sphere.center()) + mesh.bounding_sphere.radius());
+    data.bounding_sphere = Sphere(center, radius);
   }
 
-  void ProcessNode(aiNode* node, const aiScene* scene)
+  static void ProcessNode(aiNode* node, const aiScene* scene, std::vector<MeshData>& meshes)
   {
     // process all the node's meshes (if any)
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
       aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-      meshes_.push_back(ProcessMesh(mesh, scene));
+      meshes.push_back(ProcessMesh(mesh, scene));
     }
     // then do the same for each of its children
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-      ProcessNode(node->mChildren[i], scene);
+      ProcessNode(node->mChildren[i], scene, meshes);
     }
   }
 
-  Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene)
+  static MeshData ProcessMesh(aiMesh* mesh, const aiScene* scene)
   {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+    MeshData data;
+    std::vector<Vertex>& vertices = data.vertices;
+    std::vector<unsigned int>& indices = data.indices;
+    std::vector<Texture>& textures = data.textures;
 
     //Process vertex
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -103,6 +402,7 @@ class Model
       vector.y = mesh->mVertices[i].y;
       vector.z = mesh->mVertices[i].z;
       vertex.Position = vector;
+      data.bounding_box.Extend(vector);
       //Normals
       vector.x = mesh->mNormals[i].x;
       vector.y = mesh->mNormals[i].y;
@@ -123,6 +423,8 @@ class Model
       vertices.push_back(vertex);
     }
 
+    data.bounding_sphere = ComputeBoundingSphere(data.bounding_box, vertices);
+
     //Process indices
     for(unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
@@ -131,6 +433,15 @@ class Model
         indices.push_back(face.mIndices[j]);
     }
 
+    //Triangulate leaves points and lines alone, only pure triangle meshes are reordered
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+    {
+      const gpr5300::MeshOptimizationReport report = gpr5300::OptimizeMesh(vertices, indices);
+      std::cout << "Mesh " << mesh->mName.C_Str() << ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+                << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << ", "
+                << report.vertices_before << " -> " << report.vertices_after << " vertices\n";
+    }
+
     //Process material
     if(mesh->mMaterialIndex >= 0)
     {
@@ -143,44 +454,65 @@ class Model
       textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
     }
 
-    return {vertices, indices, textures};
+    return data;
   }
 
-  std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
+  static std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
   {
     std::vector<Texture> textures;
     for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
       aiString str;
       mat->GetTexture(type, i, &str);
-      bool skip = false;
-      for(unsigned int j = 0; j < textures_loaded.size(); j++)
-      {
-        if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-        {
-          textures.push_back(textures_loaded[j]);
-          skip = true;
-          break;
-        }
-      }
-      if(!skip)
-      {   // if texture hasn't been loaded already, load it
-        Texture texture;
-        texture.id = TextureFromFile(str.C_Str(), this->directory_);
-        texture.type = typeName;
-        texture.path = str.C_Str();
-        textures.push_back(texture);
-        textures_loaded.push_back(texture); // add to loaded textures
-      }
+      textures.push_back({0, typeName, str.C_Str()});
     }
     return textures;
   }
+
+  Texture LoadTexture(std::string_view path, const std::string& typeName)
+  {
+    for(const Texture& loaded : textures_loaded)
+    {
+      if(loaded.path == path)
+        return loaded;
+    }
+    // if texture hasn't been loaded already, queue its decoding and hand out the GL name right away
+    Texture texture;
+    texture.path = path;
+    glGenTextures(1, &texture.id);
+    texture.type = typeName;
+    textures_loaded.push_back(texture); // add to loaded textures
+
+    std::string filename = directory_ + '/' + texture.path;
+    const gpr5300::TextureRole role = typeName == "texture_diffuse" ? gpr5300::TextureRole::kAlbedo :
+                                      typeName == "texture_normal" ? gpr5300::TextureRole::kNormal :
+                                      gpr5300::TextureRole::kData;
+    //Already on a loader thread: a first load compresses on it alone instead of waiting on the pool it runs on
+    pending_textures_.push_back({texture.id, texture.path, gpr5300::LoaderPool().Submit([filename = std::move(filename), role] {
+      return LoadCompressedTexture(filename.c_str(), role);
+    })});
+    return texture;
+  }
+
+  static void FinishPendingTexture(PendingTexture& pending)
+  {
+    const gpr5300::CompressedTexture texture = pending.texture.get();
+    if (!texture.empty())
+    {
+      UploadCompressedTexture(pending.id, texture);
+    }
+    else
+    {
+      std::cout << "Texture failed to load at path: " << pending.path << std::endl;
+    }
+  }
 };
 
 
 
 
-unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma)
+inline unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma,
+                                    gpr5300::TextureRole role)
 {
   std::string filename = std::string(path);
   filename = directory + '/' + filename;
@@ -188,73 +520,43 @@ unsigned int TextureFromFile(const char *path, const std::string &directory, boo
   unsigned int textureID;
   glGenTextures(1, &textureID);
 
-  int width, height, nrComponents;
-  unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-  if (data)
+  //Called from the GL thread, a first load spreads the compression over the loader pool
+  const gpr5300::CompressedTexture texture = LoadCompressedTexture(filename.c_str(), role, gamma,
+                                                                   &gpr5300::LoaderPool());
+  if (!texture.empty())
   {
-    GLenum internal_format;
-    GLenum data_format;
-    if (nrComponents == 1)
-    {
-      internal_format = data_format = GL_RED;
-    }
-    else if (nrComponents == 3)
-    {
-      internal_format = gamma ? GL_SRGB : GL_RGB;
-      data_format = GL_RGB;
-    }
-    else if (nrComponents == 4)
-    {
-      internal_format = gamma ? GL_SRGB_ALPHA : GL_RGBA;
-      data_format = GL_RGBA;
-    }
-
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, data_format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, data_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, data_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
+    UploadCompressedTexture(textureID, texture);
   }
   else
   {
     std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
   }
 
   return textureID;
 }
-unsigned int GenerateCubemap(std::span<const std::string_view> faces_paths)
+inline unsigned int GenerateCubemap(std::span<const std::string_view> faces_paths)
 {
   unsigned int textureID;
   glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-  int width, height, nrChannels;
-  for (unsigned int i = 0; i < faces_paths.size(); i++)
+  //decode every face in parallel, upload in face order
+  std::vector<std::future<Image>> decoding;
+  for (std::string_view face_path : faces_paths)
   {
-    unsigned char *data = stbi_load(faces_paths[i].data(), &width, &height, &nrChannels, 0);
-    if (data)
-    {
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-      stbi_image_free(data);
-    }
-    else
-    {
+    decoding.push_back(gpr5300::LoaderPool().Submit([path = std::string(face_path)] {
+      return DecodeImage(path.c_str());
+    }));
+  }
+  std::vector<Image> faces;
+  for (unsigned int i = 0; i < decoding.size(); i++)
+  {
+    faces.push_back(decoding[i].get());
+    if (!faces.back().pixel)
       std::cout << "Cubemap texture failed to load at path: " << faces_paths[i] << std::endl;
-      stbi_image_free(data);
-    }
   }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  UploadCubemap(textureID, faces);
+  for (Image& face : faces)
+    FreeImage(face);
 
   return textureID;
 }
@@ -0,0 +1,81 @@
+#ifndef MODEL_LOADER_H_
+#define MODEL_LOADER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "model.h"
+
+using ModelHandle = std::uint32_t;
+using TextureHandle = std::uint32_t;
+
+//Streams models in without stalling the GL thread: Load returns a handle right away, the import and the texture
+//decoding run on the loader pool and Update uploads the results a few pieces per frame.
+class ModelLoader
+{
+ public:
+  //Compact meshes go in arena when there is one, it must outlive the loader. A path already loaded in the same vertex
+  //format shares its import, only the upload is done again.
+  ModelHandle Load(const std::string& path, VertexFormat vertex_format = VertexFormat::kCompact,
+                   GeometryArena* arena = nullptr);
+  //Textures of no model, streamed the same way: block compressed like the model textures
+  TextureHandle LoadTexture(const std::string& path, gpr5300::TextureRole role = gpr5300::TextureRole::kAlbedo);
+  //Faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+  TextureHandle LoadCubemap(std::span<const std::string_view> face_paths);
+
+  //GL thread, once per frame: uploads meshes and decoded textures until the time budget is spent
+  void Update(float budget_ms);
+
+  //nullptr until every mesh and texture of the model is on the GPU
+  [[nodiscard]] Model* Get(ModelHandle handle) const;
+  //false until the import is done, lets the caller draw a placeholder in the meantime
+  bool GetBoundingBox(ModelHandle handle, glm::vec3& min, glm::vec3& max) const;
+  //0 until the texture is on the GPU, draws needing it are skipped until then
+  [[nodiscard]] unsigned int GetTexture(TextureHandle handle) const;
+  //true once every model and texture loaded so far is either resident or failed
+  [[nodiscard]] bool idle() const;
+
+ private:
+  enum class State
+  {
+    kImporting,
+    kUploading,
+    kResident,
+    kFailed
+  };
+
+  struct Entry
+  {
+    std::string path;
+    VertexFormat vertex_format = VertexFormat::kCompact;
+    State state = State::kImporting;
+    std::shared_future<std::shared_ptr<const ModelData>> import;
+    Model model;
+    BoundingBox bounding_box;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  //A 2D texture has its compressed chain, a cubemap its decoded faces
+  struct TextureEntry
+  {
+    std::string path;
+    State state = State::kImporting;
+    unsigned int id = 0;
+    std::future<gpr5300::CompressedTexture> texture;
+    std::vector<std::future<Image>> faces;
+  };
+
+  void FinishTexture(TextureEntry& entry);
+
+  //Entries never move so the Model pointers handed out stay valid
+  std::vector<std::unique_ptr<Entry>> entries_;
+  std::vector<TextureEntry> textures_;
+};
+
+#endif //MODEL_LOADER_H_
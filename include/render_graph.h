@@ -0,0 +1,84 @@
+#ifndef RENDER_GRAPH_H_
+#define RENDER_GRAPH_H_
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <GL/glew.h>
+
+#include "gpu_profiler.h"
+#include "render_target_pool.h"
+
+using RenderResource = std::uint32_t;
+inline constexpr RenderResource kNoRenderResource = std::numeric_limits<RenderResource>::max();
+
+struct RenderPassDesc
+{
+  std::vector<RenderResource> reads{};
+  //Written on top of their content, a pass that replaces it clears them
+  std::vector<RenderResource> colors{};
+  RenderResource depth = kNoRenderResource;
+  //Written through framebuffers the pass binds itself, like the layers of an array texture
+  std::vector<RenderResource> writes{};
+  //Writes outside the graph, the screen: kept whatever reads it
+  bool output = false;
+};
+
+//Frame graph of the screen passes. Every frame the passes are declared with the transient targets they read and
+//write, then Execute culls the passes nothing visible depends on, gives every target a texture from the pool just
+//before its first pass and hands it back after its last one. Two targets whose lifetimes don't overlap share the
+//same texture when they have the same size and format. The passes run in declaration order, a pass only reads what
+//the passes declared before it wrote.
+class RenderGraph
+{
+ public:
+  RenderResource Create(const char* name, const RenderTargetDesc& desc);
+  //Texture owned outside the graph, kept from one frame to the next: no pool memory, it may be read unwritten
+  RenderResource Import(const char* name, GLuint texture);
+  //Name must outlive the frame (literal), it is also the GPU profiler zone of the pass. The graph binds the
+  //framebuffer of the colors and depth, with the viewport of their size, before calling execute.
+  void AddPass(const char* name, RenderPassDesc desc, std::function<void()> execute);
+
+  //Texture of the resource, only valid while a pass using it executes
+  [[nodiscard]] GLuint texture(RenderResource resource) const;
+
+  //Runs the live passes and forgets the frame, the next one is declared from scratch
+  void Execute(RenderTargetPool& pool, GpuProfiler* profiler = nullptr);
+
+  void DrawImGui() const;
+
+ private:
+  struct Resource
+  {
+    const char* name = nullptr;
+    RenderTargetDesc desc{};
+    GLuint texture = 0;
+    bool imported = false;
+    std::size_t first_pass = 0;
+    std::size_t last_pass = 0;
+  };
+  struct Pass
+  {
+    const char* name = nullptr;
+    RenderPassDesc desc{};
+    std::function<void()> execute{};
+    std::vector<std::size_t> dependencies{};
+    bool live = false;
+  };
+  struct PassStats
+  {
+    const char* name = nullptr;
+    bool live = false;
+  };
+
+  void Compile();
+
+  std::vector<Resource> resources_;
+  std::vector<Pass> passes_;
+  std::vector<PassStats> last_passes_;
+  std::size_t last_resource_count_ = 0;
+  std::size_t last_texture_count_ = 0;
+};
+
+#endif //RENDER_GRAPH_H_
@@ -0,0 +1,66 @@
+#ifndef RENDER_TARGET_POOL_H_
+#define RENDER_TARGET_POOL_H_
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <vector>
+#include <GL/glew.h>
+
+struct RenderTargetDesc
+{
+  int width = 0;
+  int height = 0;
+  GLenum internal_format = GL_RGBA8;
+  GLenum filter = GL_NEAREST;
+
+  bool operator==(const RenderTargetDesc& other) const = default;
+};
+
+//Transient render targets shared by the passes: a pass acquires the textures it renders to and releases them once
+//the last pass reading them is recorded, the next acquire of the same size and format gets them back. Targets not
+//acquired for a few frames, like the ones of the previous window size, are deleted.
+class RenderTargetPool
+{
+ public:
+  static constexpr std::uint64_t kMaxUnusedFrames = 3;
+  static constexpr std::size_t kMaxColorAttachments = 4;
+
+  GLuint Acquire(const RenderTargetDesc& desc);
+  void Release(GLuint texture);
+
+  //Framebuffer rendering to these pool textures, depth may be 0. Built on the first request then cached until one of
+  //its textures is deleted.
+  GLuint Framebuffer(std::initializer_list<GLuint> colors, GLuint depth = 0);
+  GLuint Framebuffer(std::span<const GLuint> colors, GLuint depth = 0);
+
+  //Deletes the targets left unused for kMaxUnusedFrames, every target should be released by then
+  void EndFrame();
+  void Clear();
+
+  void DrawImGui() const;
+
+ private:
+  struct Target
+  {
+    GLuint texture = 0;
+    RenderTargetDesc desc;
+    bool in_use = false;
+    std::uint64_t last_used_frame = 0;
+  };
+  struct CachedFramebuffer
+  {
+    std::array<GLuint, kMaxColorAttachments> colors{};
+    GLuint depth = 0;
+    GLuint framebuffer = 0;
+  };
+
+  [[nodiscard]] const Target* Find(GLuint texture) const;
+
+  std::vector<Target> targets_;
+  std::vector<CachedFramebuffer> framebuffers_;
+  std::uint64_t frame_ = 0;
+};
+
+#endif //RENDER_TARGET_POOL_H_
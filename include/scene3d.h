@@ -1,6 +1,8 @@
 #pragma once
 
 #include <SDL.h>
+#include <GL/glew.h>
+#include <glm/vec3.hpp>
 
 namespace gpr5300
 {
@@ -15,7 +17,21 @@ namespace gpr5300
         virtual void DrawImGui() {}
         virtual void OnEvent(const SDL_Event& event) {}
         virtual void UpdateCamera(const float dt) {}
+        //Size of the framebuffer the scene renders to, in pixels. Called after Begin and on every window resize
+        virtual void OnResize(int width, int height) {}
+        //Dynamic resolution: the last GPU frame time read back (0 while unknown), and the fraction of the output
+        //size to render the next frames at before the final upscale
+        virtual float GpuFrameTimeMs() const { return 0.0f; }
+        virtual void SetRenderScale(float scale) {}
+        //Used by the headless benchmark: wait for the content and drive the camera along a script
+        virtual bool IsLoading() const { return false; }
+        virtual void SetCameraPose(const glm::vec3& position, const glm::vec3& target) {}
 
+        //Framebuffer the final image goes to, 0 is the window
+        void SetOutputFramebuffer(GLuint framebuffer) { output_framebuffer_ = framebuffer; }
+
+    protected:
+        GLuint output_framebuffer_ = 0;
     };
 
 } // namespace gpr5300
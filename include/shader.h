@@ -1,12 +1,66 @@
 ﻿#ifndef SHADER_H_
 #define SHADER_H_
 
+#include <algorithm>
+#include <charconv>
+#include <functional>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <GL/glew.h>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 
 #include "file_utility.h"
+#include "uniform_buffer.h"
+
+//Location of a uniform resolved once, lets hot loops skip the name lookup entirely
+struct UniformHandle
+{
+  GLint location = -1;
+  GLint size = 0; //element count for arrays, 1 otherwise
+};
+
+//Uniforms the meshes and models set on every draw, resolved once after linking
+struct DrawUniforms
+{
+  UniformHandle model;
+  //Dequantization of the compact vertices, see Mesh::BindVertexFormat
+  UniformHandle compact_vertices;
+  UniformHandle position_offset;
+  UniformHandle position_scale;
+  //Arena draws, see GeometryArena::Submit
+  UniformHandle indirect;
+  UniformHandle draw_offset;
+};
+
+//Texture units of the material samplers texture_diffuseN, texture_specularN, texture_normalN and texture_heightN, N
+//counting from 1 per type, with or without a "material." prefix. The programs get them when they are linked, so the
+//meshes only bind their textures. Units from 6 on are left to the passes (shadow map, G-buffer...).
+struct MaterialSamplerUnits
+{
+  std::string_view type;
+  int first_unit;
+  int count;
+};
+inline constexpr MaterialSamplerUnits kMaterialSamplerUnits[] = {
+    {"texture_diffuse", 0, 2},
+    {"texture_specular", 2, 2},
+    {"texture_normal", 4, 1},
+    {"texture_height", 5, 1},
+};
+
+//-1 when no unit is given to that type or number
+inline int MaterialSamplerUnit(std::string_view type, int number)
+{
+  for (const MaterialSamplerUnits& units : kMaterialSamplerUnits)
+  {
+    if (units.type == type)
+      return number >= 1 && number <= units.count ? units.first_unit + number - 1 : -1;
+  }
+  return -1;
+}
 
 class Shader
 {
@@ -19,7 +73,7 @@ class Shader
     GLint success;
     //Load shaders
     const auto vertex_content = gpr5300::LoadFile(vertex_path);
-    const auto* v_shader_code = vertex_content.data();
+    const char* v_shader_code = SkipByteOrderMark(vertex_content);
     const unsigned int vertex_shader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex_shader, 1, &v_shader_code, nullptr);
     glCompileShader(vertex_shader);
@@ -30,7 +84,7 @@ class Shader
     }
 
     const auto fragment_content = gpr5300::LoadFile(fragment_path);
-    const auto* f_shader_code = fragment_content.data();
+    const char* f_shader_code = SkipByteOrderMark(fragment_content);
     const unsigned int fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment_shader, 1, &f_shader_code, nullptr);
     glCompileShader(fragment_shader);
@@ -54,6 +108,15 @@ class Shader
 
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
+
+    ReflectUniforms();
+    BindUniformBlock(kFrameDataBlock, kFrameDataBinding);
+  }
+
+  //Some shaders are saved with a UTF-8 BOM, the GLSL compilers of Mesa reject it
+  static const char* SkipByteOrderMark(const std::string& source)
+  {
+    return source.starts_with("\xEF\xBB\xBF") ? source.c_str() + 3 : source.c_str();
   }
 
   void Use() const
@@ -66,62 +129,195 @@ class Shader
     glDeleteProgram(id_);
   }
 
+  //Attaches a uniform block to a binding point, programs without that block are left alone
+  void BindUniformBlock(std::string_view name, const GLuint binding) const
+  {
+    const GLuint index = glGetUniformBlockIndex(id_, std::string(name).c_str());
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(id_, index, binding);
+  }
+
+  //-1 location when the uniform doesn't exist or was optimized out, setting it is then a no-op like with GL
+  [[nodiscard]] UniformHandle Uniform(std::string_view name) const
+  {
+    const auto it = uniforms_.find(name);
+    return it != uniforms_.end() ? it->second : UniformHandle{};
+  }
+  [[nodiscard]] const DrawUniforms& draw_uniforms() const { return draw_uniforms_; }
+
   //Uniform functions
-  void SetBool(const std::string &name, const bool value) const
+  void SetBool(std::string_view name, const bool value) const
+  {
+    SetBool(Uniform(name), value);
+  }
+  void SetInt(std::string_view name, const int value) const
+  {
+    SetInt(Uniform(name), value);
+  }
+  void SetFloat(std::string_view name, const float value) const
+  {
+    SetFloat(Uniform(name), value);
+  }
+  void SetVec2(std::string_view name, const glm::vec2 &value) const
+  {
+    SetVec2(Uniform(name), value);
+  }
+  void SetVec2(std::string_view name, const float x, const float y) const
+  {
+    SetVec2(Uniform(name), glm::vec2(x, y));
+  }
+  void SetVec3(std::string_view name, const glm::vec3 &value) const
+  {
+    SetVec3(Uniform(name), value);
+  }
+  void SetVec3(std::string_view name, const float x, const float y, const float z) const
   {
-    glUniform1i(glGetUniformLocation(id_, name.c_str()), static_cast<int>(value));
+    SetVec3(Uniform(name), glm::vec3(x, y, z));
   }
-  void SetInt(const std::string &name, const int value) const
+  void SetVec4(std::string_view name, const glm::vec4 &value) const
   {
-    glUniform1i(glGetUniformLocation(id_, name.c_str()), value);
+    SetVec4(Uniform(name), value);
   }
-  void SetFloat(const std::string &name, const float value) const
+  void SetVec4(std::string_view name, const float x, const float y, const float z, const float w) const
   {
-    glUniform1f(glGetUniformLocation(id_, name.c_str()), value);
+    SetVec4(Uniform(name), glm::vec4(x, y, z, w));
   }
-  void SetVec2(const std::string &name, const glm::vec2 &value) const
+  void SetMat2(std::string_view name, const glm::mat2 &value) const
   {
-    glUniform2fv(glGetUniformLocation(id_, name.c_str()), 1, &value[0]);
+    SetMat2(Uniform(name), value);
   }
-  void SetVec2(const std::string &name, const float x, const float y) const
+  void SetMat3(std::string_view name, const glm::mat3 &value) const
   {
-    glUniform2f(glGetUniformLocation(id_, name.c_str()), x, y);
+    SetMat3(Uniform(name), value);
   }
-  void SetVec3(const std::string &name, const glm::vec3 &value) const
+  void SetMat4(std::string_view name, const glm::mat4 &value) const
   {
-    glUniform3fv(glGetUniformLocation(id_, name.c_str()), 1, &value[0]);
+    SetMat4(Uniform(name), value);
   }
-  void SetVec3(const std::string &name, const float x, const float y, const float z) const
+  void SetVec3Array(std::string_view name, const std::vector<glm::vec3>& values, size_t count) const
   {
-    glUniform3f(glGetUniformLocation(id_, name.c_str()), x, y, z);
+    SetVec3Array(Uniform(name), values, count);
   }
-  void SetVec4(const std::string &name, const glm::vec4 &value) const
+
+  //Same with a handle from Uniform(), nothing is looked up
+  void SetBool(UniformHandle uniform, const bool value) const
   {
-    glUniform4fv(glGetUniformLocation(id_, name.c_str()), 1, &value[0]);
+    glUniform1i(uniform.location, static_cast<int>(value));
   }
-  void SetVec4(const std::string &name, const float x, const float y, const float z, const float w) const
+  void SetInt(UniformHandle uniform, const int value) const
   {
-    glUniform4f(glGetUniformLocation(id_, name.c_str()), x, y, z, w);
+    glUniform1i(uniform.location, value);
   }
-  void SetMat2(const std::string &name, const glm::mat2 &value) const
+  void SetFloat(UniformHandle uniform, const float value) const
   {
-    glUniformMatrix2fv(glGetUniformLocation(id_, name.c_str()), 1,GL_FALSE, value_ptr(value));
+    glUniform1f(uniform.location, value);
   }
-  void SetMat3(const std::string &name, const glm::mat3 &value) const
+  void SetVec2(UniformHandle uniform, const glm::vec2 &value) const
   {
-    glUniformMatrix3fv(glGetUniformLocation(id_, name.c_str()), 1, GL_FALSE, value_ptr(value));
+    glUniform2fv(uniform.location, 1, &value[0]);
   }
-  void SetMat4(const std::string &name, const glm::mat4 &value) const
+  void SetVec3(UniformHandle uniform, const glm::vec3 &value) const
   {
-    glUniformMatrix4fv(glGetUniformLocation(id_, name.c_str()), 1, GL_FALSE, value_ptr(value));
+    glUniform3fv(uniform.location, 1, &value[0]);
   }
-  void SetVec3Array(const std::string& name, const std::vector<glm::vec3>& values, size_t count) {
-    for (size_t i = 0; i < count; ++i) {
-      std::string indexedName = name + "[" + std::to_string(i) + "]";
-      glUniform3fv(glGetUniformLocation(id_, indexedName.c_str()), 1, glm::value_ptr(values[i]));
+  void SetVec4(UniformHandle uniform, const glm::vec4 &value) const
+  {
+    glUniform4fv(uniform.location, 1, &value[0]);
+  }
+  void SetMat2(UniformHandle uniform, const glm::mat2 &value) const
+  {
+    glUniformMatrix2fv(uniform.location, 1, GL_FALSE, value_ptr(value));
+  }
+  void SetMat3(UniformHandle uniform, const glm::mat3 &value) const
+  {
+    glUniformMatrix3fv(uniform.location, 1, GL_FALSE, value_ptr(value));
+  }
+  void SetMat4(UniformHandle uniform, const glm::mat4 &value) const
+  {
+    glUniformMatrix4fv(uniform.location, 1, GL_FALSE, value_ptr(value));
+  }
+  //Whole array in one call, array elements have consecutive locations
+  void SetVec3Array(UniformHandle uniform, const std::vector<glm::vec3>& values, size_t count) const
+  {
+    count = std::min({count, values.size(), static_cast<size_t>(uniform.size)});
+    if (count == 0)
+      return;
+    glUniform3fv(uniform.location, static_cast<GLsizei>(count), glm::value_ptr(values[0]));
+  }
+
+ private:
+  struct UniformNameHash
+  {
+    using is_transparent = void;
+    size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+  };
+  std::unordered_map<std::string, UniformHandle, UniformNameHash, std::equal_to<>> uniforms_;
+  DrawUniforms draw_uniforms_;
+
+  //material.texture_diffuse1 -> MaterialSamplerUnit("texture_diffuse", 1)
+  static int MaterialSamplerUnitOf(std::string_view name)
+  {
+    if (name.starts_with("material."))
+      name.remove_prefix(std::string_view("material.").size());
+    for (const MaterialSamplerUnits& units : kMaterialSamplerUnits)
+    {
+      if (!name.starts_with(units.type))
+        continue;
+      const std::string_view digits = name.substr(units.type.size());
+      int number = 0;
+      const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), number);
+      if (error == std::errc() && end == digits.data() + digits.size())
+        return MaterialSamplerUnit(units.type, number);
     }
+    return -1;
   }
 
+  //Active uniforms are listed once after linking, the setters then never ask the driver
+  void ReflectUniforms()
+  {
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::string name(static_cast<size_t>(max_length), '\0');
+    for (GLint i = 0; i < count; i++)
+    {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(id_, static_cast<GLuint>(i), max_length, &length, &size, &type, name.data());
+      std::string uniform_name = name.substr(0, static_cast<size_t>(length));
+      const GLint location = glGetUniformLocation(id_, uniform_name.c_str());
+      //members of uniform blocks have no location
+      if (location < 0)
+        continue;
+
+      //Arrays are reported as "name[0]", both "name" and every "name[i]" are accepted like glGetUniformLocation does
+      if (uniform_name.ends_with("[0]"))
+      {
+        uniform_name.resize(uniform_name.size() - 3);
+        for (GLint element = 1; element < size; element++)
+        {
+          const std::string element_name = uniform_name + "[" + std::to_string(element) + "]";
+          uniforms_[element_name] = {glGetUniformLocation(id_, element_name.c_str()), size - element};
+        }
+        uniforms_[uniform_name + "[0]"] = {location, size};
+      }
+      uniforms_[uniform_name] = {location, size};
+
+      if (type == GL_SAMPLER_2D)
+      {
+        const int unit = MaterialSamplerUnitOf(uniform_name);
+        if (unit >= 0)
+          glProgramUniform1i(id_, location, unit);
+      }
+    }
+    draw_uniforms_.model = Uniform("model");
+    draw_uniforms_.compact_vertices = Uniform("compactVertices");
+    draw_uniforms_.position_offset = Uniform("positionOffset");
+    draw_uniforms_.position_scale = Uniform("positionScale");
+    draw_uniforms_.indirect = Uniform("indirect");
+    draw_uniforms_.draw_offset = Uniform("drawOffset");
+  }
 };
 
 #endif //SHADER_H_
@@ -0,0 +1,52 @@
+#ifndef SSAO_PASS_H_
+#define SSAO_PASS_H_
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "render_target_pool.h"
+#include "shader.h"
+
+//Screen space ambient occlusion computed at a fraction of the screen resolution. The depth buffer is linearized once
+//at that resolution and the view position is rebuilt from it. The result is brought back to full resolution with a
+//depth aware bilateral filter so the occlusion stays sharp on the edges of the objects.
+//The intermediate targets come from the pool.
+class SsaoPass
+{
+ public:
+  static constexpr int kMaxKernelSize = 64; //must match ssao.frag
+  static constexpr int kNoiseSize = 4;
+
+  void Create();
+  void Delete();
+
+  //depth_buffer: hardware depth, normals: octahedral encoded view space, output: R8 occlusion, all width x height.
+  //The intermediate targets come from the pool. The viewport is restored.
+  void Render(RenderTargetPool& pool, GLuint depth_buffer, GLuint normals, GLuint output, int width, int height,
+              const glm::mat4& projection);
+
+  void DrawImGui();
+
+ private:
+  void GenerateKernel();
+
+  //1 full, 2 half, 4 quarter resolution
+  int scale_ = 2;
+  int kernel_size_ = 16;
+  float radius_ = 0.5f;
+  float bias_ = 0.025f;
+  bool kernel_dirty_ = true;
+
+  std::vector<glm::vec3> kernel_;
+  GLuint noise_texture_ = 0;
+  GLuint vao_ = 0;
+
+  Shader depth_downsample_;
+  Shader ssao_;
+  Shader blur_;
+  Shader upsample_;
+};
+
+#endif //SSAO_PASS_H_
@@ -0,0 +1,29 @@
+#ifndef TEXTURE_CACHE_H_
+#define TEXTURE_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "texture_compression.h"
+
+namespace gpr5300
+{
+
+//Compressed mip chains are cached as KTX2 files next to the source image, one per block format:
+//  brick.jpg -> brick.jpg.bc7.ktx2
+//The file is a plain KTX2 container (basic data format descriptor, no supercompression) that other tools can open.
+//The HashFileStamp and channel count of the source and the cache version are kept in a "GPRsource" key/value entry.
+inline constexpr std::string_view kTextureCacheExtension = ".ktx2";
+//Bumped whenever the encoders or the mip filter change what a source turns into
+inline constexpr std::uint32_t kTextureCacheVersion = 3;
+
+std::string TextureCachePath(std::string_view source_path, BlockFormat format);
+
+//Reads the cache if it was written from a source with this hash and the requested color space
+bool ReadTextureCache(std::string_view cache_path, std::uint64_t source_hash, bool srgb, CompressedTexture& texture);
+bool WriteTextureCache(std::string_view cache_path, std::uint64_t source_hash, const CompressedTexture& texture);
+
+} // namespace gpr5300
+
+#endif //TEXTURE_CACHE_H_
@@ -0,0 +1,74 @@
+#ifndef TEXTURE_COMPRESSION_H_
+#define TEXTURE_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace gpr5300
+{
+
+//What the texture holds, decides its block format
+enum class TextureRole : std::uint8_t
+{
+  kAlbedo,
+  kNormal,
+  kData
+};
+
+//4x4 texel blocks
+enum class BlockFormat : std::uint8_t
+{
+  kBc1, //RGB, 8 bytes
+  kBc3, //RGBA: BC1 color and BC4 alpha, 16 bytes
+  kBc4, //R, 8 bytes
+  kBc5, //RG: two BC4, 16 bytes
+  kBc7  //RGBA, 16 bytes
+};
+
+struct CompressedLevel
+{
+  int width = 0;
+  int height = 0;
+  std::size_t offset = 0;
+  std::size_t size = 0;
+};
+
+//Full mip chain of a block compressed texture, level 0 first
+struct CompressedTexture
+{
+  BlockFormat format = BlockFormat::kBc7;
+  bool srgb = false;
+  //Of the source image, 2 and 4 have an alpha channel
+  int channels = 0;
+  std::vector<CompressedLevel> levels;
+  std::vector<std::uint8_t> data;
+
+  [[nodiscard]] bool empty() const { return levels.empty(); }
+};
+
+//Albedo gets BC7, normals BC5 (x and y each get their own endpoints, z is rebuilt in the shader), data textures
+//the cheapest format keeping their channels
+BlockFormat ChooseBlockFormat(TextureRole role, int channels);
+std::size_t BlockBytes(BlockFormat format);
+
+//Encodes the mip chain of an 8 bit image of 1 to 4 channels, the mips come from GenerateMipChain. srgb only picks
+//the sRGB block formats, linear_mips averages the color channels in linear light, sRGB encoded color wants it
+//whether or not the GPU decodes it. The mip rows and block rows are spread over pool when one is given, the caller
+//must not be one of its workers.
+CompressedTexture CompressImage(const std::uint8_t* pixels, int width, int height, int channels, BlockFormat format,
+                                bool srgb, bool linear_mips, ThreadPool* pool = nullptr);
+
+//One block: texels are the 16 RGBA texels of the block in row order
+void EncodeBc1Block(const std::uint8_t* texels, std::uint8_t* block);
+void EncodeBc3Block(const std::uint8_t* texels, std::uint8_t* block);
+void EncodeBc4Block(const std::uint8_t* texels, int channel, std::uint8_t* block);
+void EncodeBc5Block(const std::uint8_t* texels, std::uint8_t* block);
+//Mode 6 only: one subset, RGBA endpoints and 4 bit indices, the best single mode for smooth content
+void EncodeBc7Block(const std::uint8_t* texels, std::uint8_t* block);
+
+} // namespace gpr5300
+
+#endif //TEXTURE_COMPRESSION_H_
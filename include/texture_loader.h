@@ -1,8 +1,13 @@
 #ifndef SAMPLES_OPENGL_TEXTURE_LOADER_H
 #define SAMPLES_OPENGL_TEXTURE_LOADER_H
 
+#include <span>
 #include <string_view>
 
+#include "mip_chain.h"
+#include "texture_compression.h"
+#include "thread_pool.h"
+
 struct Image
 {
   void* pixel = nullptr;
@@ -12,6 +17,23 @@ struct Image
 };
 
 
+//Decoding only touches the CPU so it can run on a loader thread, the result is released with FreeImage
+Image DecodeImage(const char* path);
+void FreeImage(Image& image);
+//GL thread side: fills the texture object with levels filtered beforehand by GenerateMipChain, gamma picks the sRGB
+//internal formats
+void UploadTexture(unsigned int texture, const gpr5300::MipChain& mips, bool gamma = false);
+
+//Block compressed mip chain of the image. Read from its KTX2 cache when the cache matches the file, else decoded,
+//compressed (on pool when given) and cached for the next run. CPU only, empty when the image can't be read.
+gpr5300::CompressedTexture LoadCompressedTexture(const char* path, gpr5300::TextureRole role, bool gamma = false,
+                                                 gpr5300::ThreadPool* pool = nullptr);
+//GL thread side: uploads every level of the chain as is
+void UploadCompressedTexture(unsigned int texture, const gpr5300::CompressedTexture& compressed);
+//GL thread side: one RGB face per image, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order. Faces that failed to decode are left
+//empty, returns false if there was one
+bool UploadCubemap(unsigned int texture, std::span<const Image> faces);
+
 class TextureManager
 {
   int texture_index_ = 0;
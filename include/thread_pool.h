@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace gpr5300
+{
+
+//Fixed set of worker threads consuming a FIFO job queue. Jobs must not touch GL.
+class ThreadPool
+{
+ public:
+  explicit ThreadPool(std::size_t thread_count);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template<typename Function>
+  auto Submit(Function&& function) -> std::future<std::invoke_result_t<std::decay_t<Function>>>
+  {
+    using Result = std::invoke_result_t<std::decay_t<Function>>;
+    //std::function needs a copyable target, the task is shared instead of moved in
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+    std::future<Result> result = task->get_future();
+    {
+      std::scoped_lock lock(mutex_);
+      jobs_.emplace_back([task] { (*task)(); });
+    }
+    condition_.notify_one();
+    return result;
+  }
+
+  [[nodiscard]] std::size_t thread_count() const { return workers_.size(); }
+
+ private:
+  void WorkerLoop();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> jobs_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stopping_ = false;
+};
+
+//Pool shared by asset loading (image decoding, imports...), one thread is left to the GL thread
+ThreadPool& LoaderPool();
+
+} // namespace gpr5300
+
+#endif //THREAD_POOL_H_
@@ -0,0 +1,67 @@
+#ifndef UNIFORM_BUFFER_H_
+#define UNIFORM_BUFFER_H_
+
+#include <string_view>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+static constexpr int kMaxLights = 4;
+static constexpr int kShadowCascades = 4;
+
+//Uniform block names and the binding points they are attached to in every program
+static constexpr std::string_view kFrameDataBlock = "FrameData";
+static constexpr GLuint kFrameDataBinding = 0;
+
+//CPU mirror of the std140 FrameData block declared in the shaders, vec3 are padded to vec4 like std140 does
+struct FrameData
+{
+  glm::mat4 projection;
+  glm::mat4 view;
+  glm::vec4 view_pos;
+  glm::vec4 light_positions[kMaxLights];
+  glm::vec4 light_colors[kMaxLights];
+  //Directional light, w is 1 when it casts shadows
+  glm::vec4 sun_direction;
+  glm::vec4 sun_color;
+  //View depth where each cascade ends, and the world size of one of its texels
+  glm::vec4 cascade_splits;
+  glm::vec4 cascade_texel_sizes;
+  glm::mat4 light_space_matrices[kShadowCascades];
+};
+static_assert(sizeof(FrameData) == (2 + kShadowCascades) * sizeof(glm::mat4) + (5 + 2 * kMaxLights) * sizeof(glm::vec4),
+              "FrameData must match the std140 layout");
+static_assert(kShadowCascades == 4, "the cascade splits are packed in a vec4");
+
+//Buffer backing a uniform block, attached once to its binding point and refilled with one upload per frame
+template<typename T>
+class UniformBuffer
+{
+ public:
+  void Create(GLuint binding)
+  {
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  void Update(const T& data) const
+  {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  void Delete()
+  {
+    glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+  }
+
+ private:
+  GLuint buffer_ = 0;
+};
+
+#endif //UNIFORM_BUFFER_H_
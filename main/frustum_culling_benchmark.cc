@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "frustum_culling.h"
+
+//Time of the batch culling kernels against their scalar reference, best of several runs over the same objects
+
+namespace
+{
+constexpr std::size_t kObjectCount = 100000;
+constexpr int kRepetitions = 200;
+
+//Box around the origin seen from the inside, so that about a third of the objects are kept
+gpr5300::FrustumPlanes BenchmarkFrustum()
+{
+  return {glm::vec4(1.0f, 0.0f, 0.0f, 60.0f), glm::vec4(-1.0f, 0.0f, 0.0f, 60.0f),
+          glm::vec4(0.0f, 1.0f, 0.0f, 60.0f), glm::vec4(0.0f, -1.0f, 0.0f, 60.0f),
+          glm::vec4(0.0f, 0.0f, 1.0f, 60.0f), glm::vec4(0.0f, 0.0f, -1.0f, 60.0f)};
+}
+
+template<typename Function>
+double BestNanosecondsPerObject(Function&& function, std::size_t& kept)
+{
+  double best = 0.0;
+  for (int i = 0; i < kRepetitions; i++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    kept = function();
+    const std::chrono::duration<double, std::nano> duration = std::chrono::steady_clock::now() - start;
+    const double per_object = duration.count() / static_cast<double>(kObjectCount);
+    if (i == 0 || per_object < best)
+      best = per_object;
+  }
+  return best;
+}
+
+void Report(const char* name, double simd, double scalar, std::size_t kept)
+{
+  std::cout << name << ": SIMD " << simd << " ns, scalar " << scalar << " ns per object, x" << scalar / simd
+            << " (" << kept << " of " << kObjectCount << " kept)\n";
+}
+}
+
+int main()
+{
+  std::mt19937 random(5300);
+  std::uniform_real_distribution<float> position(-90.0f, 90.0f);
+  std::uniform_real_distribution<float> size(0.1f, 2.0f);
+  gpr5300::AabbArray boxes;
+  gpr5300::SphereArray spheres;
+  for (std::size_t i = 0; i < kObjectCount; i++)
+  {
+    const glm::vec3 center(position(random), position(random), position(random));
+    const glm::vec3 half(size(random));
+    boxes.Add({center - half, center + half});
+    spheres.Add({center, size(random)});
+  }
+  const gpr5300::FrustumPlanes planes = BenchmarkFrustum();
+  std::vector<std::uint32_t> visible(kObjectCount);
+
+  std::size_t simd_kept = 0;
+  std::size_t scalar_kept = 0;
+  const double simd_boxes =
+      BestNanosecondsPerObject([&] { return gpr5300::CullAabbs(planes, boxes, visible); }, simd_kept);
+  const double scalar_boxes =
+      BestNanosecondsPerObject([&] { return gpr5300::CullAabbsScalar(planes, boxes, visible); }, scalar_kept);
+  Report("Boxes", simd_boxes, scalar_boxes, simd_kept);
+  bool ok = simd_kept == scalar_kept;
+
+  const double simd_spheres =
+      BestNanosecondsPerObject([&] { return gpr5300::CullSpheres(planes, spheres, visible); }, simd_kept);
+  const double scalar_spheres =
+      BestNanosecondsPerObject([&] { return gpr5300::CullSpheresScalar(planes, spheres, visible); }, scalar_kept);
+  Report("Spheres", simd_spheres, scalar_spheres, simd_kept);
+  ok &= simd_kept == scalar_kept;
+
+  if (!ok)
+    std::cerr << "SIMD and scalar culling kept a different number of objects\n";
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
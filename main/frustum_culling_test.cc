@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum_culling.h"
+
+//Compares the SIMD culling kernels with their scalar reference on random frusta, including objects that exactly
+//touch a plane. Returns a failure as soon as one index list differs.
+
+namespace
+{
+//Same extraction as Frustum::Update, normalized like the planes plane_equations() returns
+gpr5300::FrustumPlanes PlanesFromMatrix(const glm::mat4& proj_view)
+{
+  const auto row = [&proj_view](int i) {
+    return glm::vec4(proj_view[0][i], proj_view[1][i], proj_view[2][i], proj_view[3][i]);
+  };
+  const glm::vec4 w_row = row(3);
+  gpr5300::FrustumPlanes planes = {w_row + row(0), w_row - row(0), w_row + row(1),
+                                   w_row - row(1), w_row + row(2), w_row - row(2)};
+  for (glm::vec4& plane : planes)
+    plane /= glm::length(glm::vec3(plane));
+  return planes;
+}
+
+gpr5300::FrustumPlanes RandomFrustum(std::mt19937& random)
+{
+  std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+  std::uniform_real_distribution<float> fov(20.0f, 100.0f);
+  const glm::vec3 eye(position(random), position(random), position(random));
+  glm::vec3 target(position(random), position(random), position(random));
+  if (glm::length(target - eye) < 1.0f)
+    target = eye + glm::vec3(0.0f, 0.0f, 1.0f);
+  const glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+  const glm::mat4 projection = glm::perspective(glm::radians(fov(random)), 16.0f / 9.0f, 0.1f, 100.0f);
+  return PlanesFromMatrix(projection * view);
+}
+
+//-8 <= x <= 8, -4 <= y <= 4, 0.5 <= z <= 64: exactly representable so that objects can sit exactly on a plane
+gpr5300::FrustumPlanes AxisAlignedFrustum()
+{
+  return {glm::vec4(1.0f, 0.0f, 0.0f, 8.0f), glm::vec4(-1.0f, 0.0f, 0.0f, 8.0f),
+          glm::vec4(0.0f, 1.0f, 0.0f, 4.0f), glm::vec4(0.0f, -1.0f, 0.0f, 4.0f),
+          glm::vec4(0.0f, 0.0f, 1.0f, -0.5f), glm::vec4(0.0f, 0.0f, -1.0f, 64.0f)};
+}
+
+void AddRandomObjects(std::mt19937& random, std::size_t count, gpr5300::AabbArray& boxes,
+                      gpr5300::SphereArray& spheres)
+{
+  std::uniform_real_distribution<float> position(-120.0f, 120.0f);
+  std::uniform_real_distribution<float> size(0.0f, 10.0f);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    const glm::vec3 center(position(random), position(random), position(random));
+    const glm::vec3 half(size(random), size(random), size(random));
+    boxes.Add({center - half, center + half});
+    spheres.Add({center, size(random)});
+  }
+}
+
+//Objects whose positive vertex (box) or nearest point (sphere) lies on one of the planes. On oblique planes the
+//point is only on it up to rounding, which is where a fused multiply-add in one path flips the result.
+void AddTouchingObjects(std::mt19937& random, const gpr5300::FrustumPlanes& planes, std::size_t count,
+                        gpr5300::AabbArray& boxes, gpr5300::SphereArray& spheres)
+{
+  std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+  std::uniform_real_distribution<float> size(0.0f, 4.0f);
+  std::uniform_int_distribution<std::size_t> plane_index(0, planes.size() - 1);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    const glm::vec4& plane = planes[plane_index(random)];
+    const glm::vec3 normal(plane);
+    //solve the plane equation for the axis the normal is the most aligned with
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+      if (std::abs(normal[a]) > std::abs(normal[axis]))
+        axis = a;
+    }
+    glm::vec3 point(position(random), position(random), position(random));
+    point[axis] = 0.0f;
+    point[axis] = -(plane.w + glm::dot(normal, point)) / normal[axis];
+
+    const glm::vec3 half(size(random), size(random), size(random));
+    glm::vec3 positive_offset;
+    for (int a = 0; a < 3; a++)
+      positive_offset[a] = normal[a] >= 0.0f ? half[a] : -half[a];
+    const glm::vec3 center = point - positive_offset;
+    boxes.Add({center - half, center + half});
+
+    const float radius = size(random);
+    spheres.Add({point - normal * radius, radius});
+  }
+}
+
+bool Compare(const char* name, std::span<const std::uint32_t> simd, std::span<const std::uint32_t> scalar)
+{
+  if (simd.size() == scalar.size() && std::equal(simd.begin(), simd.end(), scalar.begin()))
+    return true;
+  std::cerr << name << ": SIMD kept " << simd.size() << " objects, scalar " << scalar.size() << '\n';
+  for (std::size_t i = 0; i < std::min(simd.size(), scalar.size()); i++)
+  {
+    if (simd[i] != scalar[i])
+    {
+      std::cerr << "  first difference at " << i << ": " << simd[i] << " != " << scalar[i] << '\n';
+      break;
+    }
+  }
+  return false;
+}
+
+bool Check(const char* name, const gpr5300::FrustumPlanes& planes, const gpr5300::AabbArray& boxes,
+           const gpr5300::SphereArray& spheres)
+{
+  std::vector<std::uint32_t> simd(boxes.size());
+  std::vector<std::uint32_t> scalar(boxes.size());
+  const std::span<const std::uint32_t> simd_boxes(simd.data(), gpr5300::CullAabbs(planes, boxes, simd));
+  const std::span<const std::uint32_t> scalar_boxes(scalar.data(), gpr5300::CullAabbsScalar(planes, boxes, scalar));
+  bool ok = Compare(name, simd_boxes, scalar_boxes);
+
+  std::vector<std::uint32_t> simd_spheres(spheres.size());
+  std::vector<std::uint32_t> scalar_spheres(spheres.size());
+  ok &= Compare(name,
+                std::span<const std::uint32_t>(simd_spheres.data(),
+                                               gpr5300::CullSpheres(planes, spheres, simd_spheres)),
+                std::span<const std::uint32_t>(scalar_spheres.data(),
+                                               gpr5300::CullSpheresScalar(planes, spheres, scalar_spheres)));
+  return ok;
+}
+}
+
+int main()
+{
+  std::mt19937 random(5300);
+  bool ok = true;
+
+  //Exact contact: every touching object must be kept by both paths
+  {
+    const gpr5300::FrustumPlanes planes = AxisAlignedFrustum();
+    gpr5300::AabbArray boxes;
+    gpr5300::SphereArray spheres;
+    boxes.Add({glm::vec3(-10.0f, -1.0f, 1.0f), glm::vec3(-8.0f, 1.0f, 2.0f)});  //max.x on x = -8
+    boxes.Add({glm::vec3(8.0f, -1.0f, 1.0f), glm::vec3(9.0f, 1.0f, 2.0f)});     //min.x on x = 8
+    boxes.Add({glm::vec3(-1.0f, 4.0f, 1.0f), glm::vec3(1.0f, 5.0f, 2.0f)});     //min.y on y = 4
+    boxes.Add({glm::vec3(-1.0f, -1.0f, 64.0f), glm::vec3(1.0f, 1.0f, 70.0f)});  //min.z on z = 64
+    boxes.Add({glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.5f)});    //max.z on z = 0.5
+    boxes.Add({glm::vec3(-9.0f, -5.0f, 0.0f), glm::vec3(-8.0f, -4.0f, 0.5f)});  //corner on three planes
+    boxes.Add({glm::vec3(8.0f, 4.0f, 64.0f), glm::vec3(8.0f, 4.0f, 64.0f)});    //single point corner
+    spheres.Add({glm::vec3(-9.0f, 0.0f, 2.0f), 1.0f});
+    spheres.Add({glm::vec3(10.0f, 0.0f, 2.0f), 2.0f});
+    spheres.Add({glm::vec3(0.0f, 4.5f, 2.0f), 0.5f});
+    spheres.Add({glm::vec3(0.0f, 0.0f, 68.0f), 4.0f});
+    spheres.Add({glm::vec3(0.0f, 0.0f, 0.0f), 0.5f});
+    spheres.Add({glm::vec3(-8.0f, 6.0f, 2.0f), 2.0f});
+    spheres.Add({glm::vec3(0.0f, 0.0f, 2.0f), 0.0f});
+    //plus a second batch so the touching objects also go through full SIMD lanes
+    for (std::size_t i = 0; i < 7; i++)
+    {
+      boxes.Add({glm::vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]),
+                 glm::vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i])});
+      spheres.Add({glm::vec3(spheres.center_x[i], spheres.center_y[i], spheres.center_z[i]), spheres.radius[i]});
+    }
+
+    std::vector<std::uint32_t> visible(boxes.size());
+    if (gpr5300::CullAabbs(planes, boxes, visible) != boxes.size())
+    {
+      std::cerr << "Boxes touching a plane were culled\n";
+      ok = false;
+    }
+    if (gpr5300::CullSpheres(planes, spheres, visible) != spheres.size())
+    {
+      std::cerr << "Spheres touching a plane were culled\n";
+      ok = false;
+    }
+    ok &= Check("touching axis aligned planes", planes, boxes, spheres);
+  }
+
+  //Random frusta, counts that are not a multiple of the lane width so the remainder loop runs too
+  for (int frustum = 0; frustum < 200 && ok; frustum++)
+  {
+    const gpr5300::FrustumPlanes planes = RandomFrustum(random);
+    gpr5300::AabbArray boxes;
+    gpr5300::SphereArray spheres;
+    AddRandomObjects(random, 1000 + frustum % 8, boxes, spheres);
+    AddTouchingObjects(random, planes, 1000, boxes, spheres);
+    ok &= Check("random frustum", planes, boxes, spheres);
+  }
+
+  std::cout << (ok ? "Frustum culling: SIMD and scalar agree\n" : "Frustum culling: mismatch\n");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,224 @@
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "geometry_arena.h"
+#include "headless_context.h"
+#include "mesh.h"
+#include "shader.h"
+#include "uniform_buffer.h"
+
+//Draws arena meshes through the three programs that read the DrawData block, with the multi-draw and with the one
+//command per call fallback, and reads the depth back to check every mesh landed where its draw data puts it.
+//Several frames are drawn so the draw offsets of every ring region are used.
+
+namespace
+{
+constexpr int kTargetSize = 64;
+constexpr int kFrameCount = 6;
+constexpr float kQuadHalfSize = 0.3f;
+
+struct ArenaProgram
+{
+  const char* name;
+  const char* vertex_path;
+  const char* fragment_path;
+};
+
+constexpr ArenaProgram kPrograms[] = {
+    {"model", "data/shaders/scene3d/model.vert", "data/shaders/scene3d/model.frag"},
+    {"shadow depth", "data/shaders/shadow_map/shadow_depth.vert", "data/shaders/shadow_map/shadow_depth.frag"},
+    {"geometry pass", "data/shaders/saso/geometry_pass.vert", "data/shaders/saso/geometry_pass.frag"},
+};
+
+//Quad around the origin facing +z, extra_vertices copies of its first vertex push it past 16 bit indices
+Mesh UploadQuad(GeometryArena& arena, std::size_t extra_vertices)
+{
+  std::vector<Vertex> vertices = {
+      {glm::vec3(-kQuadHalfSize, -kQuadHalfSize, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, 0.0f)},
+      {glm::vec3(kQuadHalfSize, -kQuadHalfSize, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 0.0f)},
+      {glm::vec3(kQuadHalfSize, kQuadHalfSize, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 1.0f)},
+      {glm::vec3(-kQuadHalfSize, kQuadHalfSize, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, 1.0f)},
+  };
+  vertices.resize(vertices.size() + extra_vertices, vertices.front());
+  const std::vector<unsigned int> indices = {0, 1, 2, 0, 2, 3};
+
+  BoundingBox box;
+  for (const Vertex& vertex : vertices)
+    box.Extend(vertex.Position);
+  glm::vec3 position_offset, position_scale;
+  CompactPositionRange(box, position_offset, position_scale);
+  const std::vector<CompactVertex> compact = CompressVertices(vertices, position_offset, position_scale);
+
+  GeometryAllocation allocation;
+  if (!arena.Allocate(compact, indices, allocation))
+    std::cerr << "Could not allocate a quad in the arena\n";
+  return Mesh(arena.vao(), allocation, {}, box, ComputeBoundingSphere(box, vertices), position_offset, position_scale);
+}
+
+//One quad per quarter of the target, the depth changes every frame so stale draw data is caught
+glm::vec3 QuadPosition(std::size_t quad, int frame)
+{
+  const float x = quad % 2 == 0 ? -0.5f : 0.5f;
+  const float y = quad / 2 == 0 ? -0.5f : 0.5f;
+  const float z = -0.6f + 0.3f * static_cast<float>(quad) - 0.05f * static_cast<float>(frame);
+  return glm::vec3(x, y, z);
+}
+
+bool DrawFrames(GeometryArena& arena, const Shader& shader, std::span<const Mesh> quads, const char* name)
+{
+  bool ok = true;
+  for (int frame = 0; frame < kFrameCount; frame++)
+  {
+    glClear(GL_DEPTH_BUFFER_BIT);
+    arena.BeginFrame();
+    shader.Use();
+    for (std::size_t i = 0; i < quads.size(); i++)
+      arena.AddDraw(quads[i], glm::translate(glm::mat4(1.0f), QuadPosition(i, frame)));
+    arena.Submit(shader);
+    arena.EndFrame();
+
+    std::array<float, kTargetSize * kTargetSize> depth{};
+    glReadPixels(0, 0, kTargetSize, kTargetSize, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
+    const auto depth_at = [&depth](float x, float y) {
+      const int px = static_cast<int>((x * 0.5f + 0.5f) * kTargetSize);
+      const int py = static_cast<int>((y * 0.5f + 0.5f) * kTargetSize);
+      return depth[static_cast<std::size_t>(py * kTargetSize + px)];
+    };
+    for (std::size_t i = 0; i < quads.size(); i++)
+    {
+      const glm::vec3 position = QuadPosition(i, frame);
+      const float expected = position.z * 0.5f + 0.5f;
+      const float actual = depth_at(position.x, position.y);
+      if (std::abs(actual - expected) > 1.0e-3f)
+      {
+        std::cerr << name << ", frame " << frame << ": quad " << i << " depth " << actual << ", expected "
+                  << expected << '\n';
+        ok = false;
+      }
+    }
+    //between the quads nothing is drawn
+    if (depth_at(0.0f, 0.0f) != 1.0f)
+    {
+      std::cerr << name << ", frame " << frame << ": the center was drawn over\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
+}
+
+int main()
+{
+#ifndef GPR5300_HEADLESS
+  std::cout << "Skipped: this build has no headless EGL context\n";
+  return EXIT_SUCCESS;
+#else
+  gpr5300::HeadlessContext context;
+  if (!context.Create())
+    return EXIT_FAILURE;
+  const GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  const bool glew_ok = glew_status == GLEW_OK || glew_status == GLEW_ERROR_NO_GLX_DISPLAY;
+#else
+  const bool glew_ok = glew_status == GLEW_OK;
+#endif
+  if (!glew_ok)
+  {
+    std::cerr << "Failed to initialize GLEW on the headless context\n";
+    context.Destroy();
+    return EXIT_FAILURE;
+  }
+
+  bool ok = true;
+  {
+    //Depth only target, clip space is world space: identity camera and light
+    GLuint framebuffer = 0, depth = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, kTargetSize, kTargetSize);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glViewport(0, 0, kTargetSize, kTargetSize);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    UniformBuffer<FrameData> frame_data;
+    frame_data.Create(kFrameDataBinding);
+    FrameData data{};
+    data.projection = glm::mat4(1.0f);
+    data.view = glm::mat4(1.0f);
+    frame_data.Update(data);
+
+    GeometryArena arena;
+    arena.Create();
+    //Three meshes with 16 bit indices and one with 32 bit ones: one multi-draw per index type
+    std::vector<Mesh> quads;
+    quads.push_back(UploadQuad(arena, 0));
+    quads.push_back(UploadQuad(arena, 0));
+    quads.push_back(UploadQuad(arena, 65536));
+    quads.push_back(UploadQuad(arena, 0));
+    if (quads[2].index_type() != GL_UNSIGNED_INT || quads[0].index_type() != GL_UNSIGNED_SHORT)
+    {
+      std::cerr << "Unexpected index types in the arena\n";
+      ok = false;
+    }
+
+    const bool multi_draw = arena.draw_parameters();
+    std::cout << "Renderer: " << glGetString(GL_RENDERER)
+              << (multi_draw ? "" : ", no GL_ARB_shader_draw_parameters: only the fallback is tested") << '\n';
+    for (const ArenaProgram& program : kPrograms)
+    {
+      const Shader shader(program.vertex_path, program.fragment_path);
+      GLint linked = GL_FALSE;
+      glGetProgramiv(shader.id_, GL_LINK_STATUS, &linked);
+      if (!linked)
+      {
+        std::cerr << program.name << ": the program did not link\n";
+        ok = false;
+        shader.Delete();
+        continue;
+      }
+      shader.Use();
+      shader.SetMat4("lightSpaceMatrix", glm::mat4(1.0f));
+      shader.SetBool("instanced", false);
+      //nothing is bound, but samplers of different types still can't share a unit
+      shader.SetInt("shadowMap", 1);
+
+      for (const bool draw_parameters : {true, false})
+      {
+        if (draw_parameters && !multi_draw)
+          continue;
+        arena.set_draw_parameters(draw_parameters);
+        const bool drawn = DrawFrames(arena, shader, quads, program.name);
+        const std::size_t expected_calls = draw_parameters ? 2 : quads.size();
+        std::cout << program.name << (draw_parameters ? ", multi-draw: " : ", one command per call: ")
+                  << arena.draws() << " draws in " << arena.draw_calls() << " calls, "
+                  << (drawn ? "rendered" : "FAILED") << '\n';
+        ok &= drawn && arena.draws() == quads.size() && arena.draw_calls() == expected_calls;
+      }
+      shader.Delete();
+    }
+
+    arena.Delete();
+    frame_data.Delete();
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteFramebuffers(1, &framebuffer);
+    if (glGetError() != GL_NO_ERROR)
+    {
+      std::cerr << "GL error\n";
+      ok = false;
+    }
+  }
+  context.Destroy();
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+}
@@ -0,0 +1,186 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "free_camera.h"
+#include "frustum_culling.h"
+#include "headless_context.h"
+#include "mapped_ring_buffer.h"
+#include "model.h"
+#include "uniform_buffer.h"
+
+//Runs the CPU side of Scene3D's per-frame instancing path on the tree model (culling of the forest per view,
+//compaction of the visible matrices into the mapped ring, walk of the meshes and textures) and fails if it makes a
+//single heap allocation. Needs the headless EGL context to load the model.
+
+namespace
+{
+std::atomic<std::size_t> allocation_count = 0;
+
+void* CountedAllocation(std::size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* pointer = std::malloc(size == 0 ? 1 : size))
+    return pointer;
+  throw std::bad_alloc();
+}
+
+void* CountedAlignedAllocation(std::size_t size, std::align_val_t alignment)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  const auto align = static_cast<std::size_t>(alignment);
+#if defined(_MSC_VER)
+  void* pointer = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+  void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+  if (pointer == nullptr)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+void AlignedFree(void* pointer)
+{
+#if defined(_MSC_VER)
+  _aligned_free(pointer);
+#else
+  std::free(pointer);
+#endif
+}
+
+constexpr unsigned kInstanceCount = 3000;
+constexpr int kInstanceSlots = 1 + kShadowCascades;
+constexpr int kFrameCount = 1000;
+}
+
+void* operator new(std::size_t size) { return CountedAllocation(size); }
+void* operator new[](std::size_t size) { return CountedAllocation(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return CountedAlignedAllocation(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+  return CountedAlignedAllocation(size, alignment);
+}
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { AlignedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { AlignedFree(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { AlignedFree(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { AlignedFree(pointer); }
+
+int main()
+{
+#ifndef GPR5300_HEADLESS
+  std::cout << "Skipped: this build has no headless EGL context to load the model with\n";
+  return EXIT_SUCCESS;
+#else
+  gpr5300::HeadlessContext context;
+  if (!context.Create())
+    return EXIT_FAILURE;
+  const GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  const bool glew_ok = glew_status == GLEW_OK || glew_status == GLEW_ERROR_NO_GLX_DISPLAY;
+#else
+  const bool glew_ok = glew_status == GLEW_OK;
+#endif
+  if (!glew_ok)
+  {
+    std::cerr << "Failed to initialize GLEW on the headless context\n";
+    context.Destroy();
+    return EXIT_FAILURE;
+  }
+
+  bool ok = true;
+  {
+    const Model tree("data/tree/scene.gltf");
+    if (tree.meshes().empty())
+    {
+      std::cerr << "Could not load data/tree/scene.gltf, run from the directory holding data/\n";
+      ok = false;
+    }
+
+    //Same ring of trees as Scene3D::Begin
+    std::vector<glm::mat4> model_matrices(kInstanceCount);
+    gpr5300::SphereArray spheres;
+    for (unsigned i = 0; i < kInstanceCount; i++)
+    {
+      const float angle = glm::radians(static_cast<float>(i) / kInstanceCount * 360.0f);
+      const glm::vec3 position(std::sin(angle) * 50.0f, 0.0f, std::cos(angle) * 50.0f);
+      model_matrices[i] = glm::translate(glm::mat4(1.0f), position) *
+          glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f)) *
+          glm::scale(glm::mat4(1.0f), glm::vec3(0.01f));
+      spheres.Add(tree.bounding_sphere().Transformed(model_matrices[i]));
+    }
+    std::vector<std::uint32_t> visible_instances(kInstanceCount);
+    MappedRingBuffer ring;
+    ring.Create(GL_ARRAY_BUFFER, kInstanceSlots * kInstanceCount * sizeof(glm::mat4));
+
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    std::array<Frustum, kInstanceSlots> frusta;
+    std::size_t drawn_instances = 0;
+    std::size_t index_count = 0;
+    std::size_t texture_count = 0;
+    const auto frame = [&](int frame_index) {
+      //the camera turns around the forest, the other slots stand in for the shadow cascades
+      for (int slot = 0; slot < kInstanceSlots; slot++)
+      {
+        const float angle = glm::radians(static_cast<float>(frame_index + slot * 90));
+        const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 5.0f, 0.0f),
+                                           glm::vec3(std::sin(angle), 5.0f, std::cos(angle)),
+                                           glm::vec3(0.0f, 1.0f, 0.0f));
+        frusta[slot].Update(projection * view);
+      }
+      auto* instances = static_cast<glm::mat4*>(ring.BeginRegion());
+      if (instances == nullptr)
+      {
+        ok = false;
+        return;
+      }
+      for (int slot = 0; slot < kInstanceSlots; slot++)
+      {
+        const std::size_t count = gpr5300::CullSpheres(frusta[slot].plane_equations(), spheres, visible_instances);
+        glm::mat4* slot_instances = instances + slot * kInstanceCount;
+        for (std::size_t i = 0; i < count; i++)
+          slot_instances[i] = model_matrices[visible_instances[i]];
+        drawn_instances += count;
+        for (const Mesh& mesh : tree.meshes())
+          index_count += mesh.index_count();
+      }
+      texture_count += tree.get_textures_loaded().size();
+      ring.EndRegion();
+    };
+
+    //first frame outside of the count, static locals and lazily created driver state are set up there
+    frame(0);
+    allocation_count = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 1; i <= kFrameCount; i++)
+      frame(i);
+    const std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+    const std::size_t allocations = allocation_count;
+
+    std::cout << "Instancing path: " << duration.count() / kFrameCount << " us per frame, " << allocations
+              << " heap allocations in " << kFrameCount << " frames (" << drawn_instances / kFrameCount
+              << " instances, " << index_count / kFrameCount << " indices, " << texture_count / kFrameCount
+              << " textures per frame)\n";
+    if (allocations != 0)
+    {
+      std::cerr << "The per-frame instancing path allocated on the heap\n";
+      ok = false;
+    }
+    ring.Delete();
+  }
+  context.Destroy();
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+}
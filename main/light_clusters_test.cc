@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "light_clusters.h"
+
+//Checks the CPU light binning without a GL context. For random cameras and lights, every cluster's light list is
+//compared with a brute-force test of the light's sphere against that cluster alone, and points sampled inside every
+//sphere are looked up with the shaders' ClusterIndex, the list they land in must hold the light.
+//PointLightRadius is checked against the shaders' attenuation.
+
+namespace
+{
+constexpr int kScenarioCount = 200;
+//Few enough that every light can cover the whole grid without reaching kMaxLightIndices
+constexpr int kLightsPerScenario = 16;
+constexpr int kSamplesPerLight = 256;
+constexpr float kNear = 0.1f;
+constexpr float kFar = 100.0f;
+constexpr float kAspect = 16.0f / 9.0f;
+//Same constants as the shaders' attenuation
+constexpr float kLightLinear = 0.09f;
+constexpr float kLightQuadratic = 0.032f;
+constexpr float kLightCutoff = 0.05f;
+
+constexpr int ClusterIndex(int x, int y, int z)
+{
+  return x + LightClusters::kClusterX * (y + LightClusters::kClusterY * z);
+}
+
+//Same extraction as Frustum::Update, normalized like the planes plane_equations() returns
+gpr5300::FrustumPlanes PlanesFromMatrix(const glm::mat4& proj_view)
+{
+  const auto row = [&proj_view](int i) {
+    return glm::vec4(proj_view[0][i], proj_view[1][i], proj_view[2][i], proj_view[3][i]);
+  };
+  const glm::vec4 w_row = row(3);
+  gpr5300::FrustumPlanes planes = {w_row + row(0), w_row - row(0), w_row + row(1),
+                                   w_row - row(1), w_row + row(2), w_row - row(2)};
+  for (glm::vec4& plane : planes)
+    plane /= glm::length(glm::vec3(plane));
+  return planes;
+}
+
+//Depth where slice z starts, the first slice reaches the eye and the last one goes past the far plane
+float SliceStart(int z)
+{
+  if (z <= 0)
+    return -std::numeric_limits<float>::infinity();
+  if (z >= LightClusters::kClusterZ)
+    return std::numeric_limits<float>::infinity();
+  return kNear * std::pow(kFar / kNear, static_cast<float>(z) / LightClusters::kClusterZ);
+}
+
+//Signed distance of the point (lateral, depth) past the tile boundary at ndc, through the eye
+float BoundaryDistance(float focal, float ndc, float lateral, float depth)
+{
+  return (focal * lateral - ndc * depth) / std::sqrt(focal * focal + ndc * ndc);
+}
+
+//Whether the sphere touches tile (x, y) in both lateral directions and slice z, one cluster at a time
+bool TouchesCluster(const glm::mat4& projection, const glm::vec3& center, float radius, int x, int y, int z)
+{
+  const float depth = -center.z;
+  if (depth + radius < kNear || depth - radius > kFar)
+    return false;
+  if (depth + radius < SliceStart(z) || depth - radius >= SliceStart(z + 1))
+    return false;
+  //a sphere around the eye reaches every tile
+  if (depth < radius)
+    return true;
+  const auto touches_tile = [depth, radius](float focal, float lateral, int tile, int tile_count) {
+    const float low = -1.0f + 2.0f * static_cast<float>(tile) / static_cast<float>(tile_count);
+    const float high = -1.0f + 2.0f * static_cast<float>(tile + 1) / static_cast<float>(tile_count);
+    return BoundaryDistance(focal, low, lateral, depth) >= -radius &&
+        BoundaryDistance(focal, high, lateral, depth) <= radius;
+  };
+  return touches_tile(projection[0][0], center.x, x, LightClusters::kClusterX) &&
+      touches_tile(projection[1][1], center.y, y, LightClusters::kClusterY);
+}
+
+//Port of ClusterIndex in model.frag and lightning_pass.frag, -1 outside of the frustum
+int ShaderClusterIndex(const glm::mat4& projection, const glm::vec3& view_position)
+{
+  const float depth = -view_position.z;
+  if (depth < kNear || depth > kFar)
+    return -1;
+  const glm::vec2 ndc = glm::vec2(projection[0][0] * view_position.x, projection[1][1] * view_position.y) / depth;
+  if (std::abs(ndc.x) > 1.0f || std::abs(ndc.y) > 1.0f)
+    return -1;
+  const auto tile = [](float ndc_coordinate, int tile_count) {
+    return static_cast<int>(std::clamp((ndc_coordinate * 0.5f + 0.5f) * static_cast<float>(tile_count), 0.0f,
+                                       static_cast<float>(tile_count) - 1.0f));
+  };
+  const float slice = std::log(std::max(depth, kNear) / kNear) * LightClusters::kClusterZ / std::log(kFar / kNear);
+  const int z = static_cast<int>(std::clamp(slice, 0.0f, LightClusters::kClusterZ - 1.0f));
+  return ClusterIndex(tile(ndc.x, LightClusters::kClusterX), tile(ndc.y, LightClusters::kClusterY), z);
+}
+
+bool ClusterHolds(const LightClusters& clusters, int cluster, std::uint32_t light)
+{
+  const glm::uvec2 range = clusters.clusters()[cluster];
+  const auto indices = clusters.light_indices().subspan(range.x, range.y);
+  return std::find(indices.begin(), indices.end(), light) != indices.end();
+}
+
+bool CheckScenario(std::mt19937& random, LightClusters& clusters, std::size_t& binned, std::size_t& brute_force)
+{
+  std::uniform_real_distribution<float> position(-40.0f, 40.0f);
+  std::uniform_real_distribution<float> fov(30.0f, 100.0f);
+  std::uniform_real_distribution<float> intensity(0.0f, 8.0f);
+  const glm::vec3 eye(position(random), position(random), position(random));
+  const glm::vec3 target = eye + glm::normalize(glm::vec3(position(random), position(random) * 0.5f, position(random)) +
+                                                glm::vec3(0.0f, 0.0f, 0.01f));
+  const glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+  const glm::mat4 projection = glm::perspective(glm::radians(fov(random)), kAspect, kNear, kFar);
+
+  //Lights around the camera, some of them around the eye itself
+  std::vector<PointLight> lights;
+  for (int i = 0; i < kLightsPerScenario; i++)
+  {
+    const glm::vec3 color(intensity(random), intensity(random), intensity(random));
+    const glm::vec3 offset(position(random), position(random), position(random));
+    const glm::vec3 light_position = eye + (i % 8 == 0 ? offset * 0.02f : offset);
+    lights.push_back({glm::vec4(light_position, PointLightRadius(color)), glm::vec4(color, 1.0f)});
+  }
+  const gpr5300::FrustumPlanes planes = PlanesFromMatrix(projection * view);
+  clusters.Bin(lights, view, projection, planes);
+
+  for (const PointLight& light : lights)
+  {
+    const glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.position_radius), 1.0f));
+    const float radius = light.position_radius.w;
+    //The lights are culled against the whole frustum first, a sphere behind the eye can still reach it
+    const auto in_frustum = [&planes, &light](float sphere_radius) {
+      return std::ranges::all_of(planes, [&](const glm::vec4& plane) {
+        return glm::dot(glm::vec3(plane), glm::vec3(light.position_radius)) + plane.w >= -sphere_radius;
+      });
+    };
+    const auto visible = std::find_if(clusters.visible_lights().begin(), clusters.visible_lights().end(),
+                                      [&light](const PointLight& other) {
+                                        return other.position_radius == light.position_radius;
+                                      });
+    const bool is_visible = visible != clusters.visible_lights().end();
+    const auto index = static_cast<std::uint32_t>(visible - clusters.visible_lights().begin());
+
+    //Every cluster on its own, a light barely touching or missing a cluster may go either way with rounding
+    for (int z = 0; z < LightClusters::kClusterZ; z++)
+      for (int y = 0; y < LightClusters::kClusterY; y++)
+        for (int x = 0; x < LightClusters::kClusterX; x++)
+        {
+          const bool held = is_visible && ClusterHolds(clusters, ClusterIndex(x, y, z), index);
+          const bool touches =
+              in_frustum(radius * 0.999f) && TouchesCluster(projection, center, radius * 0.999f, x, y, z);
+          const bool may_touch =
+              in_frustum(radius * 1.001f) && TouchesCluster(projection, center, radius * 1.001f, x, y, z);
+          binned += held;
+          brute_force += touches;
+          if (held != touches && touches == may_touch)
+          {
+            std::cerr << "Cluster (" << x << ", " << y << ", " << z << ") " << (held ? "holds" : "misses")
+                      << " the light at depth " << -center.z << " with radius " << radius << '\n';
+            return false;
+          }
+        }
+
+    //Whatever the shaders shade inside the sphere must find the light in its list
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (int sample = 0; sample < kSamplesPerLight; sample++)
+    {
+      glm::vec3 offset(unit(random), unit(random), unit(random));
+      if (glm::length(offset) > 1.0f)
+        continue;
+      const int cluster = ShaderClusterIndex(projection, center + offset * radius * 0.999f);
+      if (cluster >= 0 && !(is_visible && ClusterHolds(clusters, cluster, index)))
+      {
+        std::cerr << "A fragment in cluster " << cluster << " is lit by a light missing from its list\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool CheckPointLightRadius()
+{
+  bool ok = true;
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> channel(0.0f, 50.0f);
+  for (int i = 0; i < 10000; i++)
+  {
+    const glm::vec3 color(channel(random), channel(random), channel(random));
+    const float intensity = std::max(color.x, std::max(color.y, color.z));
+    const float radius = PointLightRadius(color);
+    //At the radius the light is exactly at the cutoff, the brightest channel decides
+    const float at_radius = intensity / (1.0f + kLightLinear * radius + kLightQuadratic * radius * radius);
+    if (std::abs(at_radius - kLightCutoff) > kLightCutoff * 1.0e-3f ||
+        radius != PointLightRadius(glm::vec3(intensity)))
+    {
+      std::cerr << "PointLightRadius(" << color.x << ", " << color.y << ", " << color.z << ") = " << radius
+                << ", the light is " << at_radius << " there\n";
+      ok = false;
+      break;
+    }
+  }
+  //Lights never brighter than the cutoff reach nothing, brighter ones reach further
+  if (PointLightRadius(glm::vec3(kLightCutoff)) != 0.0f || PointLightRadius(glm::vec3(0.0f)) != 0.0f ||
+      PointLightRadius(glm::vec3(1.0f)) >= PointLightRadius(glm::vec3(2.0f)))
+  {
+    std::cerr << "PointLightRadius doesn't grow with the intensity from the cutoff\n";
+    ok = false;
+  }
+  return ok;
+}
+}
+
+int main()
+{
+  bool ok = CheckPointLightRadius();
+
+  std::mt19937 random(42);
+  LightClusters clusters;
+  std::size_t binned = 0;
+  std::size_t brute_force = 0;
+  for (int scenario = 0; ok && scenario < kScenarioCount; scenario++)
+    ok = CheckScenario(random, clusters, binned, brute_force);
+
+  std::cout << "Light clusters: " << kScenarioCount << " cameras, " << binned << " light/cluster pairs binned, "
+            << brute_force << " touching by brute force\n";
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
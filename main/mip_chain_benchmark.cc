@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "mip_chain.h"
+#include "stb_image.h"
+#include "thread_pool.h"
+
+//Mip chain throughput on the 2K/4K textures of data/, run from the directory holding data/. The SIMD generator is
+//timed on one thread and on a pool, against a straightforward scalar filter doing the same gamma-correct average.
+
+namespace
+{
+constexpr int kRepetitions = 5;
+
+struct BenchmarkTexture
+{
+  const char* path;
+  bool srgb;
+};
+
+constexpr BenchmarkTexture kTextures[] = {
+    {"data/backpack/ao.jpg", false},
+    {"data/textures/skybox/front.jpg", true},
+    {"data/roman_baths/textures/Roofs_baseColor.jpeg", true},
+    {"data/roman_baths/textures/Roofs_normal.png", false},
+    {"data/roman_baths/textures/Bath_tub_metallicRoughness.png", false},
+};
+
+float SrgbToLinear(float c)
+{
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSrgb(float l)
+{
+  return l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+}
+
+//One texel and one channel at a time, every level from the one above, odd sizes clamp like GenerateMipChain
+std::vector<std::uint8_t> ScalarMipChain(const std::uint8_t* pixels, int width, int height, int channels, bool srgb)
+{
+  const bool linearize = srgb && channels >= 3;
+  std::vector<std::uint8_t> result(pixels, pixels + static_cast<std::size_t>(width) * height * channels);
+  std::size_t source_offset = 0;
+  while (width > 1 || height > 1)
+  {
+    const int target_width = std::max(width / 2, 1);
+    const int target_height = std::max(height / 2, 1);
+    const std::size_t target_offset = result.size();
+    result.resize(target_offset + static_cast<std::size_t>(target_width) * target_height * channels);
+    for (int y = 0; y < target_height; y++)
+    {
+      const int y0 = std::min(y * 2, height - 1);
+      const int y1 = std::min(y * 2 + 1, height - 1);
+      for (int x = 0; x < target_width; x++)
+      {
+        const int x0 = std::min(x * 2, width - 1);
+        const int x1 = std::min(x * 2 + 1, width - 1);
+        for (int c = 0; c < channels; c++)
+        {
+          const bool gamma = linearize && c < 3;
+          const auto texel = [&](int tx, int ty) {
+            const std::size_t index = source_offset + (static_cast<std::size_t>(ty) * width + tx) * channels + c;
+            const float value = result[index] / 255.0f;
+            return gamma ? SrgbToLinear(value) : value;
+          };
+          float average = (texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1)) * 0.25f;
+          if (gamma)
+            average = LinearToSrgb(average);
+          result[target_offset + (static_cast<std::size_t>(y) * target_width + x) * channels + c] =
+              static_cast<std::uint8_t>(std::lround(std::clamp(average, 0.0f, 1.0f) * 255.0f));
+        }
+      }
+    }
+    source_offset = target_offset;
+    width = target_width;
+    height = target_height;
+  }
+  return result;
+}
+
+template<typename Function>
+double BestMilliseconds(Function&& function)
+{
+  double best = 0.0;
+  for (int i = 0; i < kRepetitions; i++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    if (i == 0 || duration.count() < best)
+      best = duration.count();
+  }
+  return best;
+}
+}
+
+int main()
+{
+  const std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+  gpr5300::ThreadPool pool(thread_count);
+  bool ok = true;
+
+  for (const BenchmarkTexture& texture : kTextures)
+  {
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(texture.path, &width, &height, &channels, 0);
+    if (pixels == nullptr)
+    {
+      std::cerr << "Could not load " << texture.path << ", run from the directory holding data/\n";
+      ok = false;
+      continue;
+    }
+
+    const double megapixels = static_cast<double>(width) * height / 1.0e6;
+    std::size_t checksum = 0;
+    const double scalar = BestMilliseconds([&] {
+      checksum += ScalarMipChain(pixels, width, height, channels, texture.srgb).size();
+    });
+    const double single = BestMilliseconds([&] {
+      checksum += gpr5300::GenerateMipChain(pixels, width, height, channels, texture.srgb).data.size();
+    });
+    const double pooled = BestMilliseconds([&] {
+      checksum += gpr5300::GenerateMipChain(pixels, width, height, channels, texture.srgb, &pool).data.size();
+    });
+    stbi_image_free(pixels);
+
+    std::cout << texture.path << " (" << width << 'x' << height << ", " << channels << " channels"
+              << (texture.srgb ? ", sRGB" : "") << ")\n"
+              << "  scalar " << scalar << " ms (" << megapixels * 1000.0 / scalar << " MP/s)\n"
+              << "  SIMD 1 thread " << single << " ms (" << megapixels * 1000.0 / single << " MP/s)\n"
+              << "  SIMD pool of " << thread_count << ' ' << pooled << " ms (" << megapixels * 1000.0 / pooled
+              << " MP/s)\n";
+    if (checksum == 0)
+      ok = false;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,6 +1,8 @@
-﻿#include <fstream>
+﻿#include <algorithm>
+#include <fstream>
 #include <map>
 #include <array>
+#include <cmath>
 #include <imgui.h>
 #include <iostream>
 #include <sstream>
@@ -10,22 +12,39 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <random>
 
+#include "bloom_chain.h"
+#include "cascaded_shadow_map.h"
 #include "engine.h"
 #include "file_utility.h"
 #include "free_camera.h"
+#include "frustum_culling.h"
+#include "geometry_arena.h"
 #include "global_utility.h"
+#include "gpu_profiler.h"
+#include "light_clusters.h"
+#include "mapped_ring_buffer.h"
 #include "model.h"
+#include "model_loader.h"
+#include "render_graph.h"
+#include "render_target_pool.h"
 #include "scene3d.h"
 #include "shader.h"
+#include "ssao_pass.h"
 #include "texture_loader.h"
+#include "uniform_buffer.h"
 
 namespace gpr5300
 {
 
-static constexpr std::int32_t kScreenWidth = 1200, kScreenHeight = 720;
-static constexpr float Lerp(float f) {
-  return 0.1f + f * (1.0f - 0.1f);
-}
+static constexpr float kSpecularIntensity = 0.5f; //written to the G-buffer alpha, the models have no specular maps
+//Dim lights scattered between the trees on top of the four editable ones
+static constexpr int kScatteredLightCount = static_cast<int>(LightClusters::kMaxPointLights) - 4;
+//Time the GL thread may spend uploading streamed models each frame
+static constexpr float kModelUploadBudgetMs = 4.0f;
+static constexpr int kShadowMapResolution = 2048; //per cascade
+static constexpr GLint kShadowMapUnit = 7; //above the units the meshes bind their textures to
+//Culled tree matrices of a frame: the ones the camera sees, then the ones of each shadow cascade
+static constexpr int kInstanceSlots = 1 + kShadowCascades;
 class Scene3D final : public Scene
 {
  public:
@@ -35,10 +54,20 @@ class Scene3D final : public Scene
   void OnEvent(const SDL_Event& event) override;
   void DrawImGui() override;
   void UpdateCamera(const float dt) override;
-  Model Instancing_Model_;
+  bool IsLoading() const override { return !model_loader_.idle(); }
+  float GpuFrameTimeMs() const override;
+  void SetRenderScale(float scale) override { render_scale_ = scale; }
+  void SetCameraPose(const glm::vec3& position, const glm::vec3& target) override { camera_.LookAt(position, target); }
+  void OnResize(int width, int height) override;
  private:
-
-  const float aspect = 1280.0f / 720.0f;
+  void SetupInstancing(const Model& instancing_model);
+  void DrawPlaceholder(ModelHandle handle, const glm::mat4& model);
+
+  //Size of the window, or of the headless framebuffer, every screen target follows it
+  int width_ = 1280;
+  int height_ = 720;
+  //The HDR and G-buffer targets are this fraction of it, bloom_final upscales to the output
+  float render_scale_ = 1.0f;
   const float fovY = glm::radians(45.0f);
   const float zNear = 0.1f;
   const float zFar = 100.0f;
@@ -46,46 +75,44 @@ class Scene3D final : public Scene
 
   //bloom
   Shader shader_light_ = {};
-  Shader shader_blur_ = {};
   Shader shader_bloom_final_ = {};
+  BloomChain bloom_chain_;
 
-  GLuint hdr_fbo_ = 0;
-  GLuint color_buffer_[2] = {};
-  GLuint rbo_depth_ = 0;
-
-  //Pingpong for blur
-  GLuint pingpong_fbo_[2] = {};
-  GLuint pingpong_color_buffer_[2] = {};
+  RenderTargetPool render_targets_;
+  //Passes of the frame, declared again every Update
+  RenderGraph render_graph_;
 
   std::vector<glm::vec3> light_positions_ = {};
   std::vector<glm::vec3> light_colors_ = {};
+  std::vector<PointLight> scattered_lights_;
+  int scattered_light_count_ = 256;
+  std::vector<PointLight> point_lights_;
+  LightClusters light_clusters_;
 
   float scaleFactor_instancing = 0.1f;
 
   //model
   Shader shader_model_ = {};
-  Model model_;
-  Model model_2_;
+  UniformBuffer<FrameData> frame_data_buffer_;
+  //Vertices and indices of the static models, each drawn with a few multi-draws
+  GeometryArena geometry_arena_;
+  ModelLoader model_loader_;
+  ModelHandle model_ = 0;
+  ModelHandle model_2_ = 0;
+  ModelHandle instancing_model_ = 0;
+  bool instancing_ready_ = false;
   bool ssao=false;
 
   Shader geometry_pass_;
   Shader lighting_pass_;
-  Shader ssao_;
-  Shader ssao_blur_;
-  static constexpr std::int32_t kKernelSize = 32;
-  std::vector<glm::vec3> ssao_kernel_{};
-  unsigned int g_buffer_ = 0;
-  unsigned int ssao_fbo_ = 0, ssao_blur_fbo_ = 0;
-  unsigned int g_position_ = 0, g_normal_ = 0, g_albedo_ = 0;
-  unsigned int noise_texture_ = 0;
-  unsigned int ssao_color_buffer_ = 0, ssao_color_buffer_blur_ = 0;
+  SsaoPass ssao_pass_;
   //skybox
   Shader skybox_program_ = {};
 
   GLuint skybox_vao_ = 0;
   GLuint skybox_vbo_ = 0;
 
-  unsigned int skybox_texture_ = -1;
+  TextureHandle skybox_texture_ = 0;
 
   float skybox_vertices_[108] = {};
 
@@ -105,20 +132,26 @@ class Scene3D final : public Scene
   bool Normal_state_ = true;
 
   Frustum frustum_;
+  GpuProfiler gpu_profiler_;
 
   Shader Instancing_shader_;
-  unsigned int Instancing_buffer_;
+  //Matrices of the trees visible this frame, compacted into the region of the ring the GPU isn't reading
+  MappedRingBuffer instancing_ring_;
+  SphereArray instancing_spheres_;
+  std::vector<std::uint32_t> visible_instances_;
   glm::mat4* modelMatrices {};
   unsigned int Instancing_amout;
 
   Shader Normal_Map;
 
-  unsigned int ground_text_ = 0;
-  unsigned int ground_text_normal_ = 0;
+  TextureHandle ground_text_ = 0;
+  TextureHandle ground_text_normal_ = 0;
+  //sun, the main light: the only one casting shadows
   Shader shader_depth_ = {};
-  GLuint depth_map_fbo_ = 0;
-  GLuint depth_map_texture_ = 0;
-  const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
+  CascadedShadowMap shadow_map_;
+  bool shadows_ = true;
+  glm::vec3 sun_direction_ = glm::vec3(-0.4f, -1.0f, -0.3f);
+  glm::vec3 sun_color_ = glm::vec3(0.6f, 0.55f, 0.5f);
 
   glm::vec3 lightPos0;
   glm::vec3 lightPos1;
@@ -147,68 +180,39 @@ void Scene3D::Begin()
   Normal_Map = Shader("data/shaders/scene3d/normal_map.vert","data/shaders/scene3d/normal_map.frag");
   Instancing_shader_ = Shader("data/shaders/scene3d/instancing.vert", "data/shaders/scene3d/instancing.frag");
   shader_light_ = Shader("data/shaders/bloom/bloom.vert", "data/shaders/bloom/light.frag");
-  shader_blur_ = Shader("data/shaders/bloom/blur.vert", "data/shaders/bloom/blur.frag");
   shader_bloom_final_ = Shader("data/shaders/bloom/bloom_final.vert", "data/shaders/bloom/bloom_final.frag");
   shader_model_ = Shader("data/shaders/scene3d/model.vert", "data/shaders/scene3d/model.frag");
   skybox_program_ = Shader("data/shaders/scene3d/cubemaps.vert", "data/shaders/scene3d/cubemaps.frag");
+  geometry_pass_ = Shader("data/shaders/saso/geometry_pass.vert", "data/shaders/saso/geometry_pass.frag");
+  lighting_pass_ = Shader("data/shaders/saso/lightning_pass.vert", "data/shaders/saso/lightning_pass.frag");
+  shader_depth_ = Shader("data/shaders/shadow_map/shadow_depth.vert", "data/shaders/shadow_map/shadow_depth.frag");
+  frame_data_buffer_.Create(kFrameDataBinding);
+
+
+  //Streamed in the background, placeholders are drawn until they are on the GPU and the draws needing the textures
+  //are skipped. The textures are queued first, they are much quicker than the imports.
+  //The instanced trees keep VAOs of their own, SetupInstancing adds the instance matrices to them. They share the
+  //import of the tree drawn from the arena.
+  ground_text_ = model_loader_.LoadTexture("data/textures/brickwall.jpg");
+  ground_text_normal_ = model_loader_.LoadTexture("data/textures/brickwall_normal.jpg", gpr5300::TextureRole::kNormal);
+  static constexpr std::array<std::string_view, 6> kSkyboxFaces = {
+      "data/textures/skybox/right.jpg",
+      "data/textures/skybox/left.jpg",
+      "data/textures/skybox/top.jpg",
+      "data/textures/skybox/bottom.jpg",
+      "data/textures/skybox/front.jpg",
+      "data/textures/skybox/back.jpg"
+  };
+  skybox_texture_ = model_loader_.LoadCubemap(kSkyboxFaces);
+  geometry_arena_.Create();
+  model_ = model_loader_.Load("data/roman_baths/scene.gltf", VertexFormat::kCompact, &geometry_arena_);
+  model_2_ = model_loader_.Load("data/tree/scene.gltf", VertexFormat::kCompact, &geometry_arena_);
+  instancing_model_ = model_loader_.Load("data/tree/scene.gltf");
 
 
-  model_ = Model("data/roman_baths/scene.gltf");
-  model_2_ = Model("data/tree/scene.gltf");
-
-  Instancing_Model_ = Model("data/tree/scene.gltf");
-
-  ground_text_ = TextureFromFile("brickwall.jpg", "data/textures");
-  ground_text_normal_ = TextureFromFile("brickwall_normal.jpg", "data/textures");
-
-
-  //Configure FBO
-  glGenFramebuffers(1, &hdr_fbo_);
-  glBindFramebuffer(GL_FRAMEBUFFER, hdr_fbo_);
-  //We need 2 floating point color buffers, for normal rendering and brightness thresholds
-  glGenTextures(2, color_buffer_);
-  for (unsigned int i = 0; i < 2; i++)
-  {
-    glBindTexture(GL_TEXTURE_2D, color_buffer_[i]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 1280, 720, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    //be sure to clamp to edge!
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, color_buffer_[i], 0);
-  }
-
-  //create and attach depth buffer
-  glGenRenderbuffers(1, &rbo_depth_);
-  glBindRenderbuffer(GL_RENDERBUFFER, rbo_depth_);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 1280, 720);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo_depth_);
-  //select color attachment
-  unsigned int attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
-  glDrawBuffers(2, attachments);
-  // finally check if framebuffer is complete
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    std::cout << "Framebuffer not complete!" << std::endl;
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-  //Pingpong for blur
-  glGenFramebuffers(2, pingpong_fbo_);
-  glGenTextures(2, pingpong_color_buffer_);
-  for (unsigned int i = 0; i < 2; i++)
-  {
-    glBindFramebuffer(GL_FRAMEBUFFER, pingpong_fbo_[i]);
-    glBindTexture(GL_TEXTURE_2D, pingpong_color_buffer_[i]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 1280, 720, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpong_color_buffer_[i], 0);
-    // also check if framebuffers are complete (no need for depth buffer)
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-      std::cout << "Framebuffer not complete!" << std::endl;
-  }
+  //The HDR, G-buffer, SSAO and bloom targets are transient, declared to render_graph_ every frame
+  bloom_chain_.Create();
+  shadow_map_.Create(kShadowMapResolution);
 
   // lighting info
   // -------------
@@ -232,6 +236,24 @@ void Scene3D::Begin()
   light_colors_.push_back(lightColor2);
   light_colors_.push_back(lightColor3);
 
+  std::default_random_engine light_generator;
+  std::uniform_real_distribution<float> light_angle(0.0f, glm::radians(360.0f));
+  std::uniform_real_distribution<float> light_distance(5.0f, 25.0f);
+  std::uniform_real_distribution<float> light_height(0.5f, 4.0f);
+  std::uniform_real_distribution<float> light_channel(0.0f, 1.5f);
+  std::uniform_real_distribution<float> light_radius(2.0f, 6.0f);
+  scattered_lights_.resize(kScatteredLightCount);
+  for (PointLight& light : scattered_lights_)
+  {
+    const float angle = light_angle(light_generator);
+    const float distance = light_distance(light_generator);
+    light.position_radius = glm::vec4(std::sin(angle) * distance, light_height(light_generator),
+                                      std::cos(angle) * distance, light_radius(light_generator));
+    light.color = glm::vec4(light_channel(light_generator), light_channel(light_generator),
+                            light_channel(light_generator), 1.0f);
+  }
+  light_clusters_.Create();
+
 
 
   Instancing_amout = 3000;
@@ -264,155 +286,23 @@ void Scene3D::Begin()
 
 
 
-  glGenBuffers(1, &Instancing_buffer_);
-  glBindBuffer(GL_ARRAY_BUFFER, Instancing_buffer_);
-  glBufferData(GL_ARRAY_BUFFER, Instancing_amout * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
-  for(unsigned int i = 0; i < Instancing_Model_.meshes().size(); i++)
-  {
-    unsigned int VAO = Instancing_Model_.meshes()[i].VAO();
-    glBindVertexArray(VAO);
-    // vertex attributes
-    std::size_t vec4Size = sizeof(glm::vec4);
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(1 * vec4Size));
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(2 * vec4Size));
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(3 * vec4Size));
-
-    glVertexAttribDivisor(3, 1);
-    glVertexAttribDivisor(4, 1);
-    glVertexAttribDivisor(5, 1);
-    glVertexAttribDivisor(6, 1);
-
-    glBindVertexArray(0);
-  }
-
-
+  instancing_ring_.Create(GL_ARRAY_BUFFER, kInstanceSlots * Instancing_amout * sizeof(glm::mat4));
+  visible_instances_.resize(Instancing_amout);
 
-  // configure g-buffer framebuffer
-  // ------------------------------------------------------------------------------------------------
-
-  glGenFramebuffers(1, &g_buffer_);
-  glBindFramebuffer(GL_FRAMEBUFFER, g_buffer_);
-
-  // position color buffer
-  glGenTextures(1, &g_position_);
-  glBindTexture(GL_TEXTURE_2D, g_position_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, kScreenWidth, kScreenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_position_, 0);
-  // normal color buffer
-  glGenTextures(1, &g_normal_);
-  glBindTexture(GL_TEXTURE_2D, g_normal_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, kScreenWidth, kScreenHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, g_normal_, 0);
-  // color + specular color buffer
-  glGenTextures(1, &g_albedo_);
-  glBindTexture(GL_TEXTURE_2D, g_albedo_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kScreenWidth, kScreenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, g_albedo_, 0);
-  // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
-  unsigned int new_attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
-  glDrawBuffers(3, new_attachments);
-  // create and attach depth buffer (renderbuffer)
-  unsigned int rbo_depth;
-  glGenRenderbuffers(1, &rbo_depth);
-  glBindRenderbuffer(GL_RENDERBUFFER, rbo_depth);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, kScreenWidth, kScreenHeight);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo_depth);
-  // finally check if framebuffer is complete
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    std::cout << "Framebuffer not complete!" << std::endl;
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-  // also create framebuffer to hold SSAO processing stage
-  // -----------------------------------------------------
-
-  glGenFramebuffers(1, &ssao_fbo_);
-  glGenFramebuffers(1, &ssao_blur_fbo_);
-  glBindFramebuffer(GL_FRAMEBUFFER, ssao_fbo_);
-
-  // SSAO color buffer
-  glGenTextures(1, &ssao_color_buffer_);
-  glBindTexture(GL_TEXTURE_2D, ssao_color_buffer_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, kScreenWidth, kScreenHeight, 0, GL_RED, GL_FLOAT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssao_color_buffer_, 0);
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    std::cout << "SSAO Framebuffer not complete!" << std::endl;
-
-  // and blur stage
-  glBindFramebuffer(GL_FRAMEBUFFER, ssao_blur_fbo_);
-  glGenTextures(1, &ssao_color_buffer_blur_);
-  glBindTexture(GL_TEXTURE_2D, ssao_color_buffer_blur_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, kScreenWidth, kScreenHeight, 0, GL_RED, GL_FLOAT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssao_color_buffer_blur_, 0);
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    std::cout << "SSAO Blur Framebuffer not complete!" << std::endl;
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-  // generate sample kernel
-  // ----------------------
-  std::uniform_real_distribution<GLfloat> random_floats(0.0, 1.0); // generates random floats between 0.0 and 1.0
-  std::default_random_engine generator;
-  ssao_kernel_.resize(kKernelSize);
-  for (std::int32_t i = 0; i < kKernelSize; ++i) {
-    glm::vec3 sample(random_floats(generator) * 2.0 - 1.0, random_floats(generator) * 2.0 - 1.0,
-                     random_floats(generator));
-    sample = glm::normalize(sample);
-    sample *= random_floats(generator);
-    float scale = static_cast<float>(i) / static_cast<float>(kKernelSize);
-
-    // scale samples s.t. they're more aligned to center of kernel
-    scale = Lerp(scale * scale);
-    sample *= scale;
-    ssao_kernel_.push_back(sample);
-  }
 
-  std::cout << "stuck\n";
 
-  // generate noise texture
-  // ----------------------
-  std::vector<glm::vec3> ssao_noise;
-  for (unsigned int i = 0; i < 16; i++) {
-    glm::vec3 noise(random_floats(generator) * 2.0 - 1.0, random_floats(generator) * 2.0 - 1.0,
-                    0.0f); // rotate around z-axis (in tangent space)
-    ssao_noise.push_back(noise);
-  }
-  glGenTextures(1, &noise_texture_);
-  glBindTexture(GL_TEXTURE_2D, noise_texture_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssao_noise[0]);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  ssao_pass_.Create();
 
   // shader configuration
   // --------------------
-  glUseProgram(lighting_pass_.id_);
-  glUniform1i(glGetUniformLocation(lighting_pass_.id_, "gPosition"), 0);
-  glUniform1i(glGetUniformLocation(lighting_pass_.id_, "gNormal"), 1);
-  glUniform1i(glGetUniformLocation(lighting_pass_.id_, "gAlbedo"), 2);
-  glUniform1i(glGetUniformLocation(lighting_pass_.id_, "ssao_"), 3);
-  glUseProgram(ssao_.id_);
-  glUniform1i(glGetUniformLocation(ssao_.id_, "gPosition"), 0);
-  glUniform1i(glGetUniformLocation(ssao_.id_, "gNormal"), 1);
-  glUniform1i(glGetUniformLocation(ssao_.id_, "texNoise"), 2);
-  glUseProgram(ssao_blur_.id_);
-  glUniform1i(glGetUniformLocation(ssao_blur_.id_, "ssaoInput"), 0);
+  lighting_pass_.Use();
+  lighting_pass_.SetInt("gDepth", 0);
+  lighting_pass_.SetInt("gNormal", 1);
+  lighting_pass_.SetInt("gAlbedoSpec", 2);
+  lighting_pass_.SetInt("ssao", 3);
+  lighting_pass_.SetInt("shadowMap", kShadowMapUnit);
+  shader_model_.Use();
+  shader_model_.SetInt("shadowMap", kShadowMapUnit);
 
 
 
@@ -474,27 +364,12 @@ void Scene3D::Begin()
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
 
-  std::vector<std::string_view> faces
-      {
-          "data/textures/skybox/right.jpg",
-          "data/textures/skybox/left.jpg",
-          "data/textures/skybox/top.jpg",
-          "data/textures/skybox/bottom.jpg",
-          "data/textures/skybox/front.jpg",
-          "data/textures/skybox/back.jpg"
-      };
-
-  skybox_texture_ = GenerateCubemap(faces);
-
-
 
   // shader configuration
   // --------------------
   Normal_Map.Use();
   Normal_Map.SetInt("diffuseMap", 0);
   Normal_Map.SetInt("normalMap", 1);
-  shader_blur_.Use();
-  shader_blur_.SetInt("image", 0);
   shader_bloom_final_.Use();
   shader_bloom_final_.SetInt("scene", 0);
   shader_bloom_final_.SetInt("bloomBlur", 1);
@@ -506,39 +381,103 @@ void Scene3D::Begin()
 void Scene3D::End()
 {
   Normal_Map.Delete();
-  shader_blur_.Delete();
+  bloom_chain_.Delete();
+  ssao_pass_.Delete();
+  render_targets_.Clear();
+  geometry_pass_.Delete();
+  lighting_pass_.Delete();
+  shader_depth_.Delete();
+  shadow_map_.Delete();
   shader_light_.Delete();
   shader_bloom_final_.Delete();
   skybox_program_.Delete();
   Instancing_shader_.Delete();
+  frame_data_buffer_.Delete();
+  light_clusters_.Delete();
+  instancing_ring_.Delete();
+  geometry_arena_.Delete();
+  gpu_profiler_.Delete();
   delete[] modelMatrices;
   modelMatrices = nullptr;
 
 }
 
+void Scene3D::SetupInstancing(const Model& instancing_model)
+{
+  //The meshes only exist once the model is resident, their VAOs get the instance matrices then
+  glBindBuffer(GL_ARRAY_BUFFER, instancing_ring_.buffer());
+  for(unsigned int i = 0; i < instancing_model.meshes().size(); i++)
+  {
+    unsigned int VAO = instancing_model.meshes()[i].VAO();
+    glBindVertexArray(VAO);
+    // vertex attributes
+    std::size_t vec4Size = sizeof(glm::vec4);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(1 * vec4Size));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(2 * vec4Size));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(3 * vec4Size));
+
+    glVertexAttribDivisor(3, 1);
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribDivisor(5, 1);
+    glVertexAttribDivisor(6, 1);
+
+    glBindVertexArray(0);
+  }
+
+  //World space sphere of every tree, the model bounds are only known once it is loaded
+  instancing_spheres_.Clear();
+  for (unsigned int i = 0; i < Instancing_amout; i++)
+  {
+    instancing_spheres_.Add(instancing_model.bounding_sphere().Transformed(modelMatrices[i]));
+  }
+  instancing_ready_ = true;
+}
+
+void Scene3D::DrawPlaceholder(ModelHandle handle, const glm::mat4& model)
+{
+  glm::vec3 min, max;
+  if (!model_loader_.GetBoundingBox(handle, min, max))
+    return;
+  //renderCube spans [-1, 1], stretch it over the bounding box of the model
+  const glm::mat4 box = glm::scale(glm::translate(model, (min + max) * 0.5f), (max - min) * 0.5f);
+  shader_light_.SetMat4("model", box);
+  shader_light_.SetVec3("lightColor", glm::vec3(0.3f));
+  renderCube();
+}
+
 void Scene3D::Update(const float dt) {
   UpdateCamera(dt);
   elapsedTime_ += dt;
 
+  model_loader_.Update(kModelUploadBudgetMs);
+  Model* baths = model_loader_.Get(model_);
+  Model* tree = model_loader_.Get(model_2_);
+  Model* instancing_model = model_loader_.Get(instancing_model_);
+  //0 while still streaming
+  const unsigned int ground_texture = model_loader_.GetTexture(ground_text_);
+  const unsigned int ground_normal_texture = model_loader_.GetTexture(ground_text_normal_);
+  const unsigned int skybox_texture = model_loader_.GetTexture(skybox_texture_);
+  if (instancing_model && !instancing_ready_)
+    SetupInstancing(*instancing_model);
+
   if (ssao&Normal_state_) {
     if (l == 0) { Normal_state_ = false; l=1;}
     else { ssao = false; l=0;}
   }
 
-  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-  // 1. render scene into floating point framebuffer
-  // -----------------------------------------------
-  glBindFramebuffer(GL_FRAMEBUFFER, hdr_fbo_);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  //Same textures as last frame unless the size or the render scale changed
+  const int render_width = std::max(1, static_cast<int>(std::lround(static_cast<float>(width_) * render_scale_)));
+  const int render_height = std::max(1, static_cast<int>(std::lround(static_cast<float>(height_) * render_scale_)));
+  const float aspect = static_cast<float>(width_) / static_cast<float>(height_);
   auto projection = glm::perspective(fovY, aspect, zNear, zFar);
   auto view = camera_.view();
   auto model = glm::mat4(1.0f);
 
-  glActiveTexture(GL_TEXTURE0);
-  shader_model_.Use();
-
 
 
   light_positions_[0] = lightPos0;
@@ -557,284 +496,422 @@ void Scene3D::Update(const float dt) {
   //auto projection = glm::perspective(glm::radians(45.0f), (float)1280 / (float)720, 0.1f, 10000.0f);
   //auto view = camera_.view();
 
-  shader_model_.SetMat4("projection", projection);
-  shader_model_.SetMat4("view", view);
-
-  frustum_.CreateFrustumFromCamera(camera_, aspect, fovY, zNear, zFar);
-  glm::mat4 projView = projection * camera_.GetViewMatrix();
-  frustum_.Update(projView);
-
-  shader_model_.SetVec3Array("lightPos", light_positions_, light_positions_.size());
-  shader_model_.SetVec3Array("lightColor", light_colors_, light_colors_.size());
+  const glm::vec3 sun_direction = glm::length(sun_direction_) > 0.0f ? glm::normalize(sun_direction_)
+                                                                    : glm::vec3(0.0f, -1.0f, 0.0f);
+  shadow_map_.Update(view, fovY, aspect, zNear, zFar, sun_direction);
 
-  const glm::vec3 view_pos = camera_.camera_position_;
-  shader_model_.SetVec3("viewPos", glm::vec3(view_pos.x, view_pos.y, view_pos.z));
-
-  //Draw model
-  //auto model = glm::mat4(1.0f);
-  model = glm::translate(model, glm::vec3(1.0f, 0.0f, 0.0f));
-  model = glm::scale(model, model_scale_ * glm::vec3(1.0f, 1.0f, 1.0f));
-
-  shader_model_.SetMat4("model", model);
+  //Camera and lights are uploaded once here, every program reads them from the FrameData block
+  FrameData frame_data{};
+  frame_data.projection = projection;
+  frame_data.view = view;
+  frame_data.view_pos = glm::vec4(camera_.camera_position_, 1.0f);
+  for (std::size_t i = 0; i < light_positions_.size() && i < kMaxLights; i++)
+  {
+    frame_data.light_positions[i] = glm::vec4(light_positions_[i], 1.0f);
+    frame_data.light_colors[i] = glm::vec4(light_colors_[i], 1.0f);
+  }
+  frame_data.sun_direction = glm::vec4(sun_direction, shadows_ ? 1.0f : 0.0f);
+  frame_data.sun_color = glm::vec4(sun_color_, 1.0f);
+  shadow_map_.Fill(frame_data);
+  frame_data_buffer_.Update(frame_data);
 
+  frustum_.Update(projection * view);
 
-  if (frustum_.IsObjectInFrustum(model_)) {
-    model_.Draw(shader_model_.id_);
+  //Every light shader reads the lights of its cluster from the storage buffers binned here
+  point_lights_.clear();
+  for (std::size_t i = 0; i < light_positions_.size(); i++)
+  {
+    point_lights_.push_back({glm::vec4(light_positions_[i], PointLightRadius(light_colors_[i])),
+                             glm::vec4(light_colors_[i], 1.0f)});
   }
+  point_lights_.insert(point_lights_.end(), scattered_lights_.begin(),
+                       scattered_lights_.begin() + scattered_light_count_);
+  light_clusters_.Update(point_lights_, view, projection, frustum_.plane_equations());
+
+  //Draw cost follows the visible trees: the culled instances are compacted into this frame's ring region
+  //and the draws start at that region with their base instance. Each shadow cascade culls its own casters.
+  std::array<GLsizei, kInstanceSlots> visible_instance_counts = {};
+  std::array<GLuint, kInstanceSlots> base_instances = {};
+  if (instancing_ready_)
+  {
+    auto* instances = static_cast<glm::mat4*>(instancing_ring_.BeginRegion());
+    //No tree is drawn when the ring could not be mapped, the counts stay 0
+    for (int slot = 0; instances != nullptr && slot < (shadows_ ? kInstanceSlots : 1); slot++)
+    {
+      const FrustumPlanes planes =
+          slot == 0 ? frustum_.plane_equations() : shadow_map_.frustum(slot - 1).plane_equations();
+      const std::size_t count = CullSpheres(planes, instancing_spheres_, visible_instances_);
+      glm::mat4* slot_instances = instances + slot * Instancing_amout;
+      for (std::size_t i = 0; i < count; i++)
+      {
+        slot_instances[i] = modelMatrices[visible_instances_[i]];
+      }
+      visible_instance_counts[slot] = static_cast<GLsizei>(count);
+      base_instances[slot] =
+          static_cast<GLuint>((instancing_ring_.region_index() * kInstanceSlots + slot) * Instancing_amout);
+    }
+  }
+  const GLsizei visible_instance_count = visible_instance_counts[0];
+  const GLuint base_instance = base_instances[0];
 
   glm::mat4 model2 = glm::mat4(1.0f);
   model2 = glm::translate(model2, glm::vec3(0.0f, 0.0f, 25.0f));
   model2 = glm::rotate(model2, glm::radians(270.0f), glm::vec3(1.0f, 0.0f, 0.0f));
   model2 = glm::scale(model2, glm::vec3(model_scale_2_));
-  shader_model_.SetMat4("model", model2);
-  model_2_.Draw(shader_model_.id_);
-  glBindVertexArray(0);
+  const glm::mat4 baths_model =
+      glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f)), model_scale_ * glm::vec3(1.0f));
 
-  Instancing_shader_.Use();
-  Instancing_shader_.SetMat4("projection", projection);
-  Instancing_shader_.SetMat4("view", camera_.view());
-  Instancing_shader_.SetMat4("model", model2);
-  Instancing_shader_.Use();
-  Instancing_shader_.SetInt("texture_diffuse1", 0);
-  for (unsigned int i = 0; i < Instancing_Model_.meshes().size(); i++) {
+  //The passes of the frame and the targets they use, the graph runs what the tonemap ends up reading
+  // -----------------------------------------------
+  const RenderTargetDesc hdr_desc{render_width, render_height, GL_RGBA16F, GL_LINEAR};
+  const RenderResource hdr_color = render_graph_.Create("HDR color", hdr_desc);
+  //Only bloom reads the bright colors, without it the passes drawing the HDR colors leave their second output unbound
+  const RenderResource hdr_bright = bloom_state_ ? render_graph_.Create("HDR bright", hdr_desc) : kNoRenderResource;
+  std::vector<RenderResource> hdr_targets = {hdr_color};
+  if (bloom_state_)
+    hdr_targets.push_back(hdr_bright);
+  const RenderResource hdr_depth =
+      render_graph_.Create("HDR depth", {render_width, render_height, GL_DEPTH_COMPONENT32F});
+
+  // 0. sun depth from every cascade, the map is kept by shadow_map_ so it is imported
+  // -----------------------------------------------
+  RenderResource shadow_map = kNoRenderResource;
+  if (shadows_)
+  {
+    shadow_map = render_graph_.Import("Shadow map", shadow_map_.texture());
+    render_graph_.AddPass("Shadows", {.writes = {shadow_map}}, [&] {
+      //Slope scaled bias against the acne, the receivers add a normal offset
+      shader_depth_.Use();
+      glEnable(GL_POLYGON_OFFSET_FILL);
+      glPolygonOffset(2.0f, 1.0f);
+      for (int cascade = 0; cascade < kShadowCascades; cascade++)
+      {
+        //Casters outside of the cascade volume can't shadow anything in it
+        const Frustum& casters = shadow_map_.frustum(cascade);
+        shadow_map_.BeginCascade(cascade);
+        shader_depth_.SetMat4("lightSpaceMatrix", shadow_map_.light_space_matrix(cascade));
+        shader_depth_.SetBool("instanced", false);
+        if (baths && casters.IsObjectInFrustum(*baths, baths_model)) {
+          baths->DrawDepth(shader_depth_, baths_model, [&casters, &baths_model](const Mesh& mesh) {
+            return casters.IsMeshInFrustum(mesh, baths_model);
+          });
+        }
+        if (tree && casters.IsObjectInFrustum(*tree, model2)) {
+          tree->DrawDepth(shader_depth_, model2, [&casters, &model2](const Mesh& mesh) {
+            return casters.IsMeshInFrustum(mesh, model2);
+          });
+        }
+
+        shader_depth_.SetBool("instanced", true);
+        const GLsizei caster_count = visible_instance_counts[1 + cascade];
+        for (unsigned int i = 0; instancing_ready_ && caster_count != 0 && i < instancing_model->meshes().size(); i++) {
+          const Mesh& mesh = instancing_model->meshes()[i];
+          if (mesh.index_count() == 0)
+            continue;
+          mesh.BindVertexFormat(shader_depth_);
+          glBindVertexArray(mesh.VAO());
+          glDrawElementsInstancedBaseInstance(GL_TRIANGLES, static_cast<GLsizei>(mesh.index_count()), mesh.index_type(),
+                                              nullptr, caster_count, base_instances[1 + cascade]);
+        }
+      }
+      glBindVertexArray(0);
+      glDisable(GL_POLYGON_OFFSET_FILL);
+    });
+  }
 
-    if (!Instancing_Model_.get_textures_loaded().empty()) {
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, Instancing_Model_.get_textures_loaded()[0].id);
-    } else {
-      std::cerr << "Erreur : Aucune texture chargée  !" << std::endl;
-    }
-    glBindVertexArray(Instancing_Model_.meshes()[i].VAO());
-    if (!Instancing_Model_.meshes()[i].indices_.empty()) {
-      glDrawElementsInstanced(
-          GL_TRIANGLES,
-          static_cast<unsigned int>(Instancing_Model_.meshes()[i].indices_.size()),
-          GL_UNSIGNED_INT,
-          0,
-          Instancing_amout
-      );
-    }
+  // 1. render scene into floating point framebuffer
+  // -----------------------------------------------
+  RenderPassDesc scene_pass{.colors = hdr_targets, .depth = hdr_depth};
+  if (shadows_)
+    scene_pass.reads.push_back(shadow_map);
+  render_graph_.AddPass("Scene", std::move(scene_pass), [&] {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glActiveTexture(GL_TEXTURE0 + kShadowMapUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map_.texture());
+    glActiveTexture(GL_TEXTURE0);
+    shader_model_.Use();
 
+    //Draw model
+    //auto model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::scale(model, model_scale_ * glm::vec3(1.0f, 1.0f, 1.0f));
 
-  }
-  glBindVertexArray(0);
 
-  if (ssao){
-    glDisable(GL_CULL_FACE);
+    //Whole model first, then each mesh on its own
+    if (baths && frustum_.IsObjectInFrustum(*baths, model)) {
+      baths->Draw(shader_model_, model, [this, &model](const Mesh& mesh) {
+        return frustum_.IsMeshInFrustum(mesh, model);
+      });
+    }
 
-    // -----------------------------------------------------------------
-    glBindFramebuffer(GL_FRAMEBUFFER, g_buffer_);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(geometry_pass_.id_);
-    geometry_pass_.SetMat4("projection", projection);
-    geometry_pass_.SetMat4("view", view);
+    if (tree && frustum_.IsObjectInFrustum(*tree, model2)) {
+      tree->Draw(shader_model_, model2, [this, &model2](const Mesh& mesh) {
+        return frustum_.IsMeshInFrustum(mesh, model2);
+      });
+    }
+    glBindVertexArray(0);
 
+    Instancing_shader_.Use();
+    Instancing_shader_.SetMat4("model", model2);
+    Instancing_shader_.Use();
+    Instancing_shader_.SetInt("texture_diffuse1", 0);
 
+    for (unsigned int i = 0; instancing_ready_ && i < instancing_model->meshes().size(); i++) {
 
-    glUniform1i(glGetUniformLocation(geometry_pass_.id_, "invertedNormals"), 0);
-    model = glm::mat4(1.0f);
-    for (int i = 0; i < Instancing_Model_.meshes().size(); i++) {
-      glUniformMatrix4fv(glGetUniformLocation(geometry_pass_.id_, "model"), 1, GL_FALSE,
-                         glm::value_ptr(modelMatrices[i]));
-      glBindVertexArray(Instancing_Model_.meshes()[i].VAO());
-      glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(Instancing_Model_.meshes()[i].indices_.size()),
-                              GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(Instancing_amout));
-      glBindVertexArray(0);
-    }
+      if (!instancing_model->get_textures_loaded().empty()) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, instancing_model->get_textures_loaded()[0].id);
+      } else {
+        std::cerr << "Erreur : Aucune texture chargée  !" << std::endl;
+      }
+      instancing_model->meshes()[i].BindVertexFormat(Instancing_shader_);
+      glBindVertexArray(instancing_model->meshes()[i].VAO());
+      if (instancing_model->meshes()[i].index_count() != 0 && visible_instance_count != 0) {
+        glDrawElementsInstancedBaseInstance(
+            GL_TRIANGLES,
+            static_cast<unsigned int>(instancing_model->meshes()[i].index_count()),
+            instancing_model->meshes()[i].index_type(),
+            0,
+            visible_instance_count,
+            base_instance
+        );
+      }
 
-    glDisable(GL_CULL_FACE);
-    glFrontFace(GL_CW);
 
+    }
+    glBindVertexArray(0);
+  });
 
+  if (ssao){
+    // 12 bytes per pixel: the view position is rebuilt from the depth, normals are octahedral encoded
+    const RenderResource g_depth =
+        render_graph_.Create("G-buffer depth", {render_width, render_height, GL_DEPTH_COMPONENT32F});
+    const RenderResource g_normal = render_graph_.Create("G-buffer normal", {render_width, render_height, GL_RG16_SNORM});
+    const RenderResource g_albedo_spec =
+        render_graph_.Create("G-buffer albedo", {render_width, render_height, GL_RGBA8});
+    const RenderResource occlusion = render_graph_.Create("SSAO", {render_width, render_height, GL_R8});
 
+    // -----------------------------------------------------------------
+    render_graph_.AddPass("Geometry", {.colors = {g_normal, g_albedo_spec}, .depth = g_depth}, [&] {
+      glDisable(GL_CULL_FACE);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      geometry_pass_.Use();
+
+
+
+      geometry_pass_.SetBool("invertedNormals", false);
+      geometry_pass_.SetFloat("specularIntensity", kSpecularIntensity);
+      model = glm::mat4(1.0f);
+      //Same visible trees as the forward pass, their matrices come from the instance ring
+      geometry_pass_.SetBool("instanced", true);
+      for (std::size_t i = 0; instancing_ready_ && visible_instance_count != 0 && i < instancing_model->meshes().size();
+           i++) {
+        instancing_model->meshes()[i].BindVertexFormat(geometry_pass_);
+        glBindVertexArray(instancing_model->meshes()[i].VAO());
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, static_cast<GLsizei>(instancing_model->meshes()[i].index_count()),
+                                            instancing_model->meshes()[i].index_type(), nullptr, visible_instance_count,
+                                            base_instance);
+        glBindVertexArray(0);
+      }
+      geometry_pass_.SetBool("instanced", false);
 
-    //draw rock-------------------------------------------------------------------------------------
-    // Rendu du premier modèle (model_) avec normal mapping
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(1.0f, 0.0f, 0.0f));
-    model = glm::scale(model, model_scale_ * glm::vec3(1.0f));
-    glUniformMatrix4fv(glGetUniformLocation(geometry_pass_.id_, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    model_.Draw(shader_model_.id_);
+      glDisable(GL_CULL_FACE);
+      glFrontFace(GL_CW);
 
 
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 25.0f));
-    model = glm::rotate(model, glm::radians(270.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(model_scale_2_));
-    glUniformMatrix4fv(glGetUniformLocation(geometry_pass_.id_, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    model_2_.Draw(shader_model_.id_);
 
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      //draw rock-------------------------------------------------------------------------------------
+      // Rendu du premier modèle (model_) avec normal mapping
+      model = glm::mat4(1.0f);
+      model = glm::translate(model, glm::vec3(1.0f, 0.0f, 0.0f));
+      model = glm::scale(model, model_scale_ * glm::vec3(1.0f));
+      if (baths)
+        baths->Draw(geometry_pass_, model);
 
 
-    // 2. generate SSAO texture
-// ------------------------
-    glBindFramebuffer(GL_FRAMEBUFFER, ssao_fbo_);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glUseProgram(ssao_.id_);
-    // Send kernel + rotation
-    for (unsigned int i = 0; i < kKernelSize; ++i) {
-      std::string path = "samples[" + std::to_string(i) + "]";
-      glUniform3f(glGetUniformLocation(ssao_.id_, path.c_str()), ssao_kernel_[i].x, ssao_kernel_[i].y,
-                  ssao_kernel_[i].z);
-    }
-    glUniformMatrix4fv(glGetUniformLocation(ssao_.id_, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g_position_);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, g_normal_);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, noise_texture_);
-    renderQuad();
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      model = glm::mat4(1.0f);
+      model = glm::translate(model, glm::vec3(0.0f, 0.0f, 25.0f));
+      model = glm::rotate(model, glm::radians(270.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+      model = glm::scale(model, glm::vec3(model_scale_2_));
+      if (tree)
+        tree->Draw(geometry_pass_, model);
+    });
 
 
-    // 3. blur SSAO texture to remove noise
-// ------------------------------------
-    glBindFramebuffer(GL_FRAMEBUFFER, ssao_blur_fbo_);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glUseProgram(ssao_blur_.id_);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ssao_color_buffer_);
-    renderQuad();
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // 2. SSAO texture at the chosen resolution, blurred and brought back to full resolution
+// ------------------------
+    render_graph_.AddPass("Occlusion", {.reads = {g_depth, g_normal}, .colors = {occlusion}}, [&] {
+      ssao_pass_.Render(render_targets_, render_graph_.texture(g_depth), render_graph_.texture(g_normal),
+                        render_graph_.texture(occlusion), render_width, render_height, projection);
+    });
 
 
     // 4. lighting pass: traditional deferred Blinn-Phong lighting with added screen-space ambient occlusion
 // -----------------------------------------------------------------------------------------------------
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(lighting_pass_.id_);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    // send light relevant uniforms
-    glm::vec3 lightPosView = glm::vec3(camera_.view_ * glm::vec4(light_positions_[0], 1.0));
-
-    glUniform3f(glGetUniformLocation(lighting_pass_.id_, "light.Position"), light_positions_[0].x,
-                light_positions_[0].y, light_positions_[0].z);
-    glUniform3f(glGetUniformLocation(lighting_pass_.id_, "light.Color"), light_positions_[0].x,
-                light_positions_[0].y, light_positions_[0].z);
-
-    // Update attenuation parameters
-    const float linear = 0.09f;
-    const float quadratic = 0.032f;
-
-    glUniform1f(glGetUniformLocation(lighting_pass_.id_, "light.Linear"), linear);
-    glUniform1f(glGetUniformLocation(lighting_pass_.id_, "light.Quadratic"), quadratic);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g_position_);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, g_normal_);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, g_albedo_);
-    glActiveTexture(GL_TEXTURE3); // add extra SSAO texture to lighting pass
-    glBindTexture(GL_TEXTURE_2D, ssao_color_buffer_blur_);
-    renderQuad();
+    //Replaces the forward shading in the HDR colors, the HDR depth is kept for the lights and the skybox
+    RenderPassDesc lighting_pass{.reads = {g_depth, g_normal, g_albedo_spec, occlusion},
+                                 .colors = hdr_targets};
+    if (shadows_)
+      lighting_pass.reads.push_back(shadow_map);
+    render_graph_.AddPass("Lighting", std::move(lighting_pass), [&] {
+      glDisable(GL_DEPTH_TEST);
+      //The lighting is done in view space, the camera and the clustered lights come from the shared buffers
+      lighting_pass_.Use();
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, render_graph_.texture(g_depth));
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, render_graph_.texture(g_normal));
+      glActiveTexture(GL_TEXTURE2);
+      glBindTexture(GL_TEXTURE_2D, render_graph_.texture(g_albedo_spec));
+      glActiveTexture(GL_TEXTURE3); // add extra SSAO texture to lighting pass
+      glBindTexture(GL_TEXTURE_2D, render_graph_.texture(occlusion));
+      glActiveTexture(GL_TEXTURE0 + kShadowMapUnit);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map_.texture());
+      renderQuad();
+      glActiveTexture(GL_TEXTURE0);
+      glEnable(GL_DEPTH_TEST);
+    });
     //-------------------------------------------------------------------------------
 
   }
 
   // finally show all the light sources as bright cubes
-  shader_light_.Use();
-  shader_light_.SetMat4("projection", projection);
-  shader_light_.SetMat4("view", view);
+  render_graph_.AddPass("Forward", {.colors = hdr_targets, .depth = hdr_depth}, [&] {
+    shader_light_.Use();
+
+    const UniformHandle light_model = shader_light_.Uniform("model");
+    const UniformHandle light_color = shader_light_.Uniform("lightColor");
+    for (unsigned int i = 0; i < light_positions_.size(); i++)
+    {
+      model = glm::mat4(1.0f);
+      model = glm::translate(model, glm::vec3(light_positions_[i]));
+      model = glm::scale(model, glm::vec3(0.25f));
+      shader_light_.SetMat4(light_model, model);
+      shader_light_.SetVec3(light_color, light_colors_[i]);
+      renderCube();
+    }
+    //Models still streaming in are shown as their bounding box
+    if (!baths)
+    {
+      //own matrix, the wall below is placed from the last light's model
+      const glm::mat4 baths_model = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+      DrawPlaceholder(model_, glm::scale(baths_model, model_scale_ * glm::vec3(1.0f)));
+    }
+    if (!tree)
+      DrawPlaceholder(model_2_, model2);
+    glBindVertexArray(0);
 
-  for (unsigned int i = 0; i < light_positions_.size(); i++)
-  {
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(light_positions_[i]));
-    model = glm::scale(model, glm::vec3(0.25f));
-    shader_light_.SetMat4("model", model);
-    shader_light_.SetVec3("lightColor", light_colors_[i]);
-    renderCube();
-  }
-  glBindVertexArray(0);
-
-
-  if(Normal_state_){
-    glEnable(GL_CULL_FACE);
-    glDisable(GL_CULL_FACE);
-    //-----------------------------------------------------------------------------------------
-    Normal_Map.Use();
-    Normal_Map.SetMat4("projection", projection);
-    Normal_Map.SetMat4("view", view);
-
-    // render wall
-    auto model_4 = glm::mat4(1.0f);
-    model_4 = glm::scale(model, glm::vec3(100.25f));
-    model_4 = glm::translate(model_4, glm::vec3(Normal_x, -0.12, Normal_z));
-    model_4 = glm::rotate(model_4, glm::radians(Normal_Rotation_angle), glm::normalize(glm::vec3(1.0, 0.0, 0.0)));
-    Normal_Map.SetMat4("model", model_4);
-    Normal_Map.SetVec3("viewPos", camera_.camera_position_);
-    Normal_Map.SetVec3("lightPos", light_positions_[0].x, light_positions_[0].y, light_positions_[0].z);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ground_text_);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, ground_text_normal_);
 
-    normal_renderQuad();
-    glEnable(GL_CULL_FACE);
+    if(Normal_state_ && ground_texture && ground_normal_texture){
+      glEnable(GL_CULL_FACE);
+      glDisable(GL_CULL_FACE);
+      //-----------------------------------------------------------------------------------------
+      Normal_Map.Use();
 
-    glDisable(GL_CULL_FACE);
-    //----------------------------------------------------------------------------------------------
+      // render wall
+      auto model_4 = glm::mat4(1.0f);
+      model_4 = glm::scale(model, glm::vec3(100.25f));
+      model_4 = glm::translate(model_4, glm::vec3(Normal_x, -0.12, Normal_z));
+      model_4 = glm::rotate(model_4, glm::radians(Normal_Rotation_angle), glm::normalize(glm::vec3(1.0, 0.0, 0.0)));
+      Normal_Map.SetMat4("model", model_4);
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, ground_texture);
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, ground_normal_texture);
 
-  }
+      normal_renderQuad();
+      glEnable(GL_CULL_FACE);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 1);
+      glDisable(GL_CULL_FACE);
+      //----------------------------------------------------------------------------------------------
 
-  glDepthFunc(GL_LEQUAL); // Ensure skybox is drawn in the background
-  glDepthMask(GL_FALSE);  // Disable depth writing
+    }
+  });
 
+  render_graph_.AddPass("Skybox", {.colors = hdr_targets, .depth = hdr_depth}, [&] {
+    if (!skybox_texture)
+      return;
+    glDepthFunc(GL_LEQUAL); // Ensure skybox is drawn in the background
+    glDepthMask(GL_FALSE);  // Disable depth writing
 
-  skybox_program_.Use();
-  glm::mat4 viewS = glm::mat4(glm::mat3(camera_.view())); // Remove translation
-  //glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)1280 / (float)720, 0.1f, 10000.0f);
-  skybox_program_.SetMat4("view", viewS);
-  skybox_program_.SetMat4("projection", projection);
 
-  glBindVertexArray(skybox_vao_);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture_);
-  glDrawArrays(GL_TRIANGLES, 0, 36);
-  glBindVertexArray(0);
+    skybox_program_.Use();
+
+    glBindVertexArray(skybox_vao_);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glBindVertexArray(0);
 
-  glDepthMask(GL_TRUE);  // Re-enable depth writing
-  glDepthFunc(GL_LESS);  // Restore normal depth function
+    glDepthMask(GL_TRUE);  // Re-enable depth writing
+    glDepthFunc(GL_LESS);  // Restore normal depth function
+  });
 
 
 
 
-  // 2. blur bright fragments with two-pass Gaussian Blur
+  // 2. blur bright fragments through the downsample/upsample chain
   // --------------------------------------------------
-  bool horizontal = true, first_iteration = true;
-  unsigned int amount = 10;
-  shader_blur_.Use();
-  for (unsigned int i = 0; i < amount; i++)
+  //Only with bloom, the bright target doesn't exist otherwise
+  RenderResource bloom = kNoRenderResource;
+  if (bloom_state_)
   {
-    glBindFramebuffer(GL_FRAMEBUFFER, pingpong_fbo_[horizontal]);
-    shader_blur_.SetInt("horizontal", horizontal);
-    glBindTexture(GL_TEXTURE_2D, first_iteration ? color_buffer_[1] : pingpong_color_buffer_[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-    renderQuad();
-    horizontal = !horizontal;
-    if (first_iteration)
-      first_iteration = false;
+    bloom = render_graph_.Create("Bloom", {std::max(1, render_width / 2), std::max(1, render_height / 2),
+                                           GL_R11F_G11F_B10F, GL_LINEAR});
+    render_graph_.AddPass("Bloom", {.reads = {hdr_bright}, .colors = {bloom}}, [&] {
+      bloom_chain_.Render(render_targets_, render_graph_.texture(hdr_bright), render_graph_.texture(bloom),
+                          render_width, render_height);
+    });
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
   // 3. now render floating point color buffer to 2D quad and tonemap HDR colors to default framebuffer's (clamped) color range
   // --------------------------------------------------------------------------------------------------------------------------
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  shader_bloom_final_.Use();
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, color_buffer_[0]);
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, pingpong_color_buffer_[!horizontal]);
-  shader_bloom_final_.SetInt("bloom", bloom_state_);
-  shader_bloom_final_.SetFloat("exposure", exposure_);
-  shader_bloom_final_.SetFloat("gamma", gamma_);
-  renderQuad();
+  RenderPassDesc tonemap{.reads = {hdr_color}, .output = true};
+  if (bloom_state_)
+    tonemap.reads.push_back(bloom);
+  render_graph_.AddPass("Tonemap", std::move(tonemap), [&] {
+    glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer_);
+    glViewport(0, 0, width_, height_);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    shader_bloom_final_.Use();
+    shader_bloom_final_.SetBool("upscale", render_width != width_ || render_height != height_);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, render_graph_.texture(hdr_color));
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, bloom_state_ ? render_graph_.texture(bloom) : 0);
+    shader_bloom_final_.SetInt("bloom", bloom_state_);
+    shader_bloom_final_.SetFloat("exposure", exposure_);
+    shader_bloom_final_.SetFloat("gamma", gamma_);
+    renderQuad();
+  });
+
+  gpu_profiler_.BeginFrame();
+  geometry_arena_.BeginFrame();
+  render_graph_.Execute(render_targets_, &gpu_profiler_);
+  geometry_arena_.EndFrame();
+  gpu_profiler_.EndFrame();
+
+  if (instancing_ready_)
+    instancing_ring_.EndRegion();
+  render_targets_.EndFrame();
+
 
 
+}
+
+float Scene3D::GpuFrameTimeMs() const
+{
+  const auto zones = gpu_profiler_.results();
+  return zones.empty() ? 0.0f : zones.front().duration_ms;
+}
 
+void Scene3D::OnResize(int width, int height)
+{
+  //The targets of the old size are dropped by the pool once they stay unused
+  width_ = std::max(width, 1);
+  height_ = std::max(height, 1);
 }
 
 void Scene3D::OnEvent(const SDL_Event& event)
@@ -901,10 +978,17 @@ void Scene3D::DrawImGui()
   ImGui::Checkbox("Enable bloom", &bloom_state_);
   ImGui::Checkbox("Enable Normal", &Normal_state_);
   ImGui::Checkbox("Enable ssao", &ssao);
+  ssao_pass_.DrawImGui();
 
   ImGui::SliderFloat("Exposure", &exposure_, 0.01f, 10.0f, "%.1f");
   ImGui::SliderFloat("gamma", &gamma_, 0.01f, 10.0f, "%.1f");
 
+  gpu_profiler_.DrawImGui();
+  geometry_arena_.DrawImGui();
+  render_targets_.DrawImGui();
+  render_graph_.DrawImGui();
+  light_clusters_.DrawImGui();
+
 
   if (ImGui::CollapsingHeader("Normal Settings")) {
     ImGui::SliderFloat("Normal_X", &Normal_x, -30.01f, 30.0f, "%.1f");
@@ -915,7 +999,15 @@ void Scene3D::DrawImGui()
   // static ImVec4 LightColour = ImVec4(1.0f, 1.0f, 1.0f, 1.0f); // Default color
 
 
+  if (ImGui::CollapsingHeader("Sun")) {
+    ImGui::Checkbox("Shadows", &shadows_);
+    ImGui::DragFloat3("Sun direction", glm::value_ptr(sun_direction_), 0.01f, -1.0f, 1.0f);
+    ImGui::ColorPicker3("Sun colour", glm::value_ptr(sun_color_));
+  }
+  shadow_map_.DrawImGui();
+
   if (ImGui::CollapsingHeader("light Settings")) {
+    ImGui::SliderInt("Scattered lights", &scattered_light_count_, 0, kScatteredLightCount);
     if (ImGui::CollapsingHeader("light 1")) {
       ImGui::DragFloat3("Light Position 0", glm::value_ptr(lightPos0), 0.1f);
       ImGui::ColorPicker3("Light Colour", reinterpret_cast<float *>(&lightColor0));
@@ -943,6 +1035,12 @@ int main(int argc, char* argv[])
 {
   gpr5300::Scene3D scene;
   gpr5300::Engine engine(&scene);
+
+  gpr5300::HeadlessSettings headless;
+  if (gpr5300::ParseHeadlessArguments(argc, argv, headless))
+  {
+    return engine.RunHeadless(headless) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
   engine.Run();
 
   return EXIT_SUCCESS;
@@ -17,6 +17,7 @@
 #include "scene3d.h"
 #include "shader.h"
 #include "texture_loader.h"
+#include "uniform_buffer.h"
 
 namespace gpr5300
 {
@@ -58,6 +59,7 @@ class Scene3D final : public Scene
 
   //model
   Shader shader_model_ = {};
+  UniformBuffer<FrameData> frame_data_buffer_;
   Model model_;
   Model model_2_;
 
@@ -123,6 +125,7 @@ void Scene3D::Begin()
   shader_bloom_final_ = Shader("data/shaders/bloom/bloom_final.vert", "data/shaders/bloom/bloom_final.frag");
   shader_model_ = Shader("data/shaders/scene3d/model.vert", "data/shaders/scene3d/model.frag");
   skybox_program_ = Shader("data/shaders/scene3d/cubemaps.vert", "data/shaders/scene3d/cubemaps.frag");
+  frame_data_buffer_.Create(kFrameDataBinding);
 
 
   model_ = Model("data/roman_baths/scene.gltf");
@@ -131,7 +134,7 @@ void Scene3D::Begin()
   Instancing_Model_ = Model("data/tree/scene.gltf");
 
   ground_text_ = TextureFromFile("brickwall.jpg", "data/textures");
-  ground_text_normal_ = TextureFromFile("brickwall_normal.jpg", "data/textures");
+  ground_text_normal_ = TextureFromFile("brickwall_normal.jpg", "data/textures", false, gpr5300::TextureRole::kNormal);
 
 
   //Configure FBO
@@ -348,6 +351,7 @@ void Scene3D::End()
   shader_bloom_final_.Delete();
   skybox_program_.Delete();
   Instancing_shader_.Delete();
+  frame_data_buffer_.Delete();
   delete[] modelMatrices;
   modelMatrices = nullptr;
 
@@ -377,18 +381,19 @@ void Scene3D::Update(const float dt) {
   //auto projection = glm::perspective(glm::radians(45.0f), (float)1280 / (float)720, 0.1f, 10000.0f);
   //auto view = camera_.view();
 
-  shader_model_.SetMat4("projection", projection);
-  shader_model_.SetMat4("view", view);
-
-  frustum_.CreateFrustumFromCamera(camera_, aspect, fovY, zNear, zFar);
-  glm::mat4 projView = projection * camera_.GetViewMatrix();
-  frustum_.Update(projView);
-
-  shader_model_.SetVec3Array("lightPos", light_positions_, light_positions_.size());
-  shader_model_.SetVec3Array("lightColor", light_colors_, light_colors_.size());
+  //Camera and lights are uploaded once here, every program reads them from the FrameData block
+  FrameData frame_data{};
+  frame_data.projection = projection;
+  frame_data.view = view;
+  frame_data.view_pos = glm::vec4(camera_.camera_position_, 1.0f);
+  for (std::size_t i = 0; i < light_positions_.size() && i < kMaxLights; i++)
+  {
+    frame_data.light_positions[i] = glm::vec4(light_positions_[i], 1.0f);
+    frame_data.light_colors[i] = glm::vec4(light_colors_[i], 1.0f);
+  }
+  frame_data_buffer_.Update(frame_data);
 
-  const glm::vec3 view_pos = camera_.camera_position_;
-  shader_model_.SetVec3("viewPos", glm::vec3(view_pos.x, view_pos.y, view_pos.z));
+  frustum_.Update(projection * view);
 
   //Draw model
   //auto model = glm::mat4(1.0f);
@@ -398,8 +403,11 @@ void Scene3D::Update(const float dt) {
   shader_model_.SetMat4("model", model);
 
 
-  if (frustum_.IsObjectInFrustum(model_)) {
-    model_.Draw(shader_model_.id_);
+  //Whole model first, then each mesh on its own
+  if (frustum_.IsObjectInFrustum(model_, model)) {
+    model_.Draw(shader_model_, [this, &model](const Mesh& mesh) {
+      return frustum_.IsMeshInFrustum(mesh, model);
+    });
   }
 
   glm::mat4 model2 = glm::mat4(1.0f);
@@ -407,12 +415,10 @@ void Scene3D::Update(const float dt) {
   model2 = glm::rotate(model2, glm::radians(270.0f), glm::vec3(1.0f, 0.0f, 0.0f));
   model2 = glm::scale(model2, glm::vec3(model_scale_2_));
   shader_model_.SetMat4("model", model2);
-  model_2_.Draw(shader_model_.id_);
+  model_2_.Draw(shader_model_);
   glBindVertexArray(0);
 
   Instancing_shader_.Use();
-  Instancing_shader_.SetMat4("projection", projection);
-  Instancing_shader_.SetMat4("view", camera_.view());
   Instancing_shader_.SetMat4("model", model2);
   Instancing_shader_.Use();
   Instancing_shader_.SetInt("texture_diffuse1", 0);
@@ -424,12 +430,13 @@ void Scene3D::Update(const float dt) {
     } else {
       std::cerr << "Erreur : Aucune texture chargée  !" << std::endl;
     }
+    Instancing_Model_.meshes()[i].BindVertexFormat(Instancing_shader_);
     glBindVertexArray(Instancing_Model_.meshes()[i].VAO());
-    if (!Instancing_Model_.meshes()[i].indices_.empty()) {
+    if (Instancing_Model_.meshes()[i].index_count() != 0) {
       glDrawElementsInstanced(
           GL_TRIANGLES,
-          static_cast<unsigned int>(Instancing_Model_.meshes()[i].indices_.size()),
-          GL_UNSIGNED_INT,
+          static_cast<unsigned int>(Instancing_Model_.meshes()[i].index_count()),
+          Instancing_Model_.meshes()[i].index_type(),
           0,
           Instancing_amout
       );
@@ -443,8 +450,6 @@ void Scene3D::Update(const float dt) {
 
   // finally show all the light sources as bright cubes
   shader_light_.Use();
-  shader_light_.SetMat4("projection", projection);
-  shader_light_.SetMat4("view", view);
 
   for (unsigned int i = 0; i < light_positions_.size(); i++)
   {
@@ -462,8 +467,6 @@ void Scene3D::Update(const float dt) {
 
     //-----------------------------------------------------------------------------------------
     Normal_Map.Use();
-    Normal_Map.SetMat4("projection", projection);
-    Normal_Map.SetMat4("view", view);
 
     // render wall
     auto model_4 = glm::mat4(1.0f);
@@ -471,8 +474,6 @@ void Scene3D::Update(const float dt) {
     model_4 = glm::translate(model_4, glm::vec3(Normal_x, Normal_y, Normal_z));
     model_4 = glm::rotate(model_4, glm::radians(Normal_Rotation_angle), glm::normalize(glm::vec3(1.0, 0.0, 0.0)));
     Normal_Map.SetMat4("model", model_4);
-    Normal_Map.SetVec3("viewPos", camera_.camera_position_);
-    Normal_Map.SetVec3("lightPos", light_positions_[0].x, light_positions_[0].y, light_positions_[0].z);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, ground_text_);
     glActiveTexture(GL_TEXTURE1);
@@ -492,10 +493,6 @@ void Scene3D::Update(const float dt) {
 
 
   skybox_program_.Use();
-  glm::mat4 viewS = glm::mat4(glm::mat3(camera_.view())); // Remove translation
-  //glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)1280 / (float)720, 0.1f, 10000.0f);
-  skybox_program_.SetMat4("view", viewS);
-  skybox_program_.SetMat4("projection", projection);
 
   glBindVertexArray(skybox_vao_);
   glActiveTexture(GL_TEXTURE0);
@@ -0,0 +1,131 @@
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "texture_compression.h"
+#include "texture_loader.h"
+
+//Loads a black and white checkerboard the way Model::LoadTexture does, cold and then from its KTX2 cache, and checks
+//the albedo mips are averaged in linear light (half the light is sRGB 188, not 128) whatever the gamma argument,
+//while normals are averaged as stored. Before the cached load the source is overwritten with the same size and write
+//time, a warm load must not read it.
+
+namespace
+{
+constexpr int kImageSize = 16;
+constexpr int kLinearHalf = 188;
+constexpr int kTolerance = 2;
+
+std::vector<std::uint8_t> Checkerboard()
+{
+  std::vector<std::uint8_t> pixels(static_cast<std::size_t>(kImageSize) * kImageSize * 3);
+  for (int y = 0; y < kImageSize; y++)
+    for (int x = 0; x < kImageSize; x++)
+      for (int c = 0; c < 3; c++)
+        pixels[(static_cast<std::size_t>(y) * kImageSize + x) * 3 + c] = (x + y) % 2 == 0 ? 0 : 255;
+  return pixels;
+}
+
+//Binary PPM, lossless and read by stb_image
+bool WritePpm(const std::filesystem::path& path, const std::vector<std::uint8_t>& pixels)
+{
+  std::ofstream file(path, std::ios::binary);
+  file << "P6\n" << kImageSize << ' ' << kImageSize << "\n255\n";
+  file.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+  return static_cast<bool>(file);
+}
+
+std::uint32_t Bits(const std::uint8_t* block, int first, int count)
+{
+  std::uint32_t value = 0;
+  for (int i = 0; i < count; i++)
+    value |= static_cast<std::uint32_t>(block[(first + i) / 8] >> ((first + i) % 8) & 1) << i;
+  return value;
+}
+
+//Red of the first texel of a BC7 mode 6 block, the only mode EncodeBc7Block writes
+int Bc7FirstRed(const std::uint8_t* block)
+{
+  constexpr std::array<int, 16> kWeights = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+  const int red0 = static_cast<int>(Bits(block, 7, 7) << 1 | Bits(block, 63, 1));
+  const int red1 = static_cast<int>(Bits(block, 14, 7) << 1 | Bits(block, 64, 1));
+  const int weight = kWeights[Bits(block, 65, 3)];
+  return ((64 - weight) * red0 + weight * red1 + 32) >> 6;
+}
+
+bool CheckAlbedo(const std::string& path, bool gamma, const char* load)
+{
+  const gpr5300::CompressedTexture texture = LoadCompressedTexture(path.c_str(), gpr5300::TextureRole::kAlbedo, gamma);
+  if (texture.format != gpr5300::BlockFormat::kBc7 || texture.srgb != gamma || texture.levels.size() < 2)
+  {
+    std::cerr << "Albedo, " << load << ": unexpected format or mip count\n";
+    return false;
+  }
+  const int red = Bc7FirstRed(texture.data.data() + texture.levels[1].offset);
+  std::cout << "Albedo (gamma " << gamma << "), " << load << ": first mip is " << red << '\n';
+  if (std::abs(red - kLinearHalf) > kTolerance)
+  {
+    std::cerr << "Albedo, " << load << ": the first mip is " << red << ", expected " << kLinearHalf
+              << " from a linear light average\n";
+    return false;
+  }
+  return true;
+}
+}
+
+int main()
+{
+  std::random_device device;
+  const std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / ("texture_loader_test_" + std::to_string(device()));
+  std::filesystem::create_directories(directory);
+
+  bool ok = true;
+  const std::vector<std::uint8_t> pixels = Checkerboard();
+  for (const bool gamma : {false, true})
+  {
+    //One source per gamma: the caches of both live next to it with the same block format
+    const std::string path = (directory / (gamma ? "albedo_srgb.ppm" : "albedo.ppm")).string();
+    if (!WritePpm(path, pixels))
+    {
+      std::cerr << "Could not write " << path << '\n';
+      ok = false;
+      break;
+    }
+    ok &= CheckAlbedo(path, gamma, "cold");
+    const std::filesystem::file_time_type write_time = std::filesystem::last_write_time(path);
+    if (!WritePpm(path, std::vector<std::uint8_t>(pixels.size(), 0)))
+    {
+      std::cerr << "Could not overwrite " << path << '\n';
+      ok = false;
+      break;
+    }
+    std::filesystem::last_write_time(path, write_time);
+    ok &= CheckAlbedo(path, gamma, "cached");
+  }
+
+  //Normals are not color, their mips are the plain average of what is stored
+  const std::string normal_path = (directory / "normal.ppm").string();
+  if (ok && WritePpm(normal_path, pixels))
+  {
+    const gpr5300::CompressedTexture normal = LoadCompressedTexture(normal_path.c_str(),
+                                                                    gpr5300::TextureRole::kNormal);
+    const gpr5300::CompressedTexture expected = gpr5300::CompressImage(
+        pixels.data(), kImageSize, kImageSize, 3, gpr5300::BlockFormat::kBc5, false, false);
+    if (normal.data != expected.data || normal.srgb)
+    {
+      std::cerr << "Normals were not filtered as stored\n";
+      ok = false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::remove_all(directory, error);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#include "bloom_chain.h"
+
+#include <algorithm>
+
+void BloomChain::Create()
+{
+  downsample_ = Shader("data/shaders/fullscreen.vert", "data/shaders/bloom/downsample.frag");
+  upsample_ = Shader("data/shaders/fullscreen.vert", "data/shaders/bloom/upsample.frag");
+  downsample_.Use();
+  downsample_.SetInt("source", 0);
+  upsample_.Use();
+  upsample_.SetInt("source", 0);
+
+  //The fullscreen triangle is generated from gl_VertexID, the core profile still wants a VAO bound
+  glGenVertexArrays(1, &vao_);
+}
+
+void BloomChain::Delete()
+{
+  levels_.clear();
+  glDeleteVertexArrays(1, &vao_);
+  vao_ = 0;
+  downsample_.Delete();
+  upsample_.Delete();
+}
+
+void BloomChain::Render(RenderTargetPool& pool, GLuint bright_texture, GLuint output, int width, int height,
+                        float filter_radius)
+{
+  //11/11/10 float: half the bandwidth of RGBA16F, bloom has no use for alpha nor for the extra precision
+  levels_.clear();
+  int level_width = width / 2;
+  int level_height = height / 2;
+  while (static_cast<int>(levels_.size()) < kMaxLevels && std::min(level_width, level_height) >= kMinLevelSize)
+  {
+    const RenderTargetDesc desc{level_width, level_height, GL_R11F_G11F_B10F, GL_LINEAR};
+    levels_.push_back({levels_.empty() ? output : pool.Acquire(desc), level_width, level_height});
+    level_width /= 2;
+    level_height /= 2;
+  }
+  if (levels_.empty())
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({output}));
+    glClear(GL_COLOR_BUFFER_BIT);
+    return;
+  }
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glBindVertexArray(vao_);
+  glActiveTexture(GL_TEXTURE0);
+
+  //Down: each level filters the one above, the first one reads the full resolution bright pixels
+  downsample_.Use();
+  GLuint source = bright_texture;
+  for (const Level& level : levels_)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({level.texture}));
+    glViewport(0, 0, level.width, level.height);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    source = level.texture;
+  }
+
+  //Up: every level gets the blurred smaller one added on top
+  upsample_.Use();
+  upsample_.SetFloat("filterRadius", filter_radius);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  glBlendEquation(GL_FUNC_ADD);
+  for (std::size_t i = levels_.size() - 1; i > 0; i--)
+  {
+    const Level& target = levels_[i - 1];
+    //The last pass averages the accumulated levels, the bloom keeps the brightness the old blur had
+    if (i == 1)
+    {
+      const float weight = 1.0f / static_cast<float>(levels_.size());
+      glBlendColor(0.0f, 0.0f, 0.0f, weight);
+      glBlendFunc(GL_CONSTANT_ALPHA, GL_CONSTANT_ALPHA);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({target.texture}));
+    glViewport(0, 0, target.width, target.height);
+    glBindTexture(GL_TEXTURE_2D, levels_[i].texture);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    //Read for the last time, the next pass may take it over
+    pool.Release(levels_[i].texture);
+  }
+  glDisable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ZERO);
+
+  glBindVertexArray(0);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
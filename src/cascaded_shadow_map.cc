@@ -0,0 +1,126 @@
+#include "cascaded_shadow_map.h"
+
+#include <cmath>
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <imgui.h>
+
+void CascadedShadowMap::Create(int resolution)
+{
+  resolution_ = resolution;
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture_);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, resolution, resolution, kShadowCascades);
+  //Comparison sampling: every fetch is filtered over 2x2 texels by the hardware
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  //Outside of the map nothing is in shadow
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  constexpr float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  glGenFramebuffers(1, &framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture_, 0, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "Shadow map framebuffer not complete!\n";
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CascadedShadowMap::Delete()
+{
+  glDeleteFramebuffers(1, &framebuffer_);
+  glDeleteTextures(1, &texture_);
+  framebuffer_ = 0;
+  texture_ = 0;
+}
+
+void CascadedShadowMap::Update(const glm::mat4& view, float fov_y, float aspect, float z_near, float z_far,
+                               const glm::vec3& light_direction)
+{
+  const glm::mat4 inverse_view = glm::inverse(view);
+  const glm::vec3 direction = glm::normalize(light_direction);
+  const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  //Squared distance of the slice corners to the view axis, per unit of depth
+  const float tan_half_fov = std::tan(fov_y * 0.5f);
+  const float corner_slope2 = tan_half_fov * tan_half_fov * (1.0f + aspect * aspect);
+
+  float slice_near = z_near;
+  for (int cascade = 0; cascade < kShadowCascades; cascade++)
+  {
+    //Practical split scheme: a blend of the even and the logarithmic splits
+    const float fraction = static_cast<float>(cascade + 1) / kShadowCascades;
+    const float even_split = z_near + (z_far - z_near) * fraction;
+    const float log_split = z_near * std::pow(z_far / z_near, fraction);
+    const float slice_far = even_split + (log_split - even_split) * split_lambda_;
+
+    //Smallest sphere around the slice: on the view axis, as far from the near corners as from the far ones
+    float center_depth = (slice_near + slice_far) * (1.0f + corner_slope2) * 0.5f;
+    float radius;
+    if (center_depth >= slice_far)
+    {
+      center_depth = slice_far;
+      radius = slice_far * std::sqrt(corner_slope2);
+    }
+    else
+    {
+      const float offset = center_depth - slice_near;
+      radius = std::sqrt(offset * offset + slice_near * slice_near * corner_slope2);
+    }
+    //Rounded up so float noise doesn't change the texel size from one frame to the next
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+    const glm::vec3 center = glm::vec3(inverse_view * glm::vec4(0.0f, 0.0f, -center_depth, 1.0f));
+
+    const glm::mat4 light_view = glm::lookAt(center - direction * (radius + kCasterDistance), center, up);
+    glm::mat4 light_projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + kCasterDistance);
+    //Moves the cascade by less than a texel so the world origin lands on a texel corner
+    const glm::vec4 origin = light_projection * light_view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    const glm::vec2 origin_texels = glm::vec2(origin) * (static_cast<float>(resolution_) * 0.5f);
+    const glm::vec2 snap = (glm::round(origin_texels) - origin_texels) * (2.0f / static_cast<float>(resolution_));
+    light_projection[3][0] += snap.x;
+    light_projection[3][1] += snap.y;
+
+    light_space_matrices_[cascade] = light_projection * light_view;
+    frustums_[cascade].Update(light_space_matrices_[cascade]);
+    splits_[cascade] = slice_far;
+    texel_sizes_[cascade] = 2.0f * radius / static_cast<float>(resolution_);
+    slice_near = slice_far;
+  }
+}
+
+void CascadedShadowMap::BeginCascade(int cascade) const
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture_, 0, cascade);
+  glViewport(0, 0, resolution_, resolution_);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void CascadedShadowMap::Fill(FrameData& frame_data) const
+{
+  for (int cascade = 0; cascade < kShadowCascades; cascade++)
+  {
+    frame_data.light_space_matrices[cascade] = light_space_matrices_[cascade];
+    frame_data.cascade_splits[cascade] = splits_[cascade];
+    frame_data.cascade_texel_sizes[cascade] = texel_sizes_[cascade];
+  }
+}
+
+void CascadedShadowMap::DrawImGui()
+{
+  if (!ImGui::CollapsingHeader("Shadow cascades"))
+    return;
+  ImGui::SliderFloat("Split lambda", &split_lambda_, 0.0f, 1.0f, "%.2f");
+  for (int cascade = 0; cascade < kShadowCascades; cascade++)
+  {
+    ImGui::Text("Cascade %d: up to %.1f, texel %.3f", cascade, splits_[cascade], texel_sizes_[cascade]);
+  }
+}
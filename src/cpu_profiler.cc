@@ -0,0 +1,135 @@
+#include "cpu_profiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+namespace gpr5300
+{
+
+namespace
+{
+constexpr std::size_t kUnregisteredThread = std::numeric_limits<std::size_t>::max();
+thread_local std::size_t cpu_profiler_thread = kUnregisteredThread;
+thread_local CpuEventRing* cpu_profiler_ring = nullptr;
+}
+
+std::uint64_t CpuProfiler::Now()
+{
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void CpuProfiler::BeginCapture()
+{
+  std::scoped_lock lock(mutex_);
+  //Whatever the rings still hold predates the capture
+  for (ThreadEntry& thread : threads_)
+  {
+    thread.ring->Drain([](const CpuZoneEvent&) {});
+  }
+  events_.clear();
+  dropped_ = 0;
+  capture_start_ns_ = Now();
+  capturing_.store(true, std::memory_order_relaxed);
+}
+
+void CpuProfiler::EndCapture()
+{
+  capturing_.store(false, std::memory_order_relaxed);
+  Collect();
+  if (dropped_ > 0)
+  {
+    std::cerr << "CPU profiler dropped " << dropped_ << " zones, collect more often\n";
+  }
+}
+
+void CpuProfiler::Record(const char* name, std::uint64_t begin_ns, std::uint64_t end_ns)
+{
+  if (!capturing())
+    return;
+  if (!ThreadRing().Push({name, begin_ns, end_ns}))
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CpuProfiler::Collect()
+{
+  std::scoped_lock lock(mutex_);
+  for (std::size_t i = 0; i < threads_.size(); i++)
+  {
+    threads_[i].ring->Drain([this, i](const CpuZoneEvent& zone) {
+      //Zones opened before the capture started are cut, not shown with a bogus start
+      if (zone.begin_ns >= capture_start_ns_)
+        events_.push_back({zone, i});
+    });
+  }
+}
+
+void CpuProfiler::SetThreadName(std::string_view name)
+{
+  std::scoped_lock lock(mutex_);
+  threads_[ThreadIndex()].name = name;
+}
+
+CpuEventRing& CpuProfiler::ThreadRing()
+{
+  //Only the first zone of a thread takes the lock
+  if (cpu_profiler_ring == nullptr)
+  {
+    std::scoped_lock lock(mutex_);
+    ThreadIndex();
+  }
+  return *cpu_profiler_ring;
+}
+
+std::size_t CpuProfiler::ThreadIndex()
+{
+  if (cpu_profiler_thread == kUnregisteredThread)
+  {
+    cpu_profiler_thread = threads_.size();
+    threads_.emplace_back();
+    cpu_profiler_ring = threads_.back().ring.get();
+  }
+  return cpu_profiler_thread;
+}
+
+bool CpuProfiler::WriteChromeTrace(std::string_view path) const
+{
+  std::scoped_lock lock(mutex_);
+  std::ofstream out{std::string(path)};
+  if (!out)
+  {
+    std::cerr << "Could not write " << path << "\n";
+    return false;
+  }
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+  bool first = true;
+  for (std::size_t i = 0; i < threads_.size(); i++)
+  {
+    const std::string name = threads_[i].name.empty() ? "Thread " + std::to_string(i) : threads_[i].name;
+    out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+        << ",\"args\":{\"name\":\"" << name << "\"}}";
+    first = false;
+  }
+  for (const CollectedEvent& event : events_)
+  {
+    const double begin_us = static_cast<double>(event.zone.begin_ns - capture_start_ns_) * 1e-3;
+    const double duration_us = static_cast<double>(event.zone.end_ns - event.zone.begin_ns) * 1e-3;
+    out << (first ? "" : ",\n") << "{\"name\":\"" << event.zone.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0"
+        << ",\"tid\":" << event.thread << ",\"ts\":" << begin_us << ",\"dur\":" << duration_us << "}";
+    first = false;
+  }
+  out << "\n]}\n";
+  std::cout << "CPU trace written to " << path << " (" << events_.size() << " zones)\n";
+  return static_cast<bool>(out);
+}
+
+CpuProfiler& GlobalCpuProfiler()
+{
+  static CpuProfiler profiler;
+  return profiler;
+}
+
+} // namespace gpr5300
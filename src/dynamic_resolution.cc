@@ -0,0 +1,62 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <imgui.h>
+
+namespace gpr5300
+{
+
+float DynamicResolution::Update(float gpu_frame_ms)
+{
+  if (!settings_.enabled || gpu_frame_ms <= 0.0f)
+  {
+    if (!settings_.enabled)
+    {
+      scale_ = 1.0f;
+      smoothed_ms_ = 0.0f;
+    }
+    return scale_;
+  }
+
+  smoothed_ms_ = smoothed_ms_ > 0.0f ? smoothed_ms_ + (gpu_frame_ms - smoothed_ms_) * kSmoothing : gpu_frame_ms;
+  frames_since_change_++;
+  if (frames_since_change_ < settings_.cooldown_frames)
+    return scale_;
+
+  float wanted = scale_;
+  if (smoothed_ms_ > settings_.target_ms)
+  {
+    wanted = scale_ * std::sqrt(settings_.target_ms / smoothed_ms_);
+    wanted = std::floor(wanted / kScaleStep) * kScaleStep;
+  }
+  else if (smoothed_ms_ < settings_.target_ms * settings_.headroom)
+  {
+    //Up one step at a time, a frame that got cheap by chance costs little
+    wanted = scale_ + kScaleStep;
+  }
+  wanted = std::clamp(wanted, settings_.min_scale, settings_.max_scale);
+  if (std::abs(wanted - scale_) >= kScaleStep * 0.5f)
+  {
+    scale_ = wanted;
+    frames_since_change_ = 0;
+  }
+  return scale_;
+}
+
+void DynamicResolution::DrawImGui()
+{
+  ImGui::Begin("Dynamic resolution");
+  ImGui::Checkbox("Enabled", &settings_.enabled);
+  ImGui::Text("Scale %.0f%%, GPU %.2f ms", scale_ * 100.0f, smoothed_ms_);
+  ImGui::SliderFloat("Target (ms)", &settings_.target_ms, 4.0f, 50.0f, "%.1f");
+  ImGui::SliderFloat("Min scale", &settings_.min_scale, 0.25f, 1.0f, "%.2f");
+  ImGui::SliderFloat("Max scale", &settings_.max_scale, 0.25f, 1.0f, "%.2f");
+  settings_.min_scale = std::min(settings_.min_scale, settings_.max_scale);
+  ImGui::SliderFloat("Headroom", &settings_.headroom, 0.5f, 1.0f, "%.2f");
+  ImGui::SliderInt("Cooldown (frames)", &settings_.cooldown_frames, 1, 120);
+  ImGui::End();
+}
+
+} // namespace gpr5300
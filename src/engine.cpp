@@ -5,12 +5,116 @@
 #include <imgui.h>
 #include <imgui_impl_sdl2.h>
 #include <imgui_impl_opengl3.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string_view>
+#include <vector>
+
+#include "cpu_profiler.h"
+#include "headless_context.h"
 
 namespace gpr5300
 {
+    namespace
+    {
+        constexpr const char* kCpuTracePath = "cpu_profile.json";
+
+        //Nearest rank on sorted frame times
+        float FrameTimePercentile(const std::vector<float>& sorted_ms, float percentile)
+        {
+            const auto rank = static_cast<std::size_t>(std::ceil(percentile * static_cast<float>(sorted_ms.size())));
+            return sorted_ms[std::clamp<std::size_t>(rank, 1, sorted_ms.size()) - 1];
+        }
+
+        void ReportFrameTimes(std::vector<float> frame_ms, const std::string& stats_path)
+        {
+            std::sort(frame_ms.begin(), frame_ms.end());
+            const float mean = std::accumulate(frame_ms.begin(), frame_ms.end(), 0.0f) / static_cast<float>(frame_ms.size());
+            const float median = FrameTimePercentile(frame_ms, 0.5f);
+            const float p95 = FrameTimePercentile(frame_ms, 0.95f);
+            const float p99 = FrameTimePercentile(frame_ms, 0.99f);
+
+            std::cout << "Frames: " << frame_ms.size() << "\n"
+                      << "Frame time (ms): min " << frame_ms.front() << " mean " << mean << " median " << median
+                      << " p95 " << p95 << " p99 " << p99 << " max " << frame_ms.back() << "\n";
+
+            if (stats_path.empty())
+                return;
+            std::ofstream stats(stats_path);
+            if (!stats)
+            {
+                std::cerr << "Could not write " << stats_path << "\n";
+                return;
+            }
+            stats << "frames,min_ms,mean_ms,median_ms,p95_ms,p99_ms,max_ms\n"
+                  << frame_ms.size() << "," << frame_ms.front() << "," << mean << "," << median << ","
+                  << p95 << "," << p99 << "," << frame_ms.back() << "\n";
+        }
+
+        void WriteFramebufferImage(GLuint framebuffer, int width, int height, const std::string& path)
+        {
+            std::vector<unsigned char> pixels(static_cast<std::size_t>(width) * height * 4);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            //GL rows start at the bottom
+            stbi_flip_vertically_on_write(1);
+            if (!stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width * 4))
+            {
+                std::cerr << "Could not write " << path << "\n";
+            }
+        }
+    }
+
+    bool ParseHeadlessArguments(int argc, char* argv[], HeadlessSettings& settings)
+    {
+        bool headless = false;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string_view argument = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (argument == "--headless")
+            {
+                headless = true;
+            }
+            else if (argument == "--frames" && has_value)
+            {
+                settings.frame_count = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (argument == "--size" && has_value)
+            {
+                int width = 0, height = 0;
+                if (std::sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+                {
+                    settings.width = width;
+                    settings.height = height;
+                }
+            }
+            else if (argument == "--image" && has_value)
+            {
+                settings.image_path = argv[++i];
+            }
+            else if (argument == "--stats" && has_value)
+            {
+                settings.stats_path = argv[++i];
+            }
+            else if (argument == "--trace" && has_value)
+            {
+                settings.trace_path = argv[++i];
+            }
+        }
+        return headless;
+    }
     Engine::Engine(Scene* scene) : scene_(scene)
     {
     }
@@ -18,90 +122,250 @@ namespace gpr5300
     void Engine::Run()
     {
         Begin();
+        CpuProfiler& profiler = GlobalCpuProfiler();
+        profiler.SetThreadName("Main");
         bool isOpen = true;
 
-        std::chrono::time_point<std::chrono::system_clock> clock = std::chrono::system_clock::now();
+        std::chrono::time_point<std::chrono::steady_clock> clock = std::chrono::steady_clock::now();
         while (isOpen)
         {
-            const auto start = std::chrono::system_clock::now();
+            CpuZone frame_zone("Frame");
+            const auto start = std::chrono::steady_clock::now();
             using seconds = std::chrono::duration<float, std::ratio<1, 1>>;
             const auto dt = std::chrono::duration_cast<seconds>(start - clock);
             clock = start;
 
             //Manage SDL event
-            SDL_Event event;
-            while (SDL_PollEvent(&event))
             {
-                switch (event.type)
+                CpuZone events_zone("Events");
+                SDL_Event event;
+                while (SDL_PollEvent(&event))
                 {
-                case SDL_QUIT:
-                    isOpen = false;
-                    break;
-                case SDL_WINDOWEVENT:
+                    switch (event.type)
                     {
-                        switch (event.window.event)
+                    case SDL_QUIT:
+                        isOpen = false;
+                        break;
+                    case SDL_WINDOWEVENT:
                         {
-                        case SDL_WINDOWEVENT_CLOSE:
-                            isOpen = false;
-                            break;
-                        case SDL_WINDOWEVENT_RESIZED:
+                            switch (event.window.event)
                             {
-                                glm::uvec2 newWindowSize;
-                                newWindowSize.x = event.window.data1;
-                                newWindowSize.y = event.window.data2;
-                                //TODO do something with the new size
+                            case SDL_WINDOWEVENT_CLOSE:
+                                isOpen = false;
+                                break;
+                            case SDL_WINDOWEVENT_SIZE_CHANGED:
+                                {
+                                    //Pixels rather than the window size from the event, they differ on high DPI screens
+                                    glm::ivec2 newWindowSize;
+                                    SDL_GL_GetDrawableSize(window_, &newWindowSize.x, &newWindowSize.y);
+                                    glViewport(0, 0, newWindowSize.x, newWindowSize.y);
+                                    scene_->OnResize(newWindowSize.x, newWindowSize.y);
+                                    break;
+                                }
+                            default:
                                 break;
                             }
-                        default:
                             break;
                         }
+                    case SDL_KEYDOWN:
+                        if (event.key.keysym.sym == SDLK_ESCAPE)
+                        {
+                            isOpen = false;
+                        }
+                        //F9 starts a CPU capture, the second press writes it
+                        if (event.key.keysym.sym == SDLK_F9)
+                        {
+                            if (profiler.capturing())
+                            {
+                                profiler.EndCapture();
+                                profiler.WriteChromeTrace(kCpuTracePath);
+                            }
+                            else
+                            {
+                                profiler.BeginCapture();
+                            }
+                        }
                         break;
-                    }
-                case SDL_KEYDOWN:
-                    if (event.key.keysym.sym == SDLK_ESCAPE)
-                    {
-                        isOpen = false;
-                    }
-                    break;
-                case SDL_MOUSEBUTTONDOWN:
-                    if (event.button.button == SDL_BUTTON_LEFT)
-                    {
-                        SDL_ShowCursor(SDL_DISABLE);
-                        SDL_SetRelativeMouseMode(SDL_TRUE);
-                    }
-                    break;
-                    case SDL_MOUSEBUTTONUP:
+                    case SDL_MOUSEBUTTONDOWN:
                         if (event.button.button == SDL_BUTTON_LEFT)
                         {
-                            SDL_ShowCursor(SDL_ENABLE);
-                            SDL_SetRelativeMouseMode(SDL_FALSE);
+                            SDL_ShowCursor(SDL_DISABLE);
+                            SDL_SetRelativeMouseMode(SDL_TRUE);
                         }
-                    break;
-                default:
-                    break;
+                        break;
+                        case SDL_MOUSEBUTTONUP:
+                            if (event.button.button == SDL_BUTTON_LEFT)
+                            {
+                                SDL_ShowCursor(SDL_ENABLE);
+                                SDL_SetRelativeMouseMode(SDL_FALSE);
+                            }
+                        break;
+                    default:
+                        break;
+                    }
+                    scene_->OnEvent(event);
+                    ImGui_ImplSDL2_ProcessEvent(&event);
                 }
-                scene_->OnEvent(event);
-                ImGui_ImplSDL2_ProcessEvent(&event);
             }
             glClearColor(0, 0, 0, 0);
             glClear(GL_COLOR_BUFFER_BIT);
 
-            scene_->Update(dt.count());
+            {
+                CpuZone update_zone("Update");
+                scene_->Update(dt.count());
+            }
+            //The GPU time is a few frames old, the controller's cooldown covers that delay
+            scene_->SetRenderScale(dynamic_resolution_.Update(scene_->GpuFrameTimeMs()));
 
             //Generate new ImGui frame
-            ImGui_ImplOpenGL3_NewFrame();
-            ImGui_ImplSDL2_NewFrame();
-            ImGui::NewFrame();
+            {
+                CpuZone imgui_zone("ImGui");
+                ImGui_ImplOpenGL3_NewFrame();
+                ImGui_ImplSDL2_NewFrame();
+                ImGui::NewFrame();
 
-            scene_->DrawImGui();
-            ImGui::Render();
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                scene_->DrawImGui();
+                dynamic_resolution_.DrawImGui();
+                ImGui::Render();
+                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            }
 
-            SDL_GL_SwapWindow(window_);
+            {
+                CpuZone swap_zone("Swap");
+                SDL_GL_SwapWindow(window_);
+            }
+            if (profiler.capturing())
+            {
+                profiler.Collect();
+            }
+        }
+        if (profiler.capturing())
+        {
+            profiler.EndCapture();
+            profiler.WriteChromeTrace(kCpuTracePath);
         }
         End();
     }
 
+    bool Engine::RunHeadless(const HeadlessSettings& settings)
+    {
+        HeadlessContext context;
+        if (!context.Create())
+        {
+            return false;
+        }
+        const GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        //A GLX build of GLEW still loads the entry points, it only complains there is no X display
+        const bool glew_ok = glew_status == GLEW_OK || glew_status == GLEW_ERROR_NO_GLX_DISPLAY;
+#else
+        const bool glew_ok = glew_status == GLEW_OK;
+#endif
+        if (!glew_ok)
+        {
+            std::cerr << "Failed to initialize GLEW on the headless context\n";
+            context.Destroy();
+            return false;
+        }
+        std::cout << "Renderer: " << glGetString(GL_RENDERER) << "\n";
+
+        //Stands in for the window: no vsync and no swap, so the frame time is the rendering alone
+        GLuint framebuffer = 0, color = 0, depth = 0;
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(1, &color);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, settings.width, settings.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, settings.width, settings.height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Headless framebuffer not complete!\n";
+        }
+        glViewport(0, 0, settings.width, settings.height);
+
+        //The scene may still query ImGui, there is just no backend to draw it
+        ImGui::CreateContext();
+        scene_->SetOutputFramebuffer(framebuffer);
+        scene_->Begin();
+        scene_->OnResize(settings.width, settings.height);
+
+        constexpr float kFixedDt = 1.0f / 60.0f;
+        CpuProfiler& profiler = GlobalCpuProfiler();
+        profiler.SetThreadName("Main");
+        const auto frame = [this, framebuffer, &profiler](float dt)
+        {
+            CpuZone frame_zone("Frame");
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glClearColor(0, 0, 0, 0);
+            glClear(GL_COLOR_BUFFER_BIT);
+            {
+                CpuZone update_zone("Update");
+                scene_->Update(dt);
+            }
+            //Wait for the GPU, otherwise only the command submission would be measured
+            {
+                CpuZone finish_zone("Finish");
+                glFinish();
+            }
+            if (profiler.capturing())
+            {
+                profiler.Collect();
+            }
+        };
+
+        //Streaming frames are not representative, measure once everything is resident
+        const auto load_start = std::chrono::steady_clock::now();
+        int loading_frames = 0;
+        while (scene_->IsLoading())
+        {
+            frame(kFixedDt);
+            loading_frames++;
+        }
+        const std::chrono::duration<float, std::milli> load_duration = std::chrono::steady_clock::now() - load_start;
+        std::cout << "Loaded in " << load_duration.count() << " ms (" << loading_frames << " frames)\n";
+
+        if (!settings.trace_path.empty())
+        {
+            profiler.BeginCapture();
+        }
+        std::vector<float> frame_ms;
+        frame_ms.reserve(settings.frame_count);
+        for (int i = 0; i < settings.frame_count; i++)
+        {
+            const float angle = 2.0f * 3.14159265f * static_cast<float>(i) / static_cast<float>(settings.frame_count);
+            const glm::vec3 position = settings.orbit_center +
+                glm::vec3(std::cos(angle) * settings.orbit_radius, settings.orbit_height, std::sin(angle) * settings.orbit_radius);
+            scene_->SetCameraPose(position, settings.orbit_center);
+
+            const auto start = std::chrono::steady_clock::now();
+            frame(kFixedDt);
+            const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+            frame_ms.push_back(duration.count());
+        }
+        if (profiler.capturing())
+        {
+            profiler.EndCapture();
+            profiler.WriteChromeTrace(settings.trace_path);
+        }
+        ReportFrameTimes(std::move(frame_ms), settings.stats_path);
+        if (!settings.image_path.empty())
+        {
+            WriteFramebufferImage(framebuffer, settings.width, settings.height, settings.image_path);
+        }
+
+        scene_->End();
+        ImGui::DestroyContext();
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteFramebuffers(1, &framebuffer);
+        context.Destroy();
+        return true;
+    }
+
     void Engine::Begin()
     {
         SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER);
@@ -153,6 +417,10 @@ namespace gpr5300
         ImGui_ImplOpenGL3_Init("#version 300 es");
 
         scene_->Begin();
+        glm::ivec2 drawableSize;
+        SDL_GL_GetDrawableSize(window_, &drawableSize.x, &drawableSize.y);
+        glViewport(0, 0, drawableSize.x, drawableSize.y);
+        scene_->OnResize(drawableSize.x, drawableSize.y);
     }
 
     void Engine::End()
@@ -1,5 +1,6 @@
 #include "file_utility.h"
 #include <fstream>
+#include <random>
 
 namespace gpr5300
 {
@@ -16,4 +17,10 @@ std::string LoadFile(std::string_view path)
         std::istreambuf_iterator<char>());
     return content;
 }
+
+std::string TemporaryPath(std::string_view final_path)
+{
+    std::random_device random;
+    return std::string(final_path) + ".tmp" + std::to_string(random());
+}
 } // namespace gpr5300
@@ -0,0 +1,215 @@
+#include "frustum_culling.h"
+
+#include <bit>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_CULLING_SSE
+#endif
+
+namespace gpr5300
+{
+
+namespace
+{
+bool IsAabbVisible(const FrustumPlanes& planes, const AabbArray& boxes, std::size_t i)
+{
+  for (const glm::vec4& plane : planes)
+  {
+    const float x = plane.x >= 0.0f ? boxes.max_x[i] : boxes.min_x[i];
+    const float y = plane.y >= 0.0f ? boxes.max_y[i] : boxes.min_y[i];
+    const float z = plane.z >= 0.0f ? boxes.max_z[i] : boxes.min_z[i];
+    //same operation order as the SIMD lanes so both agree on boxes touching a plane, CMakeLists.txt builds this file
+    //with contraction off so neither side becomes an FMA
+    if (plane.w + plane.x * x + plane.y * y + plane.z * z < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+bool IsSphereVisible(const FrustumPlanes& planes, const SphereArray& spheres, std::size_t i)
+{
+  for (const glm::vec4& plane : planes)
+  {
+    const float distance = plane.w + plane.x * spheres.center_x[i] + plane.y * spheres.center_y[i] +
+        plane.z * spheres.center_z[i];
+    if (distance < -spheres.radius[i])
+      return false;
+  }
+  return true;
+}
+
+//Appends the lanes set in mask, lowest lane first so the output stays sorted
+std::size_t WriteVisible(unsigned mask, std::size_t first, std::span<std::uint32_t> visible, std::size_t count)
+{
+  while (mask != 0)
+  {
+    visible[count++] = static_cast<std::uint32_t>(first + std::countr_zero(mask));
+    mask &= mask - 1;
+  }
+  return count;
+}
+}
+
+void AabbArray::Add(const BoundingBox& box)
+{
+  min_x.push_back(box.min.x);
+  min_y.push_back(box.min.y);
+  min_z.push_back(box.min.z);
+  max_x.push_back(box.max.x);
+  max_y.push_back(box.max.y);
+  max_z.push_back(box.max.z);
+}
+
+void AabbArray::Clear()
+{
+  min_x.clear();
+  min_y.clear();
+  min_z.clear();
+  max_x.clear();
+  max_y.clear();
+  max_z.clear();
+}
+
+void SphereArray::Add(const Sphere& sphere)
+{
+  const glm::vec3 center = sphere.center();
+  center_x.push_back(center.x);
+  center_y.push_back(center.y);
+  center_z.push_back(center.z);
+  radius.push_back(sphere.radius());
+}
+
+void SphereArray::Clear()
+{
+  center_x.clear();
+  center_y.clear();
+  center_z.clear();
+  radius.clear();
+}
+
+std::size_t CullAabbsScalar(const FrustumPlanes& planes, const AabbArray& boxes, std::span<std::uint32_t> visible)
+{
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < boxes.size(); i++)
+  {
+    if (IsAabbVisible(planes, boxes, i))
+      visible[count++] = static_cast<std::uint32_t>(i);
+  }
+  return count;
+}
+
+std::size_t CullSpheresScalar(const FrustumPlanes& planes, const SphereArray& spheres, std::span<std::uint32_t> visible)
+{
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < spheres.size(); i++)
+  {
+    if (IsSphereVisible(planes, spheres, i))
+      visible[count++] = static_cast<std::uint32_t>(i);
+  }
+  return count;
+}
+
+//The sign of a plane normal is the same for every box, so the positive vertex is picked per plane by choosing
+//which arrays to load, the lanes themselves never branch
+std::size_t CullAabbs(const FrustumPlanes& planes, const AabbArray& boxes, std::span<std::uint32_t> visible)
+{
+  std::size_t count = 0;
+  std::size_t i = 0;
+#if defined(FRUSTUM_CULLING_AVX)
+  for (; i + 8 <= boxes.size(); i += 8)
+  {
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const glm::vec4& plane : planes)
+    {
+      const float* x = plane.x >= 0.0f ? boxes.max_x.data() : boxes.min_x.data();
+      const float* y = plane.y >= 0.0f ? boxes.max_y.data() : boxes.min_y.data();
+      const float* z = plane.z >= 0.0f ? boxes.max_z.data() : boxes.min_z.data();
+      __m256 distance = _mm256_set1_ps(plane.w);
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(x + i)));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(y + i)));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(z + i)));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+    }
+    count = WriteVisible(static_cast<unsigned>(_mm256_movemask_ps(inside)), i, visible, count);
+  }
+#elif defined(FRUSTUM_CULLING_SSE)
+  for (; i + 4 <= boxes.size(); i += 4)
+  {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const glm::vec4& plane : planes)
+    {
+      const float* x = plane.x >= 0.0f ? boxes.max_x.data() : boxes.min_x.data();
+      const float* y = plane.y >= 0.0f ? boxes.max_y.data() : boxes.min_y.data();
+      const float* z = plane.z >= 0.0f ? boxes.max_z.data() : boxes.min_z.data();
+      __m128 distance = _mm_set1_ps(plane.w);
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(x + i)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(y + i)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(z + i)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+    }
+    count = WriteVisible(static_cast<unsigned>(_mm_movemask_ps(inside)), i, visible, count);
+  }
+#endif
+  //remainder, or everything on targets without SIMD
+  for (; i < boxes.size(); i++)
+  {
+    if (IsAabbVisible(planes, boxes, i))
+      visible[count++] = static_cast<std::uint32_t>(i);
+  }
+  return count;
+}
+
+std::size_t CullSpheres(const FrustumPlanes& planes, const SphereArray& spheres, std::span<std::uint32_t> visible)
+{
+  std::size_t count = 0;
+  std::size_t i = 0;
+#if defined(FRUSTUM_CULLING_AVX)
+  for (; i + 8 <= spheres.size(); i += 8)
+  {
+    const __m256 x = _mm256_loadu_ps(spheres.center_x.data() + i);
+    const __m256 y = _mm256_loadu_ps(spheres.center_y.data() + i);
+    const __m256 z = _mm256_loadu_ps(spheres.center_z.data() + i);
+    const __m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius.data() + i));
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const glm::vec4& plane : planes)
+    {
+      __m256 distance = _mm256_set1_ps(plane.w);
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.x), x));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), y));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), z));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+    }
+    count = WriteVisible(static_cast<unsigned>(_mm256_movemask_ps(inside)), i, visible, count);
+  }
+#elif defined(FRUSTUM_CULLING_SSE)
+  for (; i + 4 <= spheres.size(); i += 4)
+  {
+    const __m128 x = _mm_loadu_ps(spheres.center_x.data() + i);
+    const __m128 y = _mm_loadu_ps(spheres.center_y.data() + i);
+    const __m128 z = _mm_loadu_ps(spheres.center_z.data() + i);
+    const __m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius.data() + i));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const glm::vec4& plane : planes)
+    {
+      __m128 distance = _mm_set1_ps(plane.w);
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.x), x));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negative_radius));
+    }
+    count = WriteVisible(static_cast<unsigned>(_mm_movemask_ps(inside)), i, visible, count);
+  }
+#endif
+  for (; i < spheres.size(); i++)
+  {
+    if (IsSphereVisible(planes, spheres, i))
+      visible[count++] = static_cast<std::uint32_t>(i);
+  }
+  return count;
+}
+
+} // namespace gpr5300
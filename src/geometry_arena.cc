@@ -0,0 +1,359 @@
+#include "geometry_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+#include <imgui.h>
+
+void ArenaFreeList::Reset(std::size_t capacity)
+{
+  free_.clear();
+  if (capacity != 0)
+    free_.push_back({0, capacity});
+  capacity_ = capacity;
+  used_ = 0;
+}
+
+void ArenaFreeList::Grow(std::size_t new_capacity)
+{
+  if (new_capacity <= capacity_)
+    return;
+  Insert({capacity_, new_capacity - capacity_});
+  capacity_ = new_capacity;
+}
+
+bool ArenaFreeList::Allocate(std::size_t size, std::size_t alignment, std::size_t& offset)
+{
+  if (size == 0)
+  {
+    offset = 0;
+    return true;
+  }
+  for (auto it = free_.begin(); it != free_.end(); ++it)
+  {
+    const std::size_t aligned = (it->offset + alignment - 1) / alignment * alignment;
+    const std::size_t end = it->offset + it->size;
+    if (aligned + size > end)
+      continue;
+    //What is left on both sides of the allocation stays free
+    const Range before{it->offset, aligned - it->offset};
+    const Range after{aligned + size, end - aligned - size};
+    it = free_.erase(it);
+    if (after.size != 0)
+      it = free_.insert(it, after);
+    if (before.size != 0)
+      free_.insert(it, before);
+    used_ += size;
+    offset = aligned;
+    return true;
+  }
+  return false;
+}
+
+void ArenaFreeList::Free(std::size_t offset, std::size_t size)
+{
+  if (size == 0)
+    return;
+  used_ -= size;
+  Insert({offset, size});
+}
+
+void ArenaFreeList::Insert(Range range)
+{
+  auto next = std::lower_bound(free_.begin(), free_.end(), range.offset,
+                               [](const Range& free, std::size_t offset) { return free.offset < offset; });
+  if (next != free_.end() && range.offset + range.size == next->offset)
+  {
+    range.size += next->size;
+    next = free_.erase(next);
+  }
+  if (next != free_.begin())
+  {
+    Range& previous = *(next - 1);
+    if (previous.offset + previous.size == range.offset)
+    {
+      previous.size += range.size;
+      return;
+    }
+  }
+  free_.insert(next, range);
+}
+
+void GeometryArena::Create(std::size_t vertex_capacity, std::size_t index_capacity)
+{
+  vertices_.Reset(vertex_capacity);
+  indices_.Reset(index_capacity);
+
+  glGenBuffers(1, &vertex_buffer_);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertex_capacity * sizeof(CompactVertex)), nullptr,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  //Separate attribute format: growing the vertex buffer only rebinds it, the layout is the one of Mesh::SetupMesh
+  glGenVertexArrays(1, &vao_);
+  glBindVertexArray(vao_);
+  glGenBuffers(1, &index_buffer_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(index_capacity), nullptr, GL_STATIC_DRAW);
+  glBindVertexBuffer(0, vertex_buffer_, 0, sizeof(CompactVertex));
+  glEnableVertexAttribArray(0);
+  glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(CompactVertex, position));
+  glVertexAttribBinding(0, 0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(CompactVertex, normal));
+  glVertexAttribBinding(1, 0);
+  glEnableVertexAttribArray(2);
+  glVertexAttribFormat(2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, tex_coords));
+  glVertexAttribBinding(2, 0);
+  glBindVertexArray(0);
+
+  commands_.Create(GL_DRAW_INDIRECT_BUFFER, kMaxDrawsPerFrame * sizeof(DrawElementsIndirectCommand));
+  draw_data_.Create(GL_SHADER_STORAGE_BUFFER, kMaxDrawsPerFrame * sizeof(DrawData));
+  draw_parameters_supported_ = GLEW_ARB_shader_draw_parameters || GLEW_VERSION_4_6;
+  draw_parameters_ = draw_parameters_supported_;
+}
+
+void GeometryArena::Delete()
+{
+  commands_.Delete();
+  draw_data_.Delete();
+  glDeleteVertexArrays(1, &vao_);
+  glDeleteBuffers(1, &vertex_buffer_);
+  glDeleteBuffers(1, &index_buffer_);
+  vao_ = 0;
+  vertex_buffer_ = 0;
+  index_buffer_ = 0;
+  vertices_.Reset(0);
+  indices_.Reset(0);
+}
+
+bool GeometryArena::Allocate(std::span<const CompactVertex> vertices, std::span<const unsigned int> indices,
+                             GeometryAllocation& allocation)
+{
+  //Same rule as Mesh::SetupMesh, indices are relative to the base vertex of the mesh
+  if (vertices.size() <= kMaxShortIndexedVertices)
+  {
+    const std::vector<std::uint16_t> short_indices(indices.begin(), indices.end());
+    return Allocate(vertices, short_indices, allocation);
+  }
+  return Allocate(vertices, indices.data(), indices.size(), GL_UNSIGNED_INT, allocation);
+}
+
+bool GeometryArena::Allocate(std::span<const CompactVertex> vertices, std::span<const std::uint16_t> indices,
+                             GeometryAllocation& allocation)
+{
+  if (vertices.size() > kMaxShortIndexedVertices)
+  {
+    std::cerr << "Geometry arena: 16 bit indices can't reach " << vertices.size() << " vertices\n";
+    return false;
+  }
+  return Allocate(vertices, indices.data(), indices.size(), GL_UNSIGNED_SHORT, allocation);
+}
+
+bool GeometryArena::Allocate(std::span<const CompactVertex> vertices, const void* indices, std::size_t index_count,
+                             GLenum index_type, GeometryAllocation& allocation)
+{
+  const std::size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+  const std::size_t index_bytes = index_count * index_size;
+
+  std::size_t first_vertex = 0;
+  if (!vertices_.Allocate(vertices.size(), 1, first_vertex))
+  {
+    if (!GrowVertices(vertices_.capacity() + vertices.size()) ||
+        !vertices_.Allocate(vertices.size(), 1, first_vertex))
+      return false;
+  }
+  //4 byte aligned so the offset is a whole number of indices of either type
+  std::size_t index_offset = 0;
+  if (!indices_.Allocate(index_bytes, sizeof(std::uint32_t), index_offset))
+  {
+    if (!GrowIndices(indices_.capacity() + index_bytes + sizeof(std::uint32_t)) ||
+        !indices_.Allocate(index_bytes, sizeof(std::uint32_t), index_offset))
+    {
+      vertices_.Free(first_vertex, vertices.size());
+      return false;
+    }
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer_);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(first_vertex * sizeof(CompactVertex)),
+                  static_cast<GLsizeiptr>(vertices.size_bytes()), vertices.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(index_offset), static_cast<GLsizeiptr>(index_bytes),
+                  indices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  allocation.first_vertex = first_vertex;
+  allocation.vertex_count = vertices.size();
+  allocation.first_index = index_offset / index_size;
+  allocation.index_count = index_count;
+  allocation.index_type = index_type;
+  return true;
+}
+
+void GeometryArena::Free(const GeometryAllocation& allocation)
+{
+  vertices_.Free(allocation.first_vertex, allocation.vertex_count);
+  indices_.Free(allocation.first_index * allocation.index_size(), allocation.index_count * allocation.index_size());
+}
+
+GLuint GeometryArena::CopyToLargerBuffer(GLuint buffer, std::size_t size, std::size_t new_size)
+{
+  GLuint larger = 0;
+  glGenBuffers(1, &larger);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, larger);
+  glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(new_size), nullptr, GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(size));
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glDeleteBuffers(1, &buffer);
+  return larger;
+}
+
+bool GeometryArena::GrowVertices(std::size_t min_capacity)
+{
+  if (vao_ == 0)
+    return false;
+  const std::size_t capacity = std::max(vertices_.capacity() * 2, min_capacity);
+  vertex_buffer_ = CopyToLargerBuffer(vertex_buffer_, vertices_.capacity() * sizeof(CompactVertex),
+                                      capacity * sizeof(CompactVertex));
+  vertices_.Grow(capacity);
+  glBindVertexArray(vao_);
+  glBindVertexBuffer(0, vertex_buffer_, 0, sizeof(CompactVertex));
+  glBindVertexArray(0);
+  std::cout << "Geometry arena grown to " << capacity << " vertices\n";
+  return true;
+}
+
+bool GeometryArena::GrowIndices(std::size_t min_capacity)
+{
+  if (vao_ == 0)
+    return false;
+  const std::size_t capacity = std::max(indices_.capacity() * 2, min_capacity);
+  index_buffer_ = CopyToLargerBuffer(index_buffer_, indices_.capacity(), capacity);
+  indices_.Grow(capacity);
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glBindVertexArray(0);
+  std::cout << "Geometry arena grown to " << capacity << " index bytes\n";
+  return true;
+}
+
+void GeometryArena::BeginFrame()
+{
+  frame_commands_ = static_cast<DrawElementsIndirectCommand*>(commands_.BeginRegion());
+  frame_data_ = static_cast<DrawData*>(draw_data_.BeginRegion());
+  frame_draws_ = 0;
+  frame_draw_calls_ = 0;
+  in_frame_ = true;
+}
+
+void GeometryArena::EndFrame()
+{
+  if (!in_frame_)
+    return;
+  commands_.EndRegion();
+  draw_data_.EndRegion();
+  draws_ = frame_draws_;
+  draw_calls_ = frame_draw_calls_;
+  in_frame_ = false;
+}
+
+void GeometryArena::AddDraw(const Mesh& mesh, const glm::mat4& model)
+{
+  const GeometryAllocation& allocation = mesh.allocation();
+  if (allocation.index_count == 0)
+    return;
+  QueuedDraw draw;
+  draw.command.count = static_cast<GLuint>(allocation.index_count);
+  draw.command.instance_count = 1;
+  draw.command.first_index = static_cast<GLuint>(allocation.first_index);
+  draw.command.base_vertex = static_cast<GLint>(allocation.first_vertex);
+  draw.command.base_instance = 0;
+  draw.data.model = model;
+  draw.data.position_offset = glm::vec4(mesh.position_offset(), 0.0f);
+  draw.data.position_scale = glm::vec4(mesh.position_scale(), 0.0f);
+  (allocation.index_type == GL_UNSIGNED_SHORT ? short_draws_ : int_draws_).push_back(draw);
+}
+
+void GeometryArena::Submit(const Shader& shader)
+{
+  if (!in_frame_ || frame_commands_ == nullptr || frame_data_ == nullptr)
+  {
+    std::cerr << "Geometry arena draws submitted outside of a frame or without mapped rings\n";
+    short_draws_.clear();
+    int_draws_.clear();
+    return;
+  }
+  if (short_draws_.empty() && int_draws_.empty())
+    return;
+
+  shader.SetBool(shader.draw_uniforms().indirect, true);
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands_.buffer());
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kDrawDataBinding, draw_data_.buffer());
+  SubmitQueue(shader, short_draws_, GL_UNSIGNED_SHORT);
+  SubmitQueue(shader, int_draws_, GL_UNSIGNED_INT);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  glBindVertexArray(0);
+  shader.SetBool(shader.draw_uniforms().indirect, false);
+}
+
+void GeometryArena::SubmitQueue(const Shader& shader, std::vector<QueuedDraw>& draws, GLenum index_type)
+{
+  const std::size_t count = std::min(draws.size(), kMaxDrawsPerFrame - frame_draws_);
+  if (count < draws.size())
+  {
+    std::cerr << "Geometry arena: more than " << kMaxDrawsPerFrame << " draws this frame, "
+              << draws.size() - count << " dropped\n";
+  }
+  if (count == 0)
+  {
+    draws.clear();
+    return;
+  }
+
+  //Commands and draw data share their index in the two rings
+  for (std::size_t i = 0; i < count; i++)
+  {
+    frame_commands_[frame_draws_ + i] = draws[i].command;
+    frame_data_[frame_draws_ + i] = draws[i].data;
+  }
+  const std::size_t first = commands_.region_index() * kMaxDrawsPerFrame + frame_draws_;
+  if (draw_parameters_)
+  {
+    shader.SetInt(shader.draw_uniforms().draw_offset, static_cast<GLint>(first));
+    glMultiDrawElementsIndirect(GL_TRIANGLES, index_type,
+                                reinterpret_cast<const void*>(first * sizeof(DrawElementsIndirectCommand)),
+                                static_cast<GLsizei>(count), 0);
+    frame_draw_calls_++;
+  }
+  else
+  {
+    //gl_DrawIDARB is always 0 in the shader, each command is its own call
+    for (std::size_t i = first; i < first + count; i++)
+    {
+      shader.SetInt(shader.draw_uniforms().draw_offset, static_cast<GLint>(i));
+      glMultiDrawElementsIndirect(GL_TRIANGLES, index_type,
+                                  reinterpret_cast<const void*>(i * sizeof(DrawElementsIndirectCommand)), 1, 0);
+    }
+    frame_draw_calls_ += count;
+  }
+  frame_draws_ += count;
+  draws.clear();
+}
+
+void GeometryArena::DrawImGui() const
+{
+  if (!ImGui::CollapsingHeader("Geometry arena"))
+    return;
+  ImGui::Text("Vertices: %zu / %zu", vertices_.used(), vertices_.capacity());
+  ImGui::Text("Indices: %.1f / %.1f MB", static_cast<double>(indices_.used()) / (1024.0 * 1024.0),
+              static_cast<double>(indices_.capacity()) / (1024.0 * 1024.0));
+  ImGui::Text("%zu draws in %zu calls%s", draws_, draw_calls_,
+              !draw_parameters_supported_ ? " (no GL_ARB_shader_draw_parameters)" :
+              !draw_parameters_ ? " (one command per call)" : "");
+}
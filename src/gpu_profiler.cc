@@ -0,0 +1,226 @@
+#include "gpu_profiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include <imgui.h>
+
+namespace
+{
+constexpr std::uint32_t kNoQuery = std::numeric_limits<std::uint32_t>::max();
+constexpr const char* kFrameZoneName = "Frame";
+}
+
+void GpuProfiler::Delete()
+{
+  for (PendingFrame& frame : frames_)
+  {
+    if (!frame.queries.empty())
+      glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+    frame.queries.clear();
+    frame.used_queries = 0;
+    frame.zones.clear();
+  }
+  open_zones_.clear();
+  results_.clear();
+  captured_.clear();
+  capturing_ = false;
+}
+
+void GpuProfiler::BeginFrame()
+{
+  PendingFrame& frame = frames_[frame_index_ % kFrameLatency];
+  if (!frame.zones.empty())
+    ReadBack(frame, frame_index_ - kFrameLatency);
+  frame.zones.clear();
+  frame.used_queries = 0;
+  open_zones_.clear();
+  BeginZone(kFrameZoneName);
+}
+
+void GpuProfiler::EndFrame()
+{
+  //Zones left open are closed with the frame, the root one last
+  while (!open_zones_.empty())
+  {
+    EndZone();
+  }
+  frame_index_++;
+}
+
+void GpuProfiler::BeginZone(const char* name)
+{
+  PendingFrame& frame = frames_[frame_index_ % kFrameLatency];
+  const int depth = static_cast<int>(open_zones_.size());
+  const std::uint32_t begin_query = Timestamp(frame);
+  open_zones_.push_back(frame.zones.size());
+  frame.zones.push_back({name, depth, begin_query, kNoQuery});
+}
+
+void GpuProfiler::EndZone()
+{
+  if (open_zones_.empty())
+    return;
+  PendingFrame& frame = frames_[frame_index_ % kFrameLatency];
+  frame.zones[open_zones_.back()].end_query = Timestamp(frame);
+  open_zones_.pop_back();
+}
+
+std::uint32_t GpuProfiler::Timestamp(PendingFrame& frame)
+{
+  if (frame.used_queries == frame.queries.size())
+  {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    frame.queries.push_back(query);
+  }
+  //Timestamps rather than GL_TIME_ELAPSED: elapsed queries can't be nested
+  glQueryCounter(frame.queries[frame.used_queries], GL_TIMESTAMP);
+  return frame.used_queries++;
+}
+
+void GpuProfiler::ReadBack(PendingFrame& frame, std::uint64_t frame_index)
+{
+  //The end of the root zone is the last query of the frame, once it is there all the others are too.
+  //A GPU more than kFrameLatency frames behind loses this frame instead of stalling the CPU.
+  GLint available = 0;
+  glGetQueryObjectiv(frame.queries[frame.used_queries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+    return;
+
+  timestamps_.resize(frame.used_queries);
+  for (std::uint32_t i = 0; i < frame.used_queries; i++)
+  {
+    glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamps_[i]);
+  }
+
+  const GLuint64 frame_start = timestamps_[frame.zones.front().begin_query];
+  results_.clear();
+  for (const PendingZone& zone : frame.zones)
+  {
+    if (zone.end_query == kNoQuery)
+      continue;
+    const GLuint64 begin = timestamps_[zone.begin_query];
+    const GLuint64 end = timestamps_[zone.end_query];
+    results_.push_back({zone.name, zone.depth,
+                        static_cast<float>(static_cast<double>(begin - frame_start) * 1e-6),
+                        static_cast<float>(static_cast<double>(end - begin) * 1e-6)});
+  }
+
+  frame_history_ms_[history_offset_] = results_.front().duration_ms;
+  history_offset_ = (history_offset_ + 1) % kHistoryFrames;
+
+  if (capturing_)
+  {
+    captured_.push_back({frame_index, frame_start, results_});
+    capturing_ = captured_.size() < kCaptureFrames;
+  }
+}
+
+std::size_t GpuProfiler::DrawZoneTree(std::size_t index) const
+{
+  const GpuZoneResult& zone = results_[index];
+  const bool has_children = index + 1 < results_.size() && results_[index + 1].depth > zone.depth;
+  const ImGuiTreeNodeFlags flags = has_children ? ImGuiTreeNodeFlags_DefaultOpen
+                                                : ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+  const bool open = ImGui::TreeNodeEx(reinterpret_cast<const void*>(index), flags, "%s  %.3f ms",
+                                      zone.name, zone.duration_ms);
+  index++;
+  while (index < results_.size() && results_[index].depth > zone.depth)
+  {
+    index = open && has_children ? DrawZoneTree(index) : index + 1;
+  }
+  if (open && has_children)
+    ImGui::TreePop();
+  return index;
+}
+
+void GpuProfiler::DrawImGui()
+{
+  if (!ImGui::CollapsingHeader("GPU profiler"))
+    return;
+
+  if (results_.empty())
+  {
+    ImGui::TextDisabled("Waiting for the first frames");
+    return;
+  }
+  ImGui::PlotLines("GPU frame (ms)", frame_history_ms_.data(), static_cast<int>(kHistoryFrames),
+                   static_cast<int>(history_offset_));
+  for (std::size_t index = 0; index < results_.size();)
+  {
+    index = DrawZoneTree(index);
+  }
+
+  if (capturing_)
+  {
+    ImGui::Text("Capturing %zu/%zu frames", captured_.size(), kCaptureFrames);
+    return;
+  }
+  if (ImGui::Button("Capture"))
+  {
+    captured_.clear();
+    capturing_ = true;
+  }
+  if (!captured_.empty())
+  {
+    ImGui::SameLine();
+    if (ImGui::Button("Export CSV"))
+      WriteCsv("gpu_profile.csv");
+    ImGui::SameLine();
+    if (ImGui::Button("Export trace"))
+      WriteChromeTrace("gpu_profile.json");
+  }
+}
+
+bool GpuProfiler::WriteCsv(std::string_view path) const
+{
+  std::ofstream out{std::string(path)};
+  if (!out)
+  {
+    std::cerr << "Could not write " << path << "\n";
+    return false;
+  }
+  out << "frame,zone,depth,start_ms,duration_ms\n";
+  for (const CapturedFrame& frame : captured_)
+  {
+    for (const GpuZoneResult& zone : frame.zones)
+    {
+      out << frame.index << "," << zone.name << "," << zone.depth << "," << zone.start_ms << ","
+          << zone.duration_ms << "\n";
+    }
+  }
+  std::cout << "GPU profile written to " << path << "\n";
+  return static_cast<bool>(out);
+}
+
+bool GpuProfiler::WriteChromeTrace(std::string_view path) const
+{
+  std::ofstream out{std::string(path)};
+  if (!out)
+  {
+    std::cerr << "Could not write " << path << "\n";
+    return false;
+  }
+  //Complete events in microseconds, nesting comes from the overlapping ranges on the same track
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+  bool first = true;
+  const GLuint64 origin = captured_.empty() ? 0 : captured_.front().start_ns;
+  for (const CapturedFrame& frame : captured_)
+  {
+    const double frame_us = static_cast<double>(frame.start_ns - origin) * 1e-3;
+    for (const GpuZoneResult& zone : frame.zones)
+    {
+      out << (first ? "" : ",\n") << "{\"name\":\"" << zone.name << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+          << ",\"ts\":" << frame_us + zone.start_ms * 1e3 << ",\"dur\":" << zone.duration_ms * 1e3
+          << ",\"args\":{\"frame\":" << frame.index << "}}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+  std::cout << "GPU trace written to " << path << "\n";
+  return static_cast<bool>(out);
+}
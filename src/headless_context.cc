@@ -0,0 +1,100 @@
+#include "headless_context.h"
+
+#include <iostream>
+
+#ifdef GPR5300_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace gpr5300
+{
+
+#ifdef GPR5300_HEADLESS
+
+bool HeadlessContext::Create()
+{
+  //The surfaceless platform needs neither X11 nor a GPU, fall back on the default display when it is missing
+  EGLDisplay display = EGL_NO_DISPLAY;
+  const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display)
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major = 0, minor = 0;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+  {
+    std::cerr << "Could not initialize an EGL display\n";
+    return false;
+  }
+  display_ = display;
+
+  const EGLint config_attributes[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE};
+  EGLConfig config = nullptr;
+  EGLint config_count = 0;
+  //Surfaceless contexts don't need a config, some drivers still want one
+  if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0)
+    config = nullptr;
+
+  if (!eglBindAPI(EGL_OPENGL_API))
+  {
+    std::cerr << "EGL has no desktop OpenGL support\n";
+    Destroy();
+    return false;
+  }
+  const EGLint context_attributes[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 4,
+      EGL_CONTEXT_MINOR_VERSION, 5,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE};
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+  if (context == EGL_NO_CONTEXT)
+  {
+    std::cerr << "Could not create a GL 4.5 core context (EGL error 0x" << std::hex << eglGetError() << std::dec << ")\n";
+    Destroy();
+    return false;
+  }
+  context_ = context;
+
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+  {
+    std::cerr << "Could not make the headless context current\n";
+    Destroy();
+    return false;
+  }
+  std::cout << "Headless EGL " << major << "." << minor << " context\n";
+  return true;
+}
+
+void HeadlessContext::Destroy()
+{
+  if (!display_)
+    return;
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (context_)
+    eglDestroyContext(display_, context_);
+  eglTerminate(display_);
+  context_ = nullptr;
+  display_ = nullptr;
+}
+
+#else
+
+bool HeadlessContext::Create()
+{
+  std::cerr << "Headless rendering needs EGL, this build was made without it\n";
+  return false;
+}
+
+void HeadlessContext::Destroy()
+{
+}
+
+#endif
+
+} // namespace gpr5300
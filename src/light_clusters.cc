@@ -0,0 +1,216 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <imgui.h>
+
+namespace
+{
+//Same attenuation as the shaders
+constexpr float kLightLinear = 0.09f;
+constexpr float kLightQuadratic = 0.032f;
+//Contribution under which a light is cut, the shaders fade it out smoothly up to its radius
+constexpr float kLightCutoff = 0.05f;
+
+float ClusterDistance(const glm::vec2& plane, float lateral, float z)
+{
+  return plane.x * lateral + plane.y * z;
+}
+}
+
+float PointLightRadius(const glm::vec3& color)
+{
+  const float intensity = std::max(color.x, std::max(color.y, color.z));
+  if (intensity <= kLightCutoff)
+    return 0.0f;
+  //intensity / (1 + linear * d + quadratic * d^2) = cutoff
+  const float c = 1.0f - intensity / kLightCutoff;
+  return (-kLightLinear + std::sqrt(kLightLinear * kLightLinear - 4.0f * kLightQuadratic * c)) /
+      (2.0f * kLightQuadratic);
+}
+
+void LightClusters::Create()
+{
+  glGenBuffers(1, &lights_buffer_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, lights_buffer_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, kMaxPointLights * sizeof(PointLight), nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kPointLightsBinding, lights_buffer_);
+
+  glGenBuffers(1, &clusters_buffer_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters_buffer_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, kClusterCount * sizeof(glm::uvec2), nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kLightClustersBinding, clusters_buffer_);
+
+  glGenBuffers(1, &indices_buffer_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, indices_buffer_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, kMaxLightIndices * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kLightIndicesBinding, indices_buffer_);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void LightClusters::Delete()
+{
+  const GLuint buffers[] = {lights_buffer_, clusters_buffer_, indices_buffer_};
+  glDeleteBuffers(3, buffers);
+  lights_buffer_ = clusters_buffer_ = indices_buffer_ = 0;
+}
+
+bool LightClusters::ComputeBounds(const glm::vec3& view_position, float radius, LightBounds& bounds) const
+{
+  const float depth = -view_position.z;
+  if (depth + radius < near_ || depth - radius > far_)
+    return false;
+  const auto slice = [this](float z) {
+    const float index = std::floor(std::log(std::max(z, near_) / near_) * slice_scale_);
+    return std::clamp(static_cast<int>(index), 0, kClusterZ - 1);
+  };
+  bounds.min_z = slice(depth - radius);
+  bounds.max_z = slice(depth + radius);
+
+  //The tile planes go through the eye, behind it they would mirror the tiles: a sphere around the eye touches
+  //them all
+  if (depth < radius)
+  {
+    bounds.min_x = 0;
+    bounds.max_x = kClusterX - 1;
+    bounds.min_y = 0;
+    bounds.max_y = kClusterY - 1;
+    return true;
+  }
+
+  //A column is touched when the sphere isn't fully on the outer side of either of its planes
+  bounds.min_x = kClusterX;
+  bounds.max_x = -1;
+  for (int x = 0; x < kClusterX; x++)
+  {
+    if (ClusterDistance(column_planes_[x], view_position.x, view_position.z) >= -radius &&
+        ClusterDistance(column_planes_[x + 1], view_position.x, view_position.z) <= radius)
+    {
+      bounds.min_x = std::min(bounds.min_x, x);
+      bounds.max_x = x;
+    }
+  }
+  bounds.min_y = kClusterY;
+  bounds.max_y = -1;
+  for (int y = 0; y < kClusterY; y++)
+  {
+    if (ClusterDistance(row_planes_[y], view_position.y, view_position.z) >= -radius &&
+        ClusterDistance(row_planes_[y + 1], view_position.y, view_position.z) <= radius)
+    {
+      bounds.min_y = std::min(bounds.min_y, y);
+      bounds.max_y = y;
+    }
+  }
+  return bounds.min_x <= bounds.max_x && bounds.min_y <= bounds.max_y;
+}
+
+void LightClusters::Update(std::span<const PointLight> lights, const glm::mat4& view, const glm::mat4& projection,
+                           const gpr5300::FrustumPlanes& planes)
+{
+  Bin(lights, view, projection, planes);
+
+  if (!visible_lights_.empty())
+  {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lights_buffer_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, visible_lights_.size() * sizeof(PointLight), visible_lights_.data());
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters_buffer_);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, clusters_.size() * sizeof(glm::uvec2), clusters_.data());
+  if (!indices_.empty())
+  {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indices_buffer_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, indices_.size() * sizeof(std::uint32_t), indices_.data());
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void LightClusters::Bin(std::span<const PointLight> lights, const glm::mat4& view, const glm::mat4& projection,
+                        const gpr5300::FrustumPlanes& planes)
+{
+  clusters_.resize(kClusterCount);
+  cursors_.resize(kClusterCount);
+
+  const std::size_t light_count = std::min(lights.size(), kMaxPointLights);
+  spheres_.Clear();
+  for (std::size_t i = 0; i < light_count; i++)
+  {
+    spheres_.Add(Sphere(glm::vec3(lights[i].position_radius), lights[i].position_radius.w));
+  }
+  visible_.resize(light_count);
+  const std::size_t visible_count = gpr5300::CullSpheres(planes, spheres_, visible_);
+
+  //Eye space tile planes, the point (lateral, z) is on the positive side when its NDC is past the boundary
+  near_ = projection[3][2] / (projection[2][2] - 1.0f);
+  far_ = projection[3][2] / (projection[2][2] + 1.0f);
+  slice_scale_ = static_cast<float>(kClusterZ) / std::log(far_ / near_);
+  for (int x = 0; x <= kClusterX; x++)
+  {
+    const float ndc = -1.0f + 2.0f * static_cast<float>(x) / kClusterX;
+    column_planes_[x] = glm::normalize(glm::vec2(projection[0][0], ndc));
+  }
+  for (int y = 0; y <= kClusterY; y++)
+  {
+    const float ndc = -1.0f + 2.0f * static_cast<float>(y) / kClusterY;
+    row_planes_[y] = glm::normalize(glm::vec2(projection[1][1], ndc));
+  }
+
+  //Counted first so every cluster gets a contiguous range of the index list
+  visible_lights_.clear();
+  bounds_.clear();
+  std::fill(clusters_.begin(), clusters_.end(), glm::uvec2(0));
+  for (std::size_t i = 0; i < visible_count; i++)
+  {
+    const PointLight& light = lights[visible_[i]];
+    const glm::vec3 view_position = glm::vec3(view * glm::vec4(glm::vec3(light.position_radius), 1.0f));
+    LightBounds bounds{};
+    if (!ComputeBounds(view_position, light.position_radius.w, bounds))
+      continue;
+    visible_lights_.push_back(light);
+    bounds_.push_back(bounds);
+    for (int z = bounds.min_z; z <= bounds.max_z; z++)
+      for (int y = bounds.min_y; y <= bounds.max_y; y++)
+        for (int x = bounds.min_x; x <= bounds.max_x; x++)
+          clusters_[x + kClusterX * (y + kClusterY * z)].y++;
+  }
+
+  std::uint32_t offset = 0;
+  max_lights_per_cluster_ = 0;
+  dropped_indices_ = 0;
+  for (int cluster = 0; cluster < kClusterCount; cluster++)
+  {
+    const std::uint32_t count = clusters_[cluster].y;
+    const std::uint32_t kept = std::min(count, static_cast<std::uint32_t>(kMaxLightIndices) - offset);
+    dropped_indices_ += count - kept;
+    max_lights_per_cluster_ = std::max<std::size_t>(max_lights_per_cluster_, count);
+    clusters_[cluster] = glm::uvec2(offset, kept);
+    cursors_[cluster] = offset;
+    offset += kept;
+  }
+
+  indices_.resize(offset);
+  for (std::uint32_t light = 0; light < bounds_.size(); light++)
+  {
+    const LightBounds& bounds = bounds_[light];
+    for (int z = bounds.min_z; z <= bounds.max_z; z++)
+      for (int y = bounds.min_y; y <= bounds.max_y; y++)
+        for (int x = bounds.min_x; x <= bounds.max_x; x++)
+        {
+          const int cluster = x + kClusterX * (y + kClusterY * z);
+          if (cursors_[cluster] < clusters_[cluster].x + clusters_[cluster].y)
+            indices_[cursors_[cluster]++] = light;
+        }
+  }
+}
+
+void LightClusters::DrawImGui() const
+{
+  if (!ImGui::CollapsingHeader("Light clusters"))
+    return;
+  ImGui::Text("Grid %dx%dx%d", kClusterX, kClusterY, kClusterZ);
+  ImGui::Text("Visible lights: %zu", visible_lights_.size());
+  ImGui::Text("Light indices: %zu/%zu", indices_.size(), kMaxLightIndices);
+  ImGui::Text("Most lights in a cluster: %zu", max_lights_per_cluster_);
+  if (dropped_indices_ > 0)
+    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Dropped %zu light indices", dropped_indices_);
+}
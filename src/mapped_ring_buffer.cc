@@ -0,0 +1,70 @@
+#include "mapped_ring_buffer.h"
+
+#include <iostream>
+
+void MappedRingBuffer::Create(GLenum target, std::size_t region_size, std::size_t region_count)
+{
+  target_ = target;
+  region_size_ = region_size;
+  region_ = 0;
+  fences_.assign(region_count, nullptr);
+
+  //Coherent so no explicit flush is needed, the fences are the only synchronisation
+  constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  const auto size = static_cast<GLsizeiptr>(region_size * region_count);
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(target_, buffer_);
+  glBufferStorage(target_, size, nullptr, flags);
+  data_ = static_cast<std::byte*>(glMapBufferRange(target_, 0, size, flags));
+  glBindBuffer(target_, 0);
+  if (data_ == nullptr)
+  {
+    std::cerr << "Could not map ring buffer\n";
+  }
+}
+
+void MappedRingBuffer::Delete()
+{
+  for (GLsync& fence : fences_)
+  {
+    if (fence != nullptr)
+      glDeleteSync(fence);
+    fence = nullptr;
+  }
+  if (buffer_ != 0)
+  {
+    glBindBuffer(target_, buffer_);
+    glUnmapBuffer(target_);
+    glBindBuffer(target_, 0);
+    glDeleteBuffers(1, &buffer_);
+  }
+  buffer_ = 0;
+  data_ = nullptr;
+}
+
+void* MappedRingBuffer::BeginRegion()
+{
+  if (data_ == nullptr)
+    return nullptr;
+  GLsync& fence = fences_[region_];
+  if (fence != nullptr)
+  {
+    //With 3 regions this only blocks when the GPU is more than two frames behind
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED)
+    {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+  return data_ + region_offset();
+}
+
+void MappedRingBuffer::EndRegion()
+{
+  if (data_ == nullptr)
+    return;
+  fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  region_ = (region_ + 1) % fences_.size();
+}
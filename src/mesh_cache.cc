@@ -0,0 +1,446 @@
+#include "mesh_cache.h"
+
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "file_utility.h"
+
+namespace gpr5300
+{
+
+namespace
+{
+constexpr char kMeshCacheMagic[8] = {'G', 'P', 'R', 'M', 'E', 'S', 'H', '\0'};
+constexpr std::uint64_t kSectionAlignment = 16;
+
+constexpr std::uint64_t AlignCacheOffset(std::uint64_t offset)
+{
+  return (offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+}
+
+constexpr std::uint32_t CachedVertexSize(VertexFormat vertex_format)
+{
+  return vertex_format == VertexFormat::kCompact ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+//16 bit indices for the compact meshes MeshData::Compact narrows
+constexpr std::uint32_t CachedIndexSize(VertexFormat vertex_format, std::size_t vertex_count)
+{
+  return vertex_format == VertexFormat::kCompact && vertex_count <= kMaxShortIndexedVertices ?
+      sizeof(std::uint16_t) : sizeof(std::uint32_t);
+}
+
+//What WriteMeshCache copies of a mesh in the layout of the cache
+std::span<const std::byte> CachedVertexBytes(const MeshData& mesh)
+{
+  return mesh.vertex_format == VertexFormat::kCompact ? std::as_bytes(mesh.compact_vertex_data()) :
+      std::as_bytes(mesh.vertex_data());
+}
+
+std::span<const std::byte> CachedIndexBytes(const MeshData& mesh)
+{
+  return mesh.vertex_format == VertexFormat::kCompact && !mesh.short_index_data().empty() ?
+      std::as_bytes(mesh.short_index_data()) : std::as_bytes(mesh.index_data());
+}
+
+constexpr std::uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+constexpr std::uint64_t kFnvPrime = 1099511628211ull;
+
+void HashBytes(const void* data, std::size_t size, std::uint64_t& hash)
+{
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= kFnvPrime;
+  }
+}
+
+//Size and write time of the file, hashed after what hash already holds
+bool HashStamp(const std::filesystem::path& path, std::uint64_t& hash)
+{
+  std::error_code error;
+  const std::uint64_t size = std::filesystem::file_size(path, error);
+  if (error)
+    return false;
+  const auto write_time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+  if (error)
+    return false;
+  HashBytes(&size, sizeof(size), hash);
+  HashBytes(&write_time, sizeof(write_time), hash);
+  return true;
+}
+
+//value gets the JSON string whose opening quote is at position, escapes are kept as the escaped character which
+//is enough for paths. Returns the position of the closing quote.
+std::size_t ReadJsonString(std::string_view json, std::size_t position, std::string& value)
+{
+  value.clear();
+  for (position++; position < json.size() && json[position] != '"'; position++)
+  {
+    if (json[position] == '\\' && position + 1 < json.size())
+      position++;
+    value += json[position];
+  }
+  return position;
+}
+
+std::string PercentDecode(std::string_view uri)
+{
+  std::string decoded;
+  for (std::size_t i = 0; i < uri.size(); i++)
+  {
+    if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit(static_cast<unsigned char>(uri[i + 1])) &&
+        std::isxdigit(static_cast<unsigned char>(uri[i + 2])))
+    {
+      decoded += static_cast<char>(std::stoi(std::string(uri.substr(i + 1, 2)), nullptr, 16));
+      i += 2;
+    }
+    else
+    {
+      decoded += uri[i];
+    }
+  }
+  return decoded;
+}
+
+//Files the "buffers" array of a glTF document points to, embedded data: buffers are part of the document already
+std::vector<std::string> GltfBufferUris(std::string_view json)
+{
+  std::vector<std::string> uris;
+  const std::size_t key = json.find("\"buffers\"");
+  if (key == std::string_view::npos)
+    return uris;
+  std::size_t position = json.find('[', key);
+  if (position == std::string_view::npos)
+    return uris;
+
+  int depth = 0;
+  std::string token;
+  std::string previous_token;
+  bool uri_value = false;
+  for (; position < json.size(); position++)
+  {
+    const char c = json[position];
+    if (c == '"')
+    {
+      position = ReadJsonString(json, position, token);
+      if (uri_value && !token.starts_with("data:"))
+        uris.push_back(PercentDecode(token));
+      uri_value = false;
+      previous_token = token;
+    }
+    else if (c == ':')
+    {
+      uri_value = previous_token == "uri";
+      previous_token.clear();
+    }
+    else if (c == '[' || c == '{')
+    {
+      depth++;
+    }
+    else if ((c == ']' || c == '}') && --depth == 0)
+    {
+      break;
+    }
+  }
+  return uris;
+}
+}
+
+bool MeshCacheReader::Open(std::string_view cache_path, std::uint64_t source_hash, std::uint32_t import_flags,
+                           VertexFormat vertex_format)
+{
+  vertex_format_ = vertex_format;
+  records_ = {};
+  textures_ = {};
+  strings_ = {};
+  if (!file_.Open(cache_path))
+    return false;
+
+  const std::byte* data = file_.data();
+  const std::size_t size = file_.size();
+  if (size < sizeof(MeshCacheHeader))
+    return false;
+
+  MeshCacheHeader header{};
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kMeshCacheMagic, sizeof(kMeshCacheMagic)) != 0 ||
+      header.version != kMeshCacheVersion ||
+      header.vertex_size != CachedVertexSize(vertex_format) ||
+      header.source_hash != source_hash ||
+      header.import_flags != import_flags ||
+      header.file_size != size)
+  {
+    file_.Close();
+    return false;
+  }
+
+  const std::uint64_t records_offset = AlignCacheOffset(sizeof(MeshCacheHeader));
+  const std::uint64_t textures_offset = AlignCacheOffset(records_offset + header.mesh_count * sizeof(MeshCacheRecord));
+  const std::uint64_t strings_offset = AlignCacheOffset(textures_offset + header.texture_count * sizeof(MeshCacheTexture));
+  if (strings_offset + header.strings_size > size)
+  {
+    file_.Close();
+    return false;
+  }
+  records_ = {reinterpret_cast<const MeshCacheRecord*>(data + records_offset), header.mesh_count};
+  textures_ = {reinterpret_cast<const MeshCacheTexture*>(data + textures_offset), header.texture_count};
+  strings_ = {reinterpret_cast<const char*>(data + strings_offset), header.strings_size};
+
+  //Reject truncated or corrupted files up front so the accessors can stay unchecked
+  for (const MeshCacheRecord& record : records_)
+  {
+    if (record.index_size != CachedIndexSize(vertex_format, record.vertex_count) ||
+        record.vertex_offset + std::uint64_t{record.vertex_count} * header.vertex_size > size ||
+        record.index_offset + std::uint64_t{record.index_count} * record.index_size > size ||
+        std::uint64_t{record.first_texture} + record.texture_count > textures_.size())
+    {
+      records_ = {};
+      file_.Close();
+      return false;
+    }
+  }
+  for (const MeshCacheTexture& texture : textures_)
+  {
+    if (std::uint64_t{texture.type_offset} + texture.type_length > strings_.size() ||
+        std::uint64_t{texture.path_offset} + texture.path_length > strings_.size())
+    {
+      records_ = {};
+      file_.Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+std::span<const Vertex> MeshCacheReader::vertices(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  if (vertex_format_ != VertexFormat::kFloat)
+    return {};
+  return {reinterpret_cast<const Vertex*>(file_.data() + record.vertex_offset), record.vertex_count};
+}
+
+std::span<const CompactVertex> MeshCacheReader::compact_vertices(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  if (vertex_format_ != VertexFormat::kCompact)
+    return {};
+  return {reinterpret_cast<const CompactVertex*>(file_.data() + record.vertex_offset), record.vertex_count};
+}
+
+std::span<const unsigned int> MeshCacheReader::indices(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  if (record.index_size != sizeof(std::uint32_t))
+    return {};
+  return {reinterpret_cast<const unsigned int*>(file_.data() + record.index_offset), record.index_count};
+}
+
+std::span<const std::uint16_t> MeshCacheReader::short_indices(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  if (record.index_size != sizeof(std::uint16_t))
+    return {};
+  return {reinterpret_cast<const std::uint16_t*>(file_.data() + record.index_offset), record.index_count};
+}
+
+std::vector<CachedTexture> MeshCacheReader::textures(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  std::vector<CachedTexture> textures;
+  textures.reserve(record.texture_count);
+  for (const MeshCacheTexture& texture : textures_.subspan(record.first_texture, record.texture_count))
+  {
+    textures.push_back({strings_.substr(texture.type_offset, texture.type_length),
+                        strings_.substr(texture.path_offset, texture.path_length)});
+  }
+  return textures;
+}
+
+BoundingBox MeshCacheReader::bounding_box(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  return {glm::vec3(record.aabb_min[0], record.aabb_min[1], record.aabb_min[2]),
+          glm::vec3(record.aabb_max[0], record.aabb_max[1], record.aabb_max[2])};
+}
+
+Sphere MeshCacheReader::bounding_sphere(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  return {glm::vec3(record.sphere_center[0], record.sphere_center[1], record.sphere_center[2]), record.sphere_radius};
+}
+
+glm::vec3 MeshCacheReader::position_offset(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  return glm::vec3(record.position_offset[0], record.position_offset[1], record.position_offset[2]);
+}
+
+glm::vec3 MeshCacheReader::position_scale(std::size_t mesh) const
+{
+  const MeshCacheRecord& record = records_[mesh];
+  return glm::vec3(record.position_scale[0], record.position_scale[1], record.position_scale[2]);
+}
+
+bool WriteMeshCache(std::string_view cache_path, std::uint64_t source_hash, std::uint32_t import_flags,
+                    VertexFormat vertex_format, std::span<const MeshData> meshes)
+{
+  //Build the tables first, every offset is known before anything is written
+  std::vector<MeshCacheRecord> records;
+  std::vector<MeshCacheTexture> textures;
+  std::string strings;
+  records.reserve(meshes.size());
+  for (const MeshData& mesh : meshes)
+  {
+    if (mesh.vertex_format != vertex_format)
+      return false;
+    MeshCacheRecord record{};
+    record.vertex_count = static_cast<std::uint32_t>(CachedVertexBytes(mesh).size() / CachedVertexSize(vertex_format));
+    record.index_size = CachedIndexSize(vertex_format, record.vertex_count);
+    record.index_count = static_cast<std::uint32_t>(CachedIndexBytes(mesh).size() / record.index_size);
+    record.first_texture = static_cast<std::uint32_t>(textures.size());
+    record.texture_count = static_cast<std::uint32_t>(mesh.textures.size());
+    for (int axis = 0; axis < 3; axis++)
+    {
+      record.aabb_min[axis] = mesh.bounding_box.min[axis];
+      record.aabb_max[axis] = mesh.bounding_box.max[axis];
+      record.sphere_center[axis] = mesh.bounding_sphere.center()[axis];
+      record.position_offset[axis] = mesh.position_offset[axis];
+      record.position_scale[axis] = mesh.position_scale[axis];
+    }
+    record.sphere_radius = mesh.bounding_sphere.radius();
+    for (const Texture& texture : mesh.textures)
+    {
+      MeshCacheTexture entry{};
+      entry.type_offset = static_cast<std::uint32_t>(strings.size());
+      entry.type_length = static_cast<std::uint32_t>(texture.type.size());
+      strings += texture.type;
+      entry.path_offset = static_cast<std::uint32_t>(strings.size());
+      entry.path_length = static_cast<std::uint32_t>(texture.path.size());
+      strings += texture.path;
+      textures.push_back(entry);
+    }
+    records.push_back(record);
+  }
+
+  const std::uint64_t records_offset = AlignCacheOffset(sizeof(MeshCacheHeader));
+  const std::uint64_t textures_offset = AlignCacheOffset(records_offset + records.size() * sizeof(MeshCacheRecord));
+  const std::uint64_t strings_offset = AlignCacheOffset(textures_offset + textures.size() * sizeof(MeshCacheTexture));
+  std::uint64_t offset = AlignCacheOffset(strings_offset + strings.size());
+  for (std::size_t i = 0; i < meshes.size(); i++)
+  {
+    records[i].vertex_offset = offset;
+    offset = AlignCacheOffset(offset + CachedVertexBytes(meshes[i]).size());
+    records[i].index_offset = offset;
+    offset = AlignCacheOffset(offset + CachedIndexBytes(meshes[i]).size());
+  }
+
+  MeshCacheHeader header{};
+  std::memcpy(header.magic, kMeshCacheMagic, sizeof(kMeshCacheMagic));
+  header.version = kMeshCacheVersion;
+  header.vertex_size = CachedVertexSize(vertex_format);
+  header.source_hash = source_hash;
+  header.import_flags = import_flags;
+  header.mesh_count = static_cast<std::uint32_t>(records.size());
+  header.texture_count = static_cast<std::uint32_t>(textures.size());
+  header.strings_size = static_cast<std::uint32_t>(strings.size());
+  header.file_size = offset;
+
+  //Write to a temporary file and rename it, a crash mid-write never leaves a valid looking cache behind
+  const std::string final_path(cache_path);
+  const std::string tmp_path = TemporaryPath(final_path);
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+
+    const auto pad_to = [&out](std::uint64_t position) {
+      static constexpr char zeros[kSectionAlignment] = {};
+      const auto current = static_cast<std::uint64_t>(out.tellp());
+      out.write(zeros, static_cast<std::streamsize>(position - current));
+    };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad_to(records_offset);
+    out.write(reinterpret_cast<const char*>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(MeshCacheRecord)));
+    pad_to(textures_offset);
+    out.write(reinterpret_cast<const char*>(textures.data()),
+              static_cast<std::streamsize>(textures.size() * sizeof(MeshCacheTexture)));
+    pad_to(strings_offset);
+    out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+    for (std::size_t i = 0; i < meshes.size(); i++)
+    {
+      const std::span<const std::byte> vertex_bytes = CachedVertexBytes(meshes[i]);
+      const std::span<const std::byte> index_bytes = CachedIndexBytes(meshes[i]);
+      pad_to(records[i].vertex_offset);
+      out.write(reinterpret_cast<const char*>(vertex_bytes.data()), static_cast<std::streamsize>(vertex_bytes.size()));
+      pad_to(records[i].index_offset);
+      out.write(reinterpret_cast<const char*>(index_bytes.data()), static_cast<std::streamsize>(index_bytes.size()));
+    }
+    pad_to(header.file_size);
+    if (!out)
+      return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tmp_path, final_path, error);
+  if (error)
+  {
+    std::filesystem::remove(tmp_path, error);
+    return false;
+  }
+  return true;
+}
+
+bool HashFile(std::string_view path, std::uint64_t& hash)
+{
+  std::ifstream file(std::string(path), std::ios::binary);
+  if (!file)
+    return false;
+
+  hash = kFnvOffsetBasis;
+  char buffer[64 * 1024];
+  while (file)
+  {
+    file.read(buffer, sizeof(buffer));
+    HashBytes(buffer, static_cast<std::size_t>(file.gcount()), hash);
+  }
+  return true;
+}
+
+bool HashFileStamp(std::string_view path, std::uint64_t& hash)
+{
+  hash = kFnvOffsetBasis;
+  return HashStamp(std::filesystem::path(path), hash);
+}
+
+bool HashModelSource(std::string_view path, std::uint64_t& hash)
+{
+  const std::filesystem::path source(path);
+  if (source.extension() != ".gltf")
+    return HashFile(path, hash);
+
+  std::ifstream file(source, std::ios::binary);
+  if (!file)
+    return false;
+  const std::string document((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  hash = kFnvOffsetBasis;
+  HashBytes(document.data(), document.size(), hash);
+
+  //The buffers are as large as the meshes, their size and write time stand in for their content
+  for (const std::string& uri : GltfBufferUris(document))
+  {
+    HashBytes(uri.data(), uri.size(), hash);
+    if (!HashStamp(source.parent_path() / uri, hash))
+      return false;
+  }
+  return true;
+}
+
+} // namespace gpr5300
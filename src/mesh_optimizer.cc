@@ -0,0 +1,374 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace gpr5300
+{
+
+namespace
+{
+//Forsyth's scoring: the LRU cache he simulates is larger than the FIFO the analysis assumes, as in his paper
+constexpr int kForsythCacheSize = 32;
+constexpr int kForsythMaxValence = 32;
+constexpr float kForsythCacheDecayPower = 1.5f;
+constexpr float kForsythLastTriangleScore = 0.75f;
+constexpr float kForsythValenceBoostScale = 2.0f;
+constexpr float kForsythValenceBoostPower = 0.5f;
+constexpr unsigned int kUnusedVertex = std::numeric_limits<unsigned int>::max();
+
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "welding compares vertices bit by bit, they can't have padding");
+using VertexBits = std::array<std::uint32_t, 8>;
+
+struct VertexBitsHash
+{
+  std::size_t operator()(const VertexBits& bits) const
+  {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (const std::uint32_t word : bits)
+    {
+      hash ^= word;
+      hash *= 1099511628211ull;
+    }
+    return static_cast<std::size_t>(hash);
+  }
+};
+
+//FIFO post-transform cache: a vertex is a hit while fewer than kVertexCacheSize misses happened since its own
+class FifoVertexCache
+{
+ public:
+  explicit FifoVertexCache(std::size_t vertex_count) : timestamps_(vertex_count, 0) {}
+
+  //true on a miss
+  bool Access(unsigned int vertex)
+  {
+    if (time_ - timestamps_[vertex] <= kVertexCacheSize)
+      return false;
+    timestamps_[vertex] = time_++;
+    return true;
+  }
+  int TriangleMisses(const unsigned int* triangle)
+  {
+    return static_cast<int>(Access(triangle[0])) + static_cast<int>(Access(triangle[1])) +
+        static_cast<int>(Access(triangle[2]));
+  }
+  void Reset() { time_ += kVertexCacheSize + 1; }
+
+ private:
+  std::vector<std::size_t> timestamps_;
+  std::size_t time_ = kVertexCacheSize + 1;
+};
+
+struct ForsythScoreTables
+{
+  std::array<float, kForsythCacheSize> cache;
+  std::array<float, kForsythMaxValence + 1> valence;
+};
+
+const ForsythScoreTables& GetForsythScoreTables()
+{
+  static const ForsythScoreTables tables = [] {
+    ForsythScoreTables result{};
+    for (int position = 0; position < kForsythCacheSize; position++)
+    {
+      //The last triangle's vertices get a fixed score, whichever order they were used in
+      result.cache[position] = position < 3 ? kForsythLastTriangleScore :
+          std::pow(1.0f - static_cast<float>(position - 3) / (kForsythCacheSize - 3), kForsythCacheDecayPower);
+    }
+    result.valence[0] = 0.0f;
+    for (int valence = 1; valence <= kForsythMaxValence; valence++)
+    {
+      //Vertices with few triangles left are worth finishing so they leave the cache for good
+      result.valence[valence] = kForsythValenceBoostScale *
+          std::pow(static_cast<float>(valence), -kForsythValenceBoostPower);
+    }
+    return result;
+  }();
+  return tables;
+}
+
+float ForsythVertexScore(int cache_position, unsigned int remaining_triangles)
+{
+  if (remaining_triangles == 0)
+    return -1.0f;
+  const ForsythScoreTables& tables = GetForsythScoreTables();
+  const float cache_score = cache_position >= 0 ? tables.cache[cache_position] : 0.0f;
+  return cache_score + tables.valence[std::min<unsigned int>(remaining_triangles, kForsythMaxValence)];
+}
+}
+
+VertexCacheStats AnalyzeVertexCache(std::span<const unsigned int> indices, std::size_t vertex_count)
+{
+  VertexCacheStats stats;
+  const std::size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0 || vertex_count == 0)
+    return stats;
+  FifoVertexCache cache(vertex_count);
+  std::size_t misses = 0;
+  for (std::size_t i = 0; i < triangle_count * 3; i += 3)
+    misses += static_cast<std::size_t>(cache.TriangleMisses(indices.data() + i));
+  stats.acmr = static_cast<float>(misses) / static_cast<float>(triangle_count);
+  stats.atvr = static_cast<float>(misses) / static_cast<float>(vertex_count);
+  return stats;
+}
+
+std::size_t WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+  std::unordered_map<VertexBits, unsigned int, VertexBitsHash> unique;
+  unique.reserve(vertices.size());
+  std::vector<unsigned int> remap(vertices.size());
+  std::vector<Vertex> welded;
+  welded.reserve(vertices.size());
+  for (std::size_t i = 0; i < vertices.size(); i++)
+  {
+    VertexBits bits;
+    std::memcpy(bits.data(), &vertices[i], sizeof(Vertex));
+    const auto [it, inserted] = unique.try_emplace(bits, static_cast<unsigned int>(welded.size()));
+    if (inserted)
+      welded.push_back(vertices[i]);
+    remap[i] = it->second;
+  }
+  for (unsigned int& index : indices)
+    index = remap[index];
+  vertices = std::move(welded);
+  return vertices.size();
+}
+
+void OptimizeVertexCache(std::vector<unsigned int>& indices, std::size_t vertex_count)
+{
+  const std::size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+    return;
+
+  //Triangles of every vertex, the live ones are kept at the front of each range
+  std::vector<unsigned int> remaining(vertex_count, 0);
+  for (const unsigned int index : indices)
+    remaining[index]++;
+  std::vector<std::size_t> adjacency_offsets(vertex_count + 1, 0);
+  for (std::size_t v = 0; v < vertex_count; v++)
+    adjacency_offsets[v + 1] = adjacency_offsets[v] + remaining[v];
+  std::vector<unsigned int> adjacency(indices.size());
+  {
+    std::vector<std::size_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); i++)
+      adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+  }
+
+  std::vector<int> cache_positions(vertex_count, -1);
+  std::vector<float> vertex_scores(vertex_count);
+  for (std::size_t v = 0; v < vertex_count; v++)
+    vertex_scores[v] = ForsythVertexScore(-1, remaining[v]);
+  std::vector<float> triangle_scores(triangle_count);
+  std::vector<bool> emitted(triangle_count, false);
+  std::size_t best = 0;
+  for (std::size_t t = 0; t < triangle_count; t++)
+  {
+    triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] +
+        vertex_scores[indices[t * 3 + 2]];
+    if (triangle_scores[t] > triangle_scores[best])
+      best = t;
+  }
+
+  std::vector<unsigned int> output;
+  output.reserve(indices.size());
+  std::vector<unsigned int> cache;
+  std::vector<unsigned int> next_cache;
+  cache.reserve(kForsythCacheSize + 3);
+  next_cache.reserve(kForsythCacheSize + 3);
+  std::size_t next_unemitted = 0;
+  for (std::size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+  {
+    //Nothing in the cache has triangles left: start over from the first triangle not drawn yet
+    if (best == triangle_count)
+    {
+      while (emitted[next_unemitted])
+        next_unemitted++;
+      best = next_unemitted;
+    }
+    const unsigned int* triangle = indices.data() + best * 3;
+    output.insert(output.end(), triangle, triangle + 3);
+    emitted[best] = true;
+    for (int corner = 0; corner < 3; corner++)
+    {
+      const unsigned int v = triangle[corner];
+      unsigned int* first = adjacency.data() + adjacency_offsets[v];
+      unsigned int* last = first + remaining[v];
+      std::iter_swap(std::find(first, last, static_cast<unsigned int>(best)), last - 1);
+      remaining[v]--;
+    }
+
+    //LRU: the triangle's vertices move to the front, whatever falls past the end is evicted
+    next_cache.assign(triangle, triangle + 3);
+    for (const unsigned int v : cache)
+    {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+        next_cache.push_back(v);
+    }
+    for (std::size_t i = 0; i < next_cache.size(); i++)
+    {
+      const unsigned int v = next_cache[i];
+      cache_positions[v] = i < static_cast<std::size_t>(kForsythCacheSize) ? static_cast<int>(i) : -1;
+      vertex_scores[v] = ForsythVertexScore(cache_positions[v], remaining[v]);
+    }
+
+    //Only the triangles around the touched vertices changed score, the next best is among them
+    best = triangle_count;
+    float best_score = -1.0f;
+    for (const unsigned int v : next_cache)
+    {
+      for (std::size_t a = adjacency_offsets[v]; a < adjacency_offsets[v] + remaining[v]; a++)
+      {
+        const unsigned int t = adjacency[a];
+        triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] +
+            vertex_scores[indices[t * 3 + 2]];
+        if (triangle_scores[t] > best_score)
+        {
+          best_score = triangle_scores[t];
+          best = t;
+        }
+      }
+    }
+    if (next_cache.size() > static_cast<std::size_t>(kForsythCacheSize))
+      next_cache.resize(kForsythCacheSize);
+    std::swap(cache, next_cache);
+  }
+  indices = std::move(output);
+}
+
+void OptimizeOverdraw(std::vector<unsigned int>& indices, std::span<const Vertex> vertices, float threshold)
+{
+  const std::size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+    return;
+
+  //Hard boundaries: the cache is empty anyway where a triangle misses all of its vertices
+  std::vector<std::size_t> hard_starts;
+  {
+    FifoVertexCache cache(vertices.size());
+    for (std::size_t t = 0; t < triangle_count; t++)
+    {
+      if (cache.TriangleMisses(indices.data() + t * 3) == 3)
+        hard_starts.push_back(t);
+    }
+  }
+  hard_starts.push_back(triangle_count);
+
+  //Soft boundaries: a run is cut where its own miss rate is back within threshold of the hard cluster's
+  std::vector<std::size_t> starts;
+  FifoVertexCache cache(vertices.size());
+  for (std::size_t h = 0; h + 1 < hard_starts.size(); h++)
+  {
+    const std::size_t begin = hard_starts[h];
+    const std::size_t end = hard_starts[h + 1];
+    cache.Reset();
+    std::size_t cluster_misses = 0;
+    for (std::size_t t = begin; t < end; t++)
+      cluster_misses += static_cast<std::size_t>(cache.TriangleMisses(indices.data() + t * 3));
+    const float cluster_threshold = threshold * static_cast<float>(cluster_misses) / static_cast<float>(end - begin);
+
+    cache.Reset();
+    std::size_t start = begin;
+    std::size_t misses = 0;
+    starts.push_back(begin);
+    for (std::size_t t = begin; t + 1 < end; t++)
+    {
+      misses += static_cast<std::size_t>(cache.TriangleMisses(indices.data() + t * 3));
+      if (static_cast<float>(misses) <= cluster_threshold * static_cast<float>(t + 1 - start))
+      {
+        start = t + 1;
+        misses = 0;
+        starts.push_back(start);
+        cache.Reset();
+      }
+    }
+  }
+  starts.push_back(triangle_count);
+
+  //Area weighted centroid and normal of every cluster, sorted by how much they face out of the mesh
+  glm::vec3 mesh_centroid(0.0f);
+  float mesh_area = 0.0f;
+  const std::size_t cluster_count = starts.size() - 1;
+  std::vector<glm::vec3> centroids(cluster_count, glm::vec3(0.0f));
+  std::vector<glm::vec3> normals(cluster_count, glm::vec3(0.0f));
+  for (std::size_t c = 0; c < cluster_count; c++)
+  {
+    float cluster_area = 0.0f;
+    for (std::size_t t = starts[c]; t < starts[c + 1]; t++)
+    {
+      const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+      const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+      const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+      const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      const float area = glm::length(normal);
+      centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+      normals[c] += normal;
+      cluster_area += area;
+    }
+    mesh_centroid += centroids[c];
+    mesh_area += cluster_area;
+    centroids[c] = cluster_area > 0.0f ? centroids[c] / cluster_area : vertices[indices[starts[c] * 3]].Position;
+  }
+  if (mesh_area > 0.0f)
+    mesh_centroid /= mesh_area;
+
+  std::vector<float> sort_keys(cluster_count);
+  std::vector<std::size_t> order(cluster_count);
+  for (std::size_t c = 0; c < cluster_count; c++)
+  {
+    const float length = glm::length(normals[c]);
+    sort_keys[c] = length > 0.0f ? glm::dot(centroids[c] - mesh_centroid, normals[c] / length) : 0.0f;
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&sort_keys](std::size_t a, std::size_t b) { return sort_keys[a] > sort_keys[b]; });
+
+  std::vector<unsigned int> output;
+  output.reserve(indices.size());
+  for (const std::size_t c : order)
+    output.insert(output.end(), indices.begin() + static_cast<std::ptrdiff_t>(starts[c] * 3),
+                  indices.begin() + static_cast<std::ptrdiff_t>(starts[c + 1] * 3));
+  indices = std::move(output);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+  std::vector<unsigned int> remap(vertices.size(), kUnusedVertex);
+  std::vector<Vertex> ordered;
+  ordered.reserve(vertices.size());
+  for (unsigned int& index : indices)
+  {
+    if (remap[index] == kUnusedVertex)
+    {
+      remap[index] = static_cast<unsigned int>(ordered.size());
+      ordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices = std::move(ordered);
+}
+
+MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+  MeshOptimizationReport report;
+  report.vertices_before = vertices.size();
+  report.before = AnalyzeVertexCache(indices, vertices.size());
+  //Lines and points left by the triangulation are kept as they are
+  if (!indices.empty() && indices.size() % 3 == 0)
+  {
+    WeldVertices(vertices, indices);
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+  }
+  report.vertices_after = vertices.size();
+  report.after = AnalyzeVertexCache(indices, vertices.size());
+  return report;
+}
+
+} // namespace gpr5300
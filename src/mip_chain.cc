@@ -0,0 +1,254 @@
+#include "mip_chain.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <future>
+
+#include "cpu_profiler.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_CHAIN_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIP_CHAIN_SSE
+#endif
+
+namespace gpr5300
+{
+
+namespace
+{
+//Target rows filtered by one pool job
+constexpr int kMipRowsPerJob = 32;
+//Linear to sRGB is a table lookup, fine enough that every 8 bit value survives the round trip
+constexpr int kSrgbEncodeSize = 16384;
+
+struct SrgbTables
+{
+  std::array<float, 256> decode;
+  std::array<float, 256> linear;
+  std::array<std::uint8_t, kSrgbEncodeSize> encode;
+};
+
+const SrgbTables& GetSrgbTables()
+{
+  static const SrgbTables tables = [] {
+    SrgbTables result{};
+    for (int i = 0; i < 256; i++)
+    {
+      const float c = static_cast<float>(i) / 255.0f;
+      result.decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+      result.linear[i] = c;
+    }
+    for (int i = 0; i < kSrgbEncodeSize; i++)
+    {
+      const float l = static_cast<float>(i) / (kSrgbEncodeSize - 1);
+      const float s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      result.encode[i] = static_cast<std::uint8_t>(std::lround(std::clamp(s, 0.0f, 1.0f) * 255.0f));
+    }
+    return result;
+  }();
+  return tables;
+}
+
+//The channel count is a template parameter so the inner loops have no branch left, the padding lanes of the row
+//buffers are zeroed once and never written
+//Floats per texel while filtering: 3 and 2 channel images are padded to 4 so a texel is one SSE register
+template<int Channels>
+constexpr int kMipLanes = Channels == 1 ? 1 : 4;
+
+template<int Channels>
+void DecodeMipRow(const std::uint8_t* row, int width, const std::array<const float*, 4>& tables, float* target)
+{
+  constexpr int kLanes = kMipLanes<Channels>;
+  for (int x = 0; x < width; x++)
+  {
+    for (int c = 0; c < Channels; c++)
+      target[x * kLanes + c] = tables[c][row[x * Channels + c]];
+  }
+}
+
+template<int Channels>
+void EncodeMipRow(const float* row, int width, int srgb_channels, std::uint8_t* target)
+{
+  constexpr int kLanes = kMipLanes<Channels>;
+  const SrgbTables& tables = GetSrgbTables();
+  for (int x = 0; x < width; x++)
+  {
+    for (int c = 0; c < Channels; c++)
+    {
+      const float value = std::clamp(row[x * kLanes + c], 0.0f, 1.0f);
+      target[x * Channels + c] = c < srgb_channels ?
+          tables.encode[static_cast<int>(value * (kSrgbEncodeSize - 1) + 0.5f)] :
+          static_cast<std::uint8_t>(value * 255.0f + 0.5f);
+    }
+  }
+}
+
+//Averages the 2x2 texels of two source rows. The vector loops handle the target texels whose source pair is fully
+//inside the row, the scalar loop the rest and the clamped last texel of odd widths.
+void FilterMipRow(const float* row0, const float* row1, int width, int lanes, float* target, int target_width)
+{
+  const int paired = width / 2;
+  int x = 0;
+  if (lanes == 4)
+  {
+#if defined(MIP_CHAIN_AVX2)
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    for (; x + 2 <= paired; x += 2)
+    {
+      //a holds source texels 2x and 2x+1, b 2x+2 and 2x+3: swapping halves lines up the pairs
+      const __m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8), _mm256_loadu_ps(row1 + x * 8));
+      const __m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8 + 8), _mm256_loadu_ps(row1 + x * 8 + 8));
+      const __m256 even = _mm256_permute2f128_ps(a, b, 0x20);
+      const __m256 odd = _mm256_permute2f128_ps(a, b, 0x31);
+      _mm256_storeu_ps(target + x * 4, _mm256_mul_ps(_mm256_add_ps(even, odd), quarter));
+    }
+#endif
+#if defined(MIP_CHAIN_SSE)
+    for (; x < paired; x++)
+    {
+      const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4)),
+                                    _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4)));
+      _mm_storeu_ps(target + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+    }
+#endif
+  }
+  else
+  {
+#if defined(MIP_CHAIN_AVX2)
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    for (; x + 8 <= paired; x += 8)
+    {
+      const __m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 2), _mm256_loadu_ps(row1 + x * 2));
+      const __m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 2 + 8), _mm256_loadu_ps(row1 + x * 2 + 8));
+      //hadd works per 128 bit half, the 64 bit quarters come out as a0-3 b0-3 a4-7 b4-7
+      const __m256 sums = _mm256_hadd_ps(a, b);
+      const __m256 ordered = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sums), 0xD8));
+      _mm256_storeu_ps(target + x, _mm256_mul_ps(ordered, quarter));
+    }
+#endif
+#if defined(MIP_CHAIN_SSE)
+    for (; x + 4 <= paired; x += 4)
+    {
+      const __m128 a = _mm_add_ps(_mm_loadu_ps(row0 + x * 2), _mm_loadu_ps(row1 + x * 2));
+      const __m128 b = _mm_add_ps(_mm_loadu_ps(row0 + x * 2 + 4), _mm_loadu_ps(row1 + x * 2 + 4));
+      const __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm_storeu_ps(target + x, _mm_mul_ps(_mm_add_ps(even, odd), _mm_set1_ps(0.25f)));
+    }
+#endif
+  }
+  //remainder, or everything on targets without SIMD
+  for (; x < target_width; x++)
+  {
+    const int x0 = std::min(x * 2, width - 1);
+    const int x1 = std::min(x * 2 + 1, width - 1);
+    for (int c = 0; c < lanes; c++)
+    {
+      target[x * lanes + c] = (row0[x0 * lanes + c] + row0[x1 * lanes + c] +
+          row1[x0 * lanes + c] + row1[x1 * lanes + c]) * 0.25f;
+    }
+  }
+}
+
+//Runs job over [0, rows) in bands on pool, or inline without one
+template<typename Job>
+void ForEachMipRowBand(ThreadPool* pool, int rows, const Job& job)
+{
+  if (!pool)
+  {
+    job(0, rows);
+    return;
+  }
+  std::vector<std::future<void>> jobs;
+  for (int row = 0; row < rows; row += kMipRowsPerJob)
+  {
+    const int last_row = std::min(row + kMipRowsPerJob, rows);
+    jobs.push_back(pool->Submit([&job, row, last_row] { job(row, last_row); }));
+  }
+  for (std::future<void>& band : jobs)
+    band.get();
+}
+
+//Filters target from the 8 bit level above it: only a few rows per band are ever held in float
+template<int Channels>
+void FilterMipLevel(const std::uint8_t* source, const MipLevel& source_level, std::uint8_t* target,
+                    const MipLevel& target_level, int srgb_channels, ThreadPool* pool)
+{
+  constexpr int kLanes = kMipLanes<Channels>;
+  const SrgbTables& tables = GetSrgbTables();
+  std::array<const float*, 4> decode_tables;
+  for (int c = 0; c < 4; c++)
+    decode_tables[c] = c < srgb_channels ? tables.decode.data() : tables.linear.data();
+
+  const std::size_t source_stride = static_cast<std::size_t>(source_level.width) * Channels;
+  const std::size_t target_stride = static_cast<std::size_t>(target_level.width) * Channels;
+  ForEachMipRowBand(pool, target_level.height, [&](int first_row, int last_row) {
+    std::vector<float> rows((static_cast<std::size_t>(source_level.width) * 2 + target_level.width) * kLanes);
+    float* row0 = rows.data();
+    float* row1 = row0 + static_cast<std::size_t>(source_level.width) * kLanes;
+    float* filtered = row1 + static_cast<std::size_t>(source_level.width) * kLanes;
+    for (int y = first_row; y < last_row; y++)
+    {
+      const int y0 = std::min(y * 2, source_level.height - 1);
+      const int y1 = std::min(y * 2 + 1, source_level.height - 1);
+      DecodeMipRow<Channels>(source + y0 * source_stride, source_level.width, decode_tables, row0);
+      DecodeMipRow<Channels>(source + y1 * source_stride, source_level.width, decode_tables, row1);
+      FilterMipRow(row0, row1, source_level.width, kLanes, filtered, target_level.width);
+      EncodeMipRow<Channels>(filtered, target_level.width, srgb_channels, target + y * target_stride);
+    }
+  });
+}
+}
+
+MipChain GenerateMipChain(const std::uint8_t* pixels, int width, int height, int channels, bool srgb,
+                          ThreadPool* pool)
+{
+  CpuZone zone("Generate mips");
+  MipChain chain;
+  chain.channels = channels;
+  std::size_t offset = 0;
+  int level_width = width;
+  int level_height = height;
+  while (true)
+  {
+    chain.levels.push_back({level_width, level_height, offset});
+    offset += static_cast<std::size_t>(level_width) * level_height * channels;
+    if (level_width == 1 && level_height == 1)
+      break;
+    level_width = std::max(1, level_width / 2);
+    level_height = std::max(1, level_height / 2);
+  }
+  chain.data.resize(offset);
+  std::memcpy(chain.data.data(), pixels, static_cast<std::size_t>(width) * height * channels);
+
+  const int srgb_channels = srgb && channels >= 3 ? 3 : 0;
+  for (std::size_t level = 1; level < chain.levels.size(); level++)
+  {
+    const std::uint8_t* source = chain.level_data(level - 1);
+    std::uint8_t* target = chain.data.data() + chain.levels[level].offset;
+    switch (channels)
+    {
+      case 1:
+        FilterMipLevel<1>(source, chain.levels[level - 1], target, chain.levels[level], srgb_channels, pool);
+        break;
+      case 2:
+        FilterMipLevel<2>(source, chain.levels[level - 1], target, chain.levels[level], srgb_channels, pool);
+        break;
+      case 3:
+        FilterMipLevel<3>(source, chain.levels[level - 1], target, chain.levels[level], srgb_channels, pool);
+        break;
+      default:
+        FilterMipLevel<4>(source, chain.levels[level - 1], target, chain.levels[level], srgb_channels, pool);
+        break;
+    }
+  }
+  return chain;
+}
+
+} // namespace gpr5300
@@ -0,0 +1,180 @@
+#include "model_loader.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "cpu_profiler.h"
+
+ModelHandle ModelLoader::Load(const std::string& path, VertexFormat vertex_format, GeometryArena* arena)
+{
+  auto entry = std::make_unique<Entry>();
+  entry->path = path;
+  entry->vertex_format = vertex_format;
+  entry->model.set_vertex_format(vertex_format);
+  entry->model.set_geometry_arena(arena);
+  entry->start = std::chrono::steady_clock::now();
+  //The import only depends on the path and the layout, the meshes are uploaded for each model
+  const auto same_import = std::find_if(entries_.begin(), entries_.end(), [&](const std::unique_ptr<Entry>& other) {
+    return other->path == path && other->vertex_format == vertex_format;
+  });
+  if (same_import != entries_.end())
+  {
+    entry->import = (*same_import)->import;
+  }
+  else
+  {
+    entry->import = gpr5300::LoaderPool().Submit([path, vertex_format]() -> std::shared_ptr<const ModelData> {
+      gpr5300::CpuZone zone("Import model");
+      auto data = std::make_shared<ModelData>();
+      if (!Model::Import(path, *data, vertex_format))
+        return nullptr;
+      return data;
+    }).share();
+  }
+  entries_.push_back(std::move(entry));
+  return static_cast<ModelHandle>(entries_.size() - 1);
+}
+
+TextureHandle ModelLoader::LoadTexture(const std::string& path, gpr5300::TextureRole role)
+{
+  TextureEntry& entry = textures_.emplace_back();
+  entry.path = path;
+  //Already on a loader thread: a first load compresses on it alone instead of waiting on the pool it runs on
+  entry.texture = gpr5300::LoaderPool().Submit([path, role] {
+    gpr5300::CpuZone zone("Load texture");
+    return LoadCompressedTexture(path.c_str(), role);
+  });
+  return static_cast<TextureHandle>(textures_.size() - 1);
+}
+
+TextureHandle ModelLoader::LoadCubemap(std::span<const std::string_view> face_paths)
+{
+  TextureEntry& entry = textures_.emplace_back();
+  entry.path = face_paths.empty() ? std::string() : std::string(face_paths.front());
+  for (const std::string_view face_path : face_paths)
+  {
+    entry.faces.push_back(gpr5300::LoaderPool().Submit([path = std::string(face_path)] {
+      return DecodeImage(path.c_str());
+    }));
+  }
+  return static_cast<TextureHandle>(textures_.size() - 1);
+}
+
+void ModelLoader::FinishTexture(TextureEntry& entry)
+{
+  glGenTextures(1, &entry.id);
+  bool loaded = false;
+  if (entry.faces.empty())
+  {
+    const gpr5300::CompressedTexture texture = entry.texture.get();
+    loaded = !texture.empty();
+    if (loaded)
+      UploadCompressedTexture(entry.id, texture);
+  }
+  else
+  {
+    std::vector<Image> faces;
+    for (std::future<Image>& face : entry.faces)
+      faces.push_back(face.get());
+    entry.faces.clear();
+    loaded = UploadCubemap(entry.id, faces);
+    for (Image& face : faces)
+      FreeImage(face);
+  }
+  if (!loaded)
+  {
+    std::cerr << "Could not load texture " << entry.path << "\n";
+    glDeleteTextures(1, &entry.id);
+    entry.id = 0;
+  }
+  entry.state = loaded ? State::kResident : State::kFailed;
+}
+
+void ModelLoader::Update(float budget_ms)
+{
+  gpr5300::CpuZone zone("Model streaming");
+  const auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float, std::milli>(budget_ms));
+
+  //Finished imports only queue their textures here, it is cheap enough to ignore the budget
+  for (const std::unique_ptr<Entry>& entry : entries_)
+  {
+    if (entry->state != State::kImporting ||
+        entry->import.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      continue;
+
+    std::shared_ptr<const ModelData> data = entry->import.get();
+    if (!data)
+    {
+      std::cerr << "Could not load model " << entry->path << "\n";
+      entry->state = State::kFailed;
+      continue;
+    }
+    entry->bounding_box = data->bounding_box;
+    entry->model.BeginUpload(std::move(data));
+    entry->state = State::kUploading;
+  }
+
+  //A texture is one upload, done before the meshes so they don't take the whole budget
+  for (TextureEntry& entry : textures_)
+  {
+    if (entry.state != State::kImporting || std::chrono::steady_clock::now() >= deadline)
+      continue;
+    const auto ready = [](const auto& future) {
+      return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    if (entry.faces.empty() ? ready(entry.texture) : std::ranges::all_of(entry.faces, ready))
+      FinishTexture(entry);
+  }
+
+  for (const std::unique_ptr<Entry>& entry : entries_)
+  {
+    if (entry->state != State::kUploading)
+      continue;
+    while (std::chrono::steady_clock::now() < deadline && entry->model.UploadStep())
+    {
+    }
+    if (entry->model.resident())
+    {
+      entry->state = State::kResident;
+      const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - entry->start;
+      std::cout << "Streamed " << entry->path << " in " << duration.count() << " ms\n";
+    }
+  }
+}
+
+Model* ModelLoader::Get(ModelHandle handle) const
+{
+  if (handle >= entries_.size() || entries_[handle]->state != State::kResident)
+    return nullptr;
+  return &entries_[handle]->model;
+}
+
+bool ModelLoader::GetBoundingBox(ModelHandle handle, glm::vec3& min, glm::vec3& max) const
+{
+  if (handle >= entries_.size())
+    return false;
+  const Entry& entry = *entries_[handle];
+  if (entry.state != State::kUploading && entry.state != State::kResident)
+    return false;
+  min = entry.bounding_box.min;
+  max = entry.bounding_box.max;
+  return true;
+}
+
+unsigned int ModelLoader::GetTexture(TextureHandle handle) const
+{
+  if (handle >= textures_.size() || textures_[handle].state != State::kResident)
+    return 0;
+  return textures_[handle].id;
+}
+
+bool ModelLoader::idle() const
+{
+  for (const std::unique_ptr<Entry>& entry : entries_)
+  {
+    if (entry->state == State::kImporting || entry->state == State::kUploading)
+      return false;
+  }
+  return std::ranges::none_of(textures_, [](const TextureEntry& entry) { return entry.state == State::kImporting; });
+}
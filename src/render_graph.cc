@@ -0,0 +1,180 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#include <imgui.h>
+
+namespace
+{
+constexpr std::size_t kNoRenderPass = std::numeric_limits<std::size_t>::max();
+}
+
+RenderResource RenderGraph::Create(const char* name, const RenderTargetDesc& desc)
+{
+  resources_.push_back({name, desc});
+  return static_cast<RenderResource>(resources_.size() - 1);
+}
+
+RenderResource RenderGraph::Import(const char* name, GLuint texture)
+{
+  resources_.push_back({name, {}, texture, true});
+  return static_cast<RenderResource>(resources_.size() - 1);
+}
+
+void RenderGraph::AddPass(const char* name, RenderPassDesc desc, std::function<void()> execute)
+{
+  passes_.push_back({name, std::move(desc), std::move(execute)});
+}
+
+GLuint RenderGraph::texture(RenderResource resource) const
+{
+  return resource < resources_.size() ? resources_[resource].texture : 0;
+}
+
+void RenderGraph::Compile()
+{
+  //A pass depends on the last pass that wrote anything it reads or writes on top of
+  std::vector<std::size_t> last_writer(resources_.size(), kNoRenderPass);
+  for (std::size_t i = 0; i < passes_.size(); i++)
+  {
+    Pass& pass = passes_[i];
+    for (const RenderResource read : pass.desc.reads)
+    {
+      if (last_writer[read] != kNoRenderPass)
+        pass.dependencies.push_back(last_writer[read]);
+      else if (!resources_[read].imported)
+        std::cerr << "Render pass " << pass.name << " reads " << resources_[read].name << " before it is written\n";
+    }
+    const auto write = [&](RenderResource resource) {
+      if (last_writer[resource] != kNoRenderPass)
+        pass.dependencies.push_back(last_writer[resource]);
+      last_writer[resource] = i;
+    };
+    std::ranges::for_each(pass.desc.colors, write);
+    std::ranges::for_each(pass.desc.writes, write);
+    if (pass.desc.depth != kNoRenderResource)
+      write(pass.desc.depth);
+  }
+
+  //Live: an output, or a dependency of a live pass
+  std::vector<std::size_t> stack;
+  for (std::size_t i = 0; i < passes_.size(); i++)
+  {
+    if (passes_[i].desc.output)
+    {
+      passes_[i].live = true;
+      stack.push_back(i);
+    }
+  }
+  while (!stack.empty())
+  {
+    const std::size_t index = stack.back();
+    stack.pop_back();
+    for (const std::size_t dependency : passes_[index].dependencies)
+    {
+      if (!passes_[dependency].live)
+      {
+        passes_[dependency].live = true;
+        stack.push_back(dependency);
+      }
+    }
+  }
+
+  //A target is only held from the first to the last live pass touching it
+  for (Resource& resource : resources_)
+  {
+    resource.first_pass = kNoRenderPass;
+    resource.last_pass = 0;
+  }
+  for (std::size_t i = 0; i < passes_.size(); i++)
+  {
+    if (!passes_[i].live)
+      continue;
+    const auto use = [&](RenderResource resource) {
+      resources_[resource].first_pass = std::min(resources_[resource].first_pass, i);
+      resources_[resource].last_pass = std::max(resources_[resource].last_pass, i);
+    };
+    std::ranges::for_each(passes_[i].desc.reads, use);
+    std::ranges::for_each(passes_[i].desc.colors, use);
+    std::ranges::for_each(passes_[i].desc.writes, use);
+    if (passes_[i].desc.depth != kNoRenderResource)
+      use(passes_[i].desc.depth);
+  }
+}
+
+void RenderGraph::Execute(RenderTargetPool& pool, GpuProfiler* profiler)
+{
+  Compile();
+
+  std::vector<GLuint> textures;
+  for (std::size_t i = 0; i < passes_.size(); i++)
+  {
+    Pass& pass = passes_[i];
+    if (!pass.live)
+      continue;
+    for (Resource& resource : resources_)
+    {
+      if (resource.first_pass == i && !resource.imported)
+      {
+        resource.texture = pool.Acquire(resource.desc);
+        if (std::ranges::find(textures, resource.texture) == textures.end())
+          textures.push_back(resource.texture);
+      }
+    }
+
+    const RenderResource sized = !pass.desc.colors.empty() ? pass.desc.colors.front() : pass.desc.depth;
+    if (sized != kNoRenderResource)
+    {
+      std::array<GLuint, RenderTargetPool::kMaxColorAttachments> colors{};
+      const std::size_t color_count = std::min(pass.desc.colors.size(), colors.size());
+      for (std::size_t c = 0; c < color_count; c++)
+      {
+        colors[c] = resources_[pass.desc.colors[c]].texture;
+      }
+      glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer(std::span<const GLuint>(colors.data(), color_count),
+                                                         texture(pass.desc.depth)));
+      glViewport(0, 0, resources_[sized].desc.width, resources_[sized].desc.height);
+    }
+
+    if (profiler)
+      profiler->BeginZone(pass.name);
+    pass.execute();
+    if (profiler)
+      profiler->EndZone();
+
+    for (Resource& resource : resources_)
+    {
+      if (resource.first_pass != kNoRenderPass && resource.last_pass == i && !resource.imported)
+      {
+        pool.Release(resource.texture);
+        resource.texture = 0;
+      }
+    }
+  }
+
+  last_passes_.clear();
+  for (const Pass& pass : passes_)
+  {
+    last_passes_.push_back({pass.name, pass.live});
+  }
+  last_resource_count_ = resources_.size();
+  last_texture_count_ = textures.size();
+  passes_.clear();
+  resources_.clear();
+}
+
+void RenderGraph::DrawImGui() const
+{
+  if (!ImGui::CollapsingHeader("Render graph"))
+    return;
+  ImGui::Text("%zu targets in %zu textures", last_resource_count_, last_texture_count_);
+  for (const PassStats& pass : last_passes_)
+  {
+    if (pass.live)
+      ImGui::Text("%s", pass.name);
+    else
+      ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "%s (culled)", pass.name);
+  }
+}
@@ -0,0 +1,187 @@
+#include "render_target_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <imgui.h>
+
+namespace
+{
+bool IsDepthStencilFormat(GLenum internal_format)
+{
+  return internal_format == GL_DEPTH24_STENCIL8 || internal_format == GL_DEPTH32F_STENCIL8;
+}
+
+std::size_t RenderTargetBytesPerPixel(GLenum internal_format)
+{
+  switch (internal_format)
+  {
+    case GL_R8:
+      return 1;
+    case GL_RGBA16F:
+    case GL_DEPTH32F_STENCIL8:
+      return 8;
+    case GL_RGBA32F:
+      return 16;
+    default:
+      return 4;
+  }
+}
+}
+
+GLuint RenderTargetPool::Acquire(const RenderTargetDesc& desc)
+{
+  for (Target& target : targets_)
+  {
+    if (!target.in_use && target.desc == desc)
+    {
+      target.in_use = true;
+      target.last_used_frame = frame_;
+      return target.texture;
+    }
+  }
+
+  Target target;
+  target.desc = desc;
+  target.in_use = true;
+  target.last_used_frame = frame_;
+  glGenTextures(1, &target.texture);
+  glBindTexture(GL_TEXTURE_2D, target.texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, desc.internal_format, desc.width, desc.height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, static_cast<GLint>(desc.filter));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, static_cast<GLint>(desc.filter));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  targets_.push_back(target);
+  return target.texture;
+}
+
+void RenderTargetPool::Release(GLuint texture)
+{
+  const auto it = std::ranges::find(targets_, texture, &Target::texture);
+  if (it == targets_.end() || !it->in_use)
+  {
+    std::cerr << "Render target " << texture << " released but not acquired\n";
+    return;
+  }
+  it->in_use = false;
+  it->last_used_frame = frame_;
+}
+
+const RenderTargetPool::Target* RenderTargetPool::Find(GLuint texture) const
+{
+  const auto it = std::ranges::find(targets_, texture, &Target::texture);
+  return it != targets_.end() ? &*it : nullptr;
+}
+
+GLuint RenderTargetPool::Framebuffer(std::initializer_list<GLuint> colors, GLuint depth)
+{
+  return Framebuffer(std::span<const GLuint>(colors.begin(), colors.size()), depth);
+}
+
+GLuint RenderTargetPool::Framebuffer(std::span<const GLuint> colors, GLuint depth)
+{
+  CachedFramebuffer key;
+  if (colors.size() > kMaxColorAttachments)
+  {
+    std::cerr << "Render target framebuffers take at most " << kMaxColorAttachments << " color attachments\n";
+    return 0;
+  }
+  std::ranges::copy(colors, key.colors.begin());
+  key.depth = depth;
+  for (const CachedFramebuffer& cached : framebuffers_)
+  {
+    if (cached.colors == key.colors && cached.depth == key.depth)
+      return cached.framebuffer;
+  }
+
+  //Built without disturbing the framebuffer the caller may have bound
+  GLint previous = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  glGenFramebuffers(1, &key.framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, key.framebuffer);
+  GLenum draw_buffers[kMaxColorAttachments] = {};
+  GLsizei color_count = 0;
+  for (const GLuint color : colors)
+  {
+    draw_buffers[color_count] = GL_COLOR_ATTACHMENT0 + color_count;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, draw_buffers[color_count], GL_TEXTURE_2D, color, 0);
+    color_count++;
+  }
+  if (color_count > 0)
+  {
+    glDrawBuffers(color_count, draw_buffers);
+  }
+  else
+  {
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+  if (depth != 0)
+  {
+    const Target* target = Find(depth);
+    const GLenum attachment = target && IsDepthStencilFormat(target->desc.internal_format)
+                                  ? GL_DEPTH_STENCIL_ATTACHMENT
+                                  : GL_DEPTH_ATTACHMENT;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, depth, 0);
+  }
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "Render target framebuffer not complete!\n";
+  glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previous));
+
+  framebuffers_.push_back(key);
+  return key.framebuffer;
+}
+
+void RenderTargetPool::EndFrame()
+{
+  std::erase_if(targets_, [this](const Target& target) {
+    if (target.in_use || frame_ - target.last_used_frame < kMaxUnusedFrames)
+      return false;
+    //The framebuffers it was attached to go with it
+    std::erase_if(framebuffers_, [&target](const CachedFramebuffer& cached) {
+      const bool attached = cached.depth == target.texture || std::ranges::find(cached.colors, target.texture) !=
+          cached.colors.end();
+      if (attached)
+        glDeleteFramebuffers(1, &cached.framebuffer);
+      return attached;
+    });
+    glDeleteTextures(1, &target.texture);
+    return true;
+  });
+  frame_++;
+}
+
+void RenderTargetPool::Clear()
+{
+  for (const CachedFramebuffer& cached : framebuffers_)
+  {
+    glDeleteFramebuffers(1, &cached.framebuffer);
+  }
+  for (const Target& target : targets_)
+  {
+    glDeleteTextures(1, &target.texture);
+  }
+  framebuffers_.clear();
+  targets_.clear();
+}
+
+void RenderTargetPool::DrawImGui() const
+{
+  if (!ImGui::CollapsingHeader("Render targets"))
+    return;
+  std::size_t bytes = 0;
+  for (const Target& target : targets_)
+  {
+    bytes += static_cast<std::size_t>(target.desc.width) * target.desc.height *
+        RenderTargetBytesPerPixel(target.desc.internal_format);
+  }
+  ImGui::Text("%zu textures, %.1f MB, %zu framebuffers", targets_.size(), static_cast<double>(bytes) / (1024.0 * 1024.0),
+              framebuffers_.size());
+  for (const Target& target : targets_)
+  {
+    ImGui::Text("%4dx%-4d format 0x%04X%s", target.desc.width, target.desc.height, target.desc.internal_format,
+                target.in_use ? "  in use" : "");
+  }
+}
@@ -0,0 +1,170 @@
+#include "ssao_pass.h"
+
+#include <algorithm>
+#include <array>
+#include <random>
+
+#include <glm/glm.hpp>
+#include <imgui.h>
+
+void SsaoPass::Create()
+{
+  depth_downsample_ = Shader("data/shaders/fullscreen.vert", "data/shaders/saso/depth_downsample.frag");
+  ssao_ = Shader("data/shaders/fullscreen.vert", "data/shaders/saso/ssao.frag");
+  blur_ = Shader("data/shaders/fullscreen.vert", "data/shaders/saso/ssao_blur.frag");
+  upsample_ = Shader("data/shaders/fullscreen.vert", "data/shaders/saso/ssao_upsample.frag");
+  depth_downsample_.Use();
+  depth_downsample_.SetInt("depthBuffer", 0);
+  ssao_.Use();
+  ssao_.SetInt("linearDepth", 0);
+  ssao_.SetInt("gNormal", 1);
+  ssao_.SetInt("texNoise", 2);
+  blur_.Use();
+  blur_.SetInt("ssaoInput", 0);
+  upsample_.Use();
+  upsample_.SetInt("ssaoInput", 0);
+  upsample_.SetInt("lowDepth", 1);
+  upsample_.SetInt("depthBuffer", 2);
+
+  // generate noise texture, random rotations around the normal tiled over the screen
+  // ----------------------
+  std::uniform_real_distribution<GLfloat> random_floats(0.0, 1.0);
+  std::default_random_engine generator;
+  std::array<glm::vec3, kNoiseSize * kNoiseSize> noise;
+  for (glm::vec3& rotation : noise)
+  {
+    rotation = glm::vec3(random_floats(generator) * 2.0f - 1.0f, random_floats(generator) * 2.0f - 1.0f, 0.0f);
+  }
+  glGenTextures(1, &noise_texture_);
+  glBindTexture(GL_TEXTURE_2D, noise_texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, kNoiseSize, kNoiseSize, 0, GL_RGB, GL_FLOAT, noise.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+  //The fullscreen triangle is generated from gl_VertexID, the core profile still wants a VAO bound
+  glGenVertexArrays(1, &vao_);
+  GenerateKernel();
+}
+
+void SsaoPass::Delete()
+{
+  glDeleteTextures(1, &noise_texture_);
+  glDeleteVertexArrays(1, &vao_);
+  noise_texture_ = 0;
+  vao_ = 0;
+  depth_downsample_.Delete();
+  ssao_.Delete();
+  blur_.Delete();
+  upsample_.Delete();
+}
+
+void SsaoPass::GenerateKernel()
+{
+  // samples in a hemisphere around +z, more of them close to the center
+  std::uniform_real_distribution<GLfloat> random_floats(0.0, 1.0);
+  std::default_random_engine generator;
+  kernel_.resize(kernel_size_);
+  for (int i = 0; i < kernel_size_; ++i)
+  {
+    glm::vec3 sample(random_floats(generator) * 2.0f - 1.0f, random_floats(generator) * 2.0f - 1.0f,
+                     random_floats(generator));
+    sample = glm::normalize(sample) * random_floats(generator);
+    const float scale = static_cast<float>(i) / static_cast<float>(kernel_size_);
+    kernel_[i] = sample * glm::mix(0.1f, 1.0f, scale * scale);
+  }
+  kernel_dirty_ = true;
+}
+
+void SsaoPass::Render(RenderTargetPool& pool, GLuint depth_buffer, GLuint normals, GLuint output, int width,
+                      int height, const glm::mat4& projection)
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  const int low_width = std::max(1, width / scale_);
+  const int low_height = std::max(1, height / scale_);
+  const GLuint low_depth = pool.Acquire({low_width, low_height, GL_R32F});
+  const GLuint low_occlusion = pool.Acquire({low_width, low_height, GL_R8});
+  //At full resolution the blur writes the output directly
+  const GLuint low_occlusion_blur = scale_ > 1 ? pool.Acquire({low_width, low_height, GL_R8}) : output;
+
+  glBindVertexArray(vao_);
+
+  //Linearized once here so the occlusion taps don't each have to, also at full resolution
+  glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({low_depth}));
+  glViewport(0, 0, low_width, low_height);
+  depth_downsample_.Use();
+  depth_downsample_.SetInt("scale", scale_);
+  depth_downsample_.SetMat4("projection", projection);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, depth_buffer);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({low_occlusion}));
+  ssao_.Use();
+  //The kernel only goes to the GPU when it changes
+  if (kernel_dirty_)
+  {
+    ssao_.SetVec3Array("samples", kernel_, kernel_.size());
+    ssao_.SetInt("kernelSize", kernel_size_);
+    kernel_dirty_ = false;
+  }
+  ssao_.SetFloat("radius", radius_);
+  ssao_.SetFloat("bias", bias_);
+  ssao_.SetMat4("projection", projection);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, low_depth);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, normals);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, noise_texture_);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({low_occlusion_blur}));
+  blur_.Use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, low_occlusion);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  pool.Release(low_occlusion);
+
+  if (scale_ > 1)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({output}));
+    glViewport(0, 0, width, height);
+    upsample_.Use();
+    upsample_.SetMat4("projection", projection);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, low_occlusion_blur);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, low_depth);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, depth_buffer);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    pool.Release(low_occlusion_blur);
+  }
+  pool.Release(low_depth);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindVertexArray(0);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void SsaoPass::DrawImGui()
+{
+  if (!ImGui::CollapsingHeader("SSAO Settings"))
+    return;
+
+  static constexpr const char* kResolutions[] = {"Full", "Half", "Quarter"};
+  int resolution = scale_ == 1 ? 0 : scale_ == 2 ? 1 : 2;
+  if (ImGui::Combo("Resolution", &resolution, kResolutions, 3))
+  {
+    scale_ = 1 << resolution;
+  }
+  if (ImGui::SliderInt("Samples", &kernel_size_, 4, kMaxKernelSize))
+  {
+    GenerateKernel();
+  }
+  ImGui::SliderFloat("Radius", &radius_, 0.05f, 2.0f, "%.2f");
+  ImGui::SliderFloat("Bias", &bias_, 0.0f, 0.1f, "%.3f");
+}
@@ -0,0 +1,314 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "file_utility.h"
+#include "mapped_file.h"
+
+namespace gpr5300
+{
+
+namespace
+{
+constexpr std::array<std::uint8_t, 12> kKtx2Identifier = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+//Identifier, header and index: the level index starts right after
+constexpr std::size_t kKtx2LevelIndexOffset = 80;
+constexpr std::size_t kKtx2LevelIndexEntrySize = 24;
+constexpr char kSourceKey[] = "GPRsource";
+
+//Khronos data format descriptor values of the basic block
+constexpr std::uint32_t kDfdTransferLinear = 1;
+constexpr std::uint32_t kDfdTransferSrgb = 2;
+constexpr std::uint32_t kDfdPrimariesBt709 = 1;
+constexpr std::uint32_t kDfdChannelAlpha = 15;
+constexpr std::uint32_t kDfdSampleLinear = 0x10;
+
+struct Ktx2Sample
+{
+  std::uint32_t bit_offset;
+  std::uint32_t bit_length;
+  std::uint32_t channel;
+};
+
+struct Ktx2Format
+{
+  std::uint32_t vk_unorm;
+  std::uint32_t vk_srgb;
+  std::uint32_t color_model;
+  std::array<Ktx2Sample, 2> samples;
+  std::size_t sample_count;
+};
+
+Ktx2Format Ktx2FormatOf(BlockFormat format)
+{
+  switch (format)
+  {
+    case BlockFormat::kBc1:
+      return {131, 132, 128, {{{0, 64, 0}}}, 1};
+    case BlockFormat::kBc3:
+      return {137, 138, 130, {{{0, 64, kDfdChannelAlpha}, {64, 64, 0}}}, 2};
+    case BlockFormat::kBc4:
+      return {139, 139, 131, {{{0, 64, 0}}}, 1};
+    case BlockFormat::kBc5:
+      return {141, 141, 132, {{{0, 64, 0}, {64, 64, 1}}}, 2};
+    case BlockFormat::kBc7:
+    default:
+      return {145, 146, 134, {{{0, 128, 0}}}, 1};
+  }
+}
+
+std::string_view BlockFormatName(BlockFormat format)
+{
+  switch (format)
+  {
+    case BlockFormat::kBc1:
+      return "bc1";
+    case BlockFormat::kBc3:
+      return "bc3";
+    case BlockFormat::kBc4:
+      return "bc4";
+    case BlockFormat::kBc5:
+      return "bc5";
+    case BlockFormat::kBc7:
+    default:
+      return "bc7";
+  }
+}
+
+std::size_t AlignTextureCacheOffset(std::size_t offset, std::size_t alignment)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+void PutU32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    out.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+}
+
+void PutU64(std::vector<std::uint8_t>& out, std::uint64_t value)
+{
+  for (int i = 0; i < 8; i++)
+    out.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+}
+
+std::uint32_t GetU32(const std::byte* data)
+{
+  std::uint32_t value = 0;
+  for (int i = 0; i < 4; i++)
+    value |= static_cast<std::uint32_t>(data[i]) << (i * 8);
+  return value;
+}
+
+std::uint64_t GetU64(const std::byte* data)
+{
+  return GetU32(data) | static_cast<std::uint64_t>(GetU32(data + 4)) << 32;
+}
+
+std::size_t LevelSize(BlockFormat format, int width, int height)
+{
+  return static_cast<std::size_t>((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+}
+
+std::string TextureCachePath(std::string_view source_path, BlockFormat format)
+{
+  std::string path(source_path);
+  path += '.';
+  path += BlockFormatName(format);
+  path += kTextureCacheExtension;
+  return path;
+}
+
+bool ReadTextureCache(std::string_view cache_path, std::uint64_t source_hash, bool srgb, CompressedTexture& texture)
+{
+  MappedFile file;
+  if (!file.Open(cache_path))
+    return false;
+  const std::byte* data = file.data();
+  const std::size_t size = file.size();
+  if (size < kKtx2LevelIndexOffset || std::memcmp(data, kKtx2Identifier.data(), kKtx2Identifier.size()) != 0)
+    return false;
+
+  const std::uint32_t vk_format = GetU32(data + 12);
+  const int width = static_cast<int>(GetU32(data + 20));
+  const int height = static_cast<int>(GetU32(data + 24));
+  const std::uint32_t level_count = GetU32(data + 40);
+  //Only what WriteTextureCache produces: a 2D texture, not an array or a cubemap, not supercompressed
+  if (GetU32(data + 16) != 1 || GetU32(data + 28) != 0 || GetU32(data + 32) != 0 || GetU32(data + 36) != 1 ||
+      GetU32(data + 44) != 0 || width <= 0 || height <= 0 || level_count == 0 || level_count > 32 ||
+      kKtx2LevelIndexOffset + level_count * kKtx2LevelIndexEntrySize > size)
+    return false;
+
+  bool found_format = false;
+  for (const BlockFormat format : {BlockFormat::kBc1, BlockFormat::kBc3, BlockFormat::kBc4, BlockFormat::kBc5,
+                                   BlockFormat::kBc7})
+  {
+    const Ktx2Format info = Ktx2FormatOf(format);
+    if (vk_format == (srgb ? info.vk_srgb : info.vk_unorm))
+    {
+      texture.format = format;
+      found_format = true;
+    }
+  }
+  if (!found_format)
+    return false;
+  texture.srgb = srgb;
+
+  //The source entry tells whether the cache is still up to date
+  const std::uint64_t kvd_offset = GetU32(data + 56);
+  const std::uint64_t kvd_length = GetU32(data + 60);
+  if (kvd_offset + kvd_length > size)
+    return false;
+  bool source_matches = false;
+  for (std::uint64_t entry = kvd_offset; entry + 4 <= kvd_offset + kvd_length;)
+  {
+    const std::uint32_t entry_length = GetU32(data + entry);
+    if (entry + 4 + entry_length > kvd_offset + kvd_length)
+      return false;
+    const auto* key = reinterpret_cast<const char*>(data + entry + 4);
+    if (entry_length == sizeof(kSourceKey) + 16 && std::memcmp(key, kSourceKey, sizeof(kSourceKey)) == 0)
+    {
+      const std::byte* value = data + entry + 4 + sizeof(kSourceKey);
+      source_matches = GetU64(value) == source_hash && GetU32(value + 12) == kTextureCacheVersion;
+      texture.channels = static_cast<int>(GetU32(value + 8));
+    }
+    entry = AlignTextureCacheOffset(entry + 4 + entry_length, 4);
+  }
+  if (!source_matches)
+    return false;
+
+  texture.levels.clear();
+  std::size_t total_size = 0;
+  int level_width = width;
+  int level_height = height;
+  for (std::uint32_t level = 0; level < level_count; level++)
+  {
+    const std::byte* entry = data + kKtx2LevelIndexOffset + level * kKtx2LevelIndexEntrySize;
+    const std::uint64_t offset = GetU64(entry);
+    const std::uint64_t length = GetU64(entry + 8);
+    if (length != LevelSize(texture.format, level_width, level_height) || offset + length > size)
+      return false;
+    texture.levels.push_back({level_width, level_height, total_size, static_cast<std::size_t>(length)});
+    total_size += length;
+    level_width = std::max(1, level_width / 2);
+    level_height = std::max(1, level_height / 2);
+  }
+
+  texture.data.resize(total_size);
+  for (std::uint32_t level = 0; level < level_count; level++)
+  {
+    const std::uint64_t offset = GetU64(data + kKtx2LevelIndexOffset + level * kKtx2LevelIndexEntrySize);
+    std::memcpy(texture.data.data() + texture.levels[level].offset, data + offset, texture.levels[level].size);
+  }
+  return true;
+}
+
+bool WriteTextureCache(std::string_view cache_path, std::uint64_t source_hash, const CompressedTexture& texture)
+{
+  if (texture.empty())
+    return false;
+  const Ktx2Format info = Ktx2FormatOf(texture.format);
+  const auto level_count = static_cast<std::uint32_t>(texture.levels.size());
+  const std::size_t block_bytes = BlockBytes(texture.format);
+
+  const std::size_t dfd_offset = kKtx2LevelIndexOffset + level_count * kKtx2LevelIndexEntrySize;
+  const std::size_t dfd_length = 4 + 24 + 16 * info.sample_count;
+  const std::size_t kvd_offset = dfd_offset + dfd_length;
+  const std::size_t kvd_entry_length = sizeof(kSourceKey) + 16;
+  const std::size_t kvd_length = AlignTextureCacheOffset(4 + kvd_entry_length, 4);
+  //The spec stores the smallest level first, aligned on the block size
+  std::vector<std::size_t> level_offsets(level_count);
+  std::size_t offset = AlignTextureCacheOffset(kvd_offset + kvd_length, block_bytes);
+  for (std::size_t level = level_count; level-- > 0;)
+  {
+    level_offsets[level] = offset;
+    offset = AlignTextureCacheOffset(offset + texture.levels[level].size, block_bytes);
+  }
+
+  std::vector<std::uint8_t> out;
+  out.reserve(offset);
+  out.insert(out.end(), kKtx2Identifier.begin(), kKtx2Identifier.end());
+  PutU32(out, texture.srgb ? info.vk_srgb : info.vk_unorm);
+  PutU32(out, 1); //typeSize
+  PutU32(out, static_cast<std::uint32_t>(texture.levels.front().width));
+  PutU32(out, static_cast<std::uint32_t>(texture.levels.front().height));
+  PutU32(out, 0); //depth
+  PutU32(out, 0); //layers
+  PutU32(out, 1); //faces
+  PutU32(out, level_count);
+  PutU32(out, 0); //supercompression
+  PutU32(out, static_cast<std::uint32_t>(dfd_offset));
+  PutU32(out, static_cast<std::uint32_t>(dfd_length));
+  PutU32(out, static_cast<std::uint32_t>(kvd_offset));
+  PutU32(out, static_cast<std::uint32_t>(kvd_length));
+  PutU64(out, 0); //supercompression global data
+  PutU64(out, 0);
+  for (std::uint32_t level = 0; level < level_count; level++)
+  {
+    PutU64(out, level_offsets[level]);
+    PutU64(out, texture.levels[level].size);
+    PutU64(out, texture.levels[level].size);
+  }
+
+  PutU32(out, static_cast<std::uint32_t>(dfd_length));
+  PutU32(out, 0); //Khronos vendor, basic descriptor type
+  PutU32(out, 2 | static_cast<std::uint32_t>(dfd_length - 4) << 16); //version 1.3, block size
+  PutU32(out, info.color_model | kDfdPrimariesBt709 << 8 |
+      (texture.srgb ? kDfdTransferSrgb : kDfdTransferLinear) << 16);
+  PutU32(out, 3 | 3 << 8); //4x4 texel blocks
+  PutU32(out, static_cast<std::uint32_t>(block_bytes));
+  PutU32(out, 0);
+  for (std::size_t i = 0; i < info.sample_count; i++)
+  {
+    const Ktx2Sample& sample = info.samples[i];
+    //Alpha is never sRGB encoded
+    const std::uint32_t qualifiers = sample.channel == kDfdChannelAlpha && texture.srgb ? kDfdSampleLinear : 0;
+    PutU32(out, sample.bit_offset | (sample.bit_length - 1) << 16 | (sample.channel | qualifiers) << 24);
+    PutU32(out, 0); //sample position
+    PutU32(out, 0); //lower
+    PutU32(out, 0xFFFFFFFF); //upper
+  }
+
+  PutU32(out, static_cast<std::uint32_t>(kvd_entry_length));
+  out.insert(out.end(), kSourceKey, kSourceKey + sizeof(kSourceKey));
+  PutU64(out, source_hash);
+  PutU32(out, static_cast<std::uint32_t>(texture.channels));
+  PutU32(out, kTextureCacheVersion);
+  out.resize(kvd_offset + kvd_length, 0);
+
+  for (std::size_t level = level_count; level-- > 0;)
+  {
+    out.resize(level_offsets[level], 0);
+    const auto* level_data = texture.data.data() + texture.levels[level].offset;
+    out.insert(out.end(), level_data, level_data + texture.levels[level].size);
+  }
+
+  //Same as the mesh cache: written aside under a name of its own and renamed, so neither a crash nor a concurrent
+  //writer of the same texture leaves a torn file behind
+  const std::string final_path(cache_path);
+  const std::string tmp_path = TemporaryPath(final_path);
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file)
+      return false;
+    file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    if (!file)
+      return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tmp_path, final_path, error);
+  if (error)
+  {
+    std::filesystem::remove(tmp_path, error);
+    return false;
+  }
+  return true;
+}
+
+} // namespace gpr5300
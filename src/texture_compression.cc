@@ -0,0 +1,443 @@
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <future>
+
+#include "cpu_profiler.h"
+#include "mip_chain.h"
+
+namespace gpr5300
+{
+
+namespace
+{
+constexpr int kBlockTexels = 16;
+//Block rows encoded by one pool job
+constexpr int kBlockRowsPerJob = 8;
+constexpr std::array<int, 16> kBc7Weights4 = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+//Mean of the texels and the direction they spread the most along, found by power iteration on their covariance
+void BlockPrincipalAxis(const std::uint8_t* texels, int channels, float* mean, float* axis)
+{
+  float min[4] = {255.0f, 255.0f, 255.0f, 255.0f};
+  float max[4] = {};
+  for (int c = 0; c < channels; c++)
+  {
+    mean[c] = 0.0f;
+    for (int i = 0; i < kBlockTexels; i++)
+    {
+      const float value = texels[i * 4 + c];
+      mean[c] += value;
+      min[c] = std::min(min[c], value);
+      max[c] = std::max(max[c], value);
+    }
+    mean[c] /= kBlockTexels;
+  }
+
+  float covariance[4][4] = {};
+  for (int i = 0; i < kBlockTexels; i++)
+  {
+    for (int a = 0; a < channels; a++)
+    {
+      const float da = texels[i * 4 + a] - mean[a];
+      for (int b = a; b < channels; b++)
+        covariance[a][b] += da * (texels[i * 4 + b] - mean[b]);
+    }
+  }
+  for (int a = 0; a < channels; a++)
+    for (int b = 0; b < a; b++)
+      covariance[a][b] = covariance[b][a];
+
+  //The diagonal of the bounding box is close to the answer already, a few iterations are enough
+  for (int c = 0; c < channels; c++)
+    axis[c] = max[c] - min[c];
+  for (int iteration = 0; iteration < 8; iteration++)
+  {
+    float next[4] = {};
+    float length = 0.0f;
+    for (int a = 0; a < channels; a++)
+    {
+      for (int b = 0; b < channels; b++)
+        next[a] += covariance[a][b] * axis[b];
+      length = std::max(length, std::abs(next[a]));
+    }
+    if (length <= 0.0f)
+      break;
+    for (int c = 0; c < channels; c++)
+      axis[c] = next[c] / length;
+  }
+  float length = 0.0f;
+  for (int c = 0; c < channels; c++)
+    length += axis[c] * axis[c];
+  length = std::sqrt(length);
+  for (int c = 0; c < channels; c++)
+    axis[c] = length > 0.0f ? axis[c] / length : 0.0f;
+}
+
+//Endpoints at the extreme projections of the texels on the principal axis
+void BlockEndpoints(const std::uint8_t* texels, int channels, float* low, float* high)
+{
+  float mean[4];
+  float axis[4];
+  BlockPrincipalAxis(texels, channels, mean, axis);
+  float min_t = 0.0f;
+  float max_t = 0.0f;
+  for (int i = 0; i < kBlockTexels; i++)
+  {
+    float t = 0.0f;
+    for (int c = 0; c < channels; c++)
+      t += (texels[i * 4 + c] - mean[c]) * axis[c];
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  for (int c = 0; c < channels; c++)
+  {
+    low[c] = std::clamp(mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+    high[c] = std::clamp(mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+  }
+}
+
+int SquaredDistance(const std::uint8_t* texel, const int* color, int channels)
+{
+  int distance = 0;
+  for (int c = 0; c < channels; c++)
+  {
+    const int d = texel[c] - color[c];
+    distance += d * d;
+  }
+  return distance;
+}
+
+template<std::size_t N>
+int NearestPaletteEntry(const std::uint8_t* texel, const std::array<std::array<int, 4>, N>& palette, int channels)
+{
+  int best = 0;
+  int best_distance = SquaredDistance(texel, palette[0].data(), channels);
+  for (int i = 1; i < static_cast<int>(N); i++)
+  {
+    const int distance = SquaredDistance(texel, palette[i].data(), channels);
+    if (distance < best_distance)
+    {
+      best = i;
+      best_distance = distance;
+    }
+  }
+  return best;
+}
+
+std::uint16_t PackRgb565(const float* color)
+{
+  const auto r = static_cast<std::uint16_t>(std::lround(color[0] * 31.0f / 255.0f));
+  const auto g = static_cast<std::uint16_t>(std::lround(color[1] * 63.0f / 255.0f));
+  const auto b = static_cast<std::uint16_t>(std::lround(color[2] * 31.0f / 255.0f));
+  return static_cast<std::uint16_t>(r << 11 | g << 5 | b);
+}
+
+std::array<int, 4> UnpackRgb565(std::uint16_t color)
+{
+  const int r = color >> 11 & 31;
+  const int g = color >> 5 & 63;
+  const int b = color & 31;
+  return {r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 255};
+}
+
+//Little endian bit stream of a 128 bit BC7 block
+class Bc7BitWriter
+{
+ public:
+  void Put(std::uint32_t value, int count)
+  {
+    for (int i = 0; i < count; i++, position_++)
+    {
+      if (value >> i & 1u)
+        bytes_[position_ >> 3] |= static_cast<std::uint8_t>(1u << (position_ & 7));
+    }
+  }
+  void CopyTo(std::uint8_t* block) const { std::copy(bytes_.begin(), bytes_.end(), block); }
+
+ private:
+  std::array<std::uint8_t, 16> bytes_ = {};
+  int position_ = 0;
+};
+
+void EncodeBlock(BlockFormat format, const std::uint8_t* texels, std::uint8_t* block)
+{
+  switch (format)
+  {
+    case BlockFormat::kBc1:
+      EncodeBc1Block(texels, block);
+      break;
+    case BlockFormat::kBc3:
+      EncodeBc3Block(texels, block);
+      break;
+    case BlockFormat::kBc4:
+      EncodeBc4Block(texels, 0, block);
+      break;
+    case BlockFormat::kBc5:
+      EncodeBc5Block(texels, block);
+      break;
+    case BlockFormat::kBc7:
+      EncodeBc7Block(texels, block);
+      break;
+  }
+}
+
+//Any channel count to RGBA: grey is replicated, missing alpha is opaque
+void ExpandTexelToRgba(const std::uint8_t* texel, int channels, std::uint8_t* rgba)
+{
+  if (channels <= 2)
+  {
+    rgba[0] = rgba[1] = rgba[2] = texel[0];
+    rgba[3] = channels == 2 ? texel[1] : 255;
+  }
+  else
+  {
+    rgba[0] = texel[0];
+    rgba[1] = texel[1];
+    rgba[2] = texel[2];
+    rgba[3] = channels == 4 ? texel[3] : 255;
+  }
+}
+
+int BlockCount(int size)
+{
+  return (size + 3) / 4;
+}
+}
+
+BlockFormat ChooseBlockFormat(TextureRole role, int channels)
+{
+  switch (role)
+  {
+    case TextureRole::kAlbedo:
+      return BlockFormat::kBc7;
+    case TextureRole::kNormal:
+      return BlockFormat::kBc5;
+    case TextureRole::kData:
+    default:
+      if (channels == 1)
+        return BlockFormat::kBc4;
+      return channels == 3 ? BlockFormat::kBc1 : BlockFormat::kBc3;
+  }
+}
+
+std::size_t BlockBytes(BlockFormat format)
+{
+  return format == BlockFormat::kBc1 || format == BlockFormat::kBc4 ? 8 : 16;
+}
+
+void EncodeBc1Block(const std::uint8_t* texels, std::uint8_t* block)
+{
+  float low[4];
+  float high[4];
+  BlockEndpoints(texels, 3, low, high);
+  std::uint16_t color0 = PackRgb565(high);
+  std::uint16_t color1 = PackRgb565(low);
+  //color0 > color1 selects the 4 color mode, no texel becomes transparent black
+  if (color0 < color1)
+    std::swap(color0, color1);
+
+  std::uint32_t indices = 0;
+  if (color0 != color1)
+  {
+    std::array<std::array<int, 4>, 4> palette;
+    palette[0] = UnpackRgb565(color0);
+    palette[1] = UnpackRgb565(color1);
+    for (int c = 0; c < 3; c++)
+    {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < kBlockTexels; i++)
+      indices |= static_cast<std::uint32_t>(NearestPaletteEntry(texels + i * 4, palette, 3)) << (i * 2);
+  }
+  block[0] = static_cast<std::uint8_t>(color0 & 0xFF);
+  block[1] = static_cast<std::uint8_t>(color0 >> 8);
+  block[2] = static_cast<std::uint8_t>(color1 & 0xFF);
+  block[3] = static_cast<std::uint8_t>(color1 >> 8);
+  for (int i = 0; i < 4; i++)
+    block[4 + i] = static_cast<std::uint8_t>(indices >> (i * 8));
+}
+
+void EncodeBc4Block(const std::uint8_t* texels, int channel, std::uint8_t* block)
+{
+  int min = 255;
+  int max = 0;
+  for (int i = 0; i < kBlockTexels; i++)
+  {
+    min = std::min<int>(min, texels[i * 4 + channel]);
+    max = std::max<int>(max, texels[i * 4 + channel]);
+  }
+  std::fill(block, block + 8, std::uint8_t{0});
+  //max > min selects the 8 value mode, equal endpoints leave every index at 0
+  block[0] = static_cast<std::uint8_t>(max);
+  block[1] = static_cast<std::uint8_t>(min);
+  if (max == min)
+    return;
+
+  std::array<int, 8> palette;
+  palette[0] = max;
+  palette[1] = min;
+  for (int i = 1; i < 7; i++)
+    palette[i + 1] = ((7 - i) * max + i * min) / 7;
+  std::uint64_t indices = 0;
+  for (int i = 0; i < kBlockTexels; i++)
+  {
+    const int value = texels[i * 4 + channel];
+    int best = 0;
+    for (int entry = 1; entry < 8; entry++)
+    {
+      if (std::abs(palette[entry] - value) < std::abs(palette[best] - value))
+        best = entry;
+    }
+    indices |= static_cast<std::uint64_t>(best) << (i * 3);
+  }
+  for (int i = 0; i < 6; i++)
+    block[2 + i] = static_cast<std::uint8_t>(indices >> (i * 8));
+}
+
+void EncodeBc3Block(const std::uint8_t* texels, std::uint8_t* block)
+{
+  EncodeBc4Block(texels, 3, block);
+  EncodeBc1Block(texels, block + 8);
+}
+
+void EncodeBc5Block(const std::uint8_t* texels, std::uint8_t* block)
+{
+  EncodeBc4Block(texels, 0, block);
+  EncodeBc4Block(texels, 1, block + 8);
+}
+
+void EncodeBc7Block(const std::uint8_t* texels, std::uint8_t* block)
+{
+  float endpoints[2][4];
+  BlockEndpoints(texels, 4, endpoints[0], endpoints[1]);
+
+  //7 bits per channel and a p-bit shared by the channels of an endpoint: the p-bit closest to the 8 bit value
+  std::array<std::array<int, 4>, 2> quantized;
+  std::array<int, 2> p_bits;
+  std::array<std::array<int, 4>, 2> colors;
+  for (int e = 0; e < 2; e++)
+  {
+    float best_error = -1.0f;
+    for (int p = 0; p < 2; p++)
+    {
+      std::array<int, 4> q;
+      float error = 0.0f;
+      for (int c = 0; c < 4; c++)
+      {
+        q[c] = std::clamp(static_cast<int>(std::lround((endpoints[e][c] - p) * 0.5f)), 0, 127);
+        const float d = static_cast<float>(q[c] << 1 | p) - endpoints[e][c];
+        error += d * d;
+      }
+      if (best_error < 0.0f || error < best_error)
+      {
+        best_error = error;
+        quantized[e] = q;
+        p_bits[e] = p;
+      }
+    }
+    for (int c = 0; c < 4; c++)
+      colors[e][c] = quantized[e][c] << 1 | p_bits[e];
+  }
+
+  std::array<std::array<int, 4>, 16> palette;
+  for (int i = 0; i < 16; i++)
+  {
+    for (int c = 0; c < 4; c++)
+      palette[i][c] = ((64 - kBc7Weights4[i]) * colors[0][c] + kBc7Weights4[i] * colors[1][c] + 32) >> 6;
+  }
+  std::array<int, kBlockTexels> indices;
+  for (int i = 0; i < kBlockTexels; i++)
+    indices[i] = NearestPaletteEntry(texels + i * 4, palette, 4);
+  //The first index is stored without its top bit: flip the endpoints so that bit is 0
+  if (indices[0] & 8)
+  {
+    std::swap(quantized[0], quantized[1]);
+    std::swap(p_bits[0], p_bits[1]);
+    for (int& index : indices)
+      index = 15 - index;
+  }
+
+  Bc7BitWriter writer;
+  writer.Put(1u << 6, 7); //mode 6
+  for (int c = 0; c < 4; c++)
+  {
+    writer.Put(static_cast<std::uint32_t>(quantized[0][c]), 7);
+    writer.Put(static_cast<std::uint32_t>(quantized[1][c]), 7);
+  }
+  writer.Put(static_cast<std::uint32_t>(p_bits[0]), 1);
+  writer.Put(static_cast<std::uint32_t>(p_bits[1]), 1);
+  writer.Put(static_cast<std::uint32_t>(indices[0]), 3);
+  for (int i = 1; i < kBlockTexels; i++)
+    writer.Put(static_cast<std::uint32_t>(indices[i]), 4);
+  writer.CopyTo(block);
+}
+
+CompressedTexture CompressImage(const std::uint8_t* pixels, int width, int height, int channels, BlockFormat format,
+                                bool srgb, bool linear_mips, ThreadPool* pool)
+{
+  CpuZone zone("Compress texture");
+  CompressedTexture texture;
+  texture.format = format;
+  texture.srgb = srgb;
+  texture.channels = channels;
+
+  const MipChain mips = GenerateMipChain(pixels, width, height, channels, linear_mips, pool);
+  std::size_t offset = 0;
+  for (const MipLevel& mip : mips.levels)
+  {
+    const std::size_t size = static_cast<std::size_t>(BlockCount(mip.width)) * BlockCount(mip.height) *
+        BlockBytes(format);
+    texture.levels.push_back({mip.width, mip.height, offset, size});
+    offset += size;
+  }
+  texture.data.resize(offset);
+
+  const auto encode_rows = [&texture, &mips, format](std::size_t level, int first_row, int last_row) {
+    const CompressedLevel& target = texture.levels[level];
+    const std::uint8_t* source = mips.level_data(level);
+    const int blocks_x = BlockCount(target.width);
+    std::array<std::uint8_t, kBlockTexels * 4> texels;
+    for (int by = first_row; by < last_row; by++)
+    {
+      for (int bx = 0; bx < blocks_x; bx++)
+      {
+        //Blocks past the edge of small levels repeat the last texels
+        for (int ty = 0; ty < 4; ty++)
+        {
+          const int y = std::min(by * 4 + ty, target.height - 1);
+          for (int tx = 0; tx < 4; tx++)
+          {
+            const int x = std::min(bx * 4 + tx, target.width - 1);
+            ExpandTexelToRgba(source + (static_cast<std::size_t>(y) * target.width + x) * mips.channels,
+                              mips.channels, texels.data() + (ty * 4 + tx) * 4);
+          }
+        }
+        const std::size_t block_index = static_cast<std::size_t>(by) * blocks_x + bx;
+        EncodeBlock(format, texels.data(), texture.data.data() + target.offset + block_index * BlockBytes(format));
+      }
+    }
+  };
+
+  std::vector<std::future<void>> jobs;
+  for (std::size_t level = 0; level < texture.levels.size(); level++)
+  {
+    const int blocks_y = BlockCount(texture.levels[level].height);
+    for (int row = 0; row < blocks_y; row += kBlockRowsPerJob)
+    {
+      const int last_row = std::min(row + kBlockRowsPerJob, blocks_y);
+      if (pool)
+        jobs.push_back(pool->Submit([&encode_rows, level, row, last_row] { encode_rows(level, row, last_row); }));
+      else
+        encode_rows(level, row, last_row);
+    }
+  }
+  for (std::future<void>& job : jobs)
+    job.get();
+  return texture;
+}
+
+} // namespace gpr5300
@@ -1,34 +1,183 @@
 #include <iostream>
+#include <GL/glew.h>
+#include "cpu_profiler.h"
+#include "mesh_cache.h"
+#include "texture_cache.h"
 #include "texture_loader.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-unsigned int TextureManager::CreateTexture(const char* path) {
-  unsigned int texture;
-  glGenTextures(1, &texture);
+Image DecodeImage(const char* path)
+{
+  gpr5300::CpuZone zone("Decode image");
+  Image image;
+  image.pixel = stbi_load(path, &image.width, &image.height, &image.comp, 0);
+  return image;
+}
+
+void FreeImage(Image& image)
+{
+  stbi_image_free(image.pixel);
+  image.pixel = nullptr;
+}
+
+void UploadTexture(unsigned int texture, const gpr5300::MipChain& mips, bool gamma)
+{
+  GLenum internal_format = GL_RGB;
+  GLenum data_format = GL_RGB;
+  if (mips.channels == 1)
+  {
+    internal_format = data_format = GL_RED;
+  }
+  else if (mips.channels == 3)
+  {
+    internal_format = gamma ? GL_SRGB : GL_RGB;
+    data_format = GL_RGB;
+  }
+  else if (mips.channels == 4)
+  {
+    internal_format = gamma ? GL_SRGB_ALPHA : GL_RGBA;
+    data_format = GL_RGBA;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  //rows of 1 and 3 channel images are not 4 bytes aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (std::size_t level = 0; level < mips.levels.size(); level++)
+  {
+    const gpr5300::MipLevel& mip = mips.levels[level];
+    glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internal_format, mip.width, mip.height, 0, data_format,
+                 GL_UNSIGNED_BYTE, mips.level_data(level));
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(mips.levels.size()) - 1);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, data_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, data_format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+gpr5300::CompressedTexture LoadCompressedTexture(const char* path, gpr5300::TextureRole role, bool gamma,
+                                                 gpr5300::ThreadPool* pool)
+{
+  gpr5300::CompressedTexture compressed;
+  //Normals and data are never color. Albedo is sRGB encoded and always filtered in linear light, gamma only decides
+  //whether the GPU decodes it
+  const bool color = role == gpr5300::TextureRole::kAlbedo;
+  const bool srgb = gamma && color;
+  //Keyed on the size and write time of the image, a warm load only reads the cache
+  std::uint64_t source_hash = 0;
+  if (!gpr5300::HashFileStamp(path, source_hash))
+    return compressed;
+
+  //The format depends on the channel count of the image, a cache of any format is fine if it is the one it would get
+  for (const gpr5300::BlockFormat format : {gpr5300::BlockFormat::kBc1, gpr5300::BlockFormat::kBc3,
+                                            gpr5300::BlockFormat::kBc4, gpr5300::BlockFormat::kBc5,
+                                            gpr5300::BlockFormat::kBc7})
+  {
+    if (gpr5300::ReadTextureCache(gpr5300::TextureCachePath(path, format), source_hash, srgb, compressed) &&
+        gpr5300::ChooseBlockFormat(role, compressed.channels) == format)
+      return compressed;
+  }
+  compressed = {};
+
+  Image image = DecodeImage(path);
+  if (image.pixel)
+  {
+    const gpr5300::BlockFormat format = gpr5300::ChooseBlockFormat(role, image.comp);
+    compressed = gpr5300::CompressImage(static_cast<const std::uint8_t*>(image.pixel), image.width, image.height,
+                                        image.comp, format, srgb, color, pool);
+    if (!gpr5300::WriteTextureCache(gpr5300::TextureCachePath(path, format), source_hash, compressed))
+      std::cerr << "Could not write texture cache of " << path << '\n';
+  }
+  FreeImage(image);
+  return compressed;
+}
+
+void UploadCompressedTexture(unsigned int texture, const gpr5300::CompressedTexture& compressed)
+{
+  GLenum internal_format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+  switch (compressed.format)
+  {
+    case gpr5300::BlockFormat::kBc1:
+      internal_format = compressed.srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+      break;
+    case gpr5300::BlockFormat::kBc3:
+      internal_format = compressed.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+      break;
+    case gpr5300::BlockFormat::kBc4:
+      internal_format = GL_COMPRESSED_RED_RGTC1;
+      break;
+    case gpr5300::BlockFormat::kBc5:
+      internal_format = GL_COMPRESSED_RG_RGTC2;
+      break;
+    case gpr5300::BlockFormat::kBc7:
+      internal_format = compressed.srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+      break;
+  }
+
   glBindTexture(GL_TEXTURE_2D, texture);
-// set the texture wrapping/filtering options (on the currently bound texture object)
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  for (std::size_t level = 0; level < compressed.levels.size(); level++)
+  {
+    const gpr5300::CompressedLevel& mip = compressed.levels[level];
+    glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internal_format, mip.width, mip.height, 0,
+                           static_cast<GLsizei>(mip.size), compressed.data.data() + mip.offset);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressed.levels.size()) - 1);
+
+  //Same rules as UploadTexture: RGBA images are clamped
+  const GLint wrap = compressed.channels == 4 ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-// load and generate the texture
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-  if (data)
-  {
-    //TODO add check JPG:
-      //glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-      //glGenerateMipmap(GL_TEXTURE_2D);
-    //TODO PNG
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+bool UploadCubemap(unsigned int texture, std::span<const Image> faces)
+{
+  bool complete = true;
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+  for (std::size_t i = 0; i < faces.size(); i++)
+  {
+    if (faces[i].pixel)
+    {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(i), 0, GL_RGB, faces[i].width,
+                   faces[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i].pixel);
+    }
+    else
+    {
+      complete = false;
+    }
+  }
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  return complete;
+}
+
+unsigned int TextureManager::CreateTexture(const char* path) {
+  unsigned int texture;
+  glGenTextures(1, &texture);
+// load the texture, its mipmaps are filtered in linear light on the loader threads and only uploaded here
+  Image image = DecodeImage(path);
+  if (image.pixel)
+  {
+    const gpr5300::MipChain mips = gpr5300::GenerateMipChain(static_cast<const std::uint8_t*>(image.pixel),
+                                                             image.width, image.height, image.comp, true,
+                                                             &gpr5300::LoaderPool());
+    UploadTexture(texture, mips);
+// set the texture wrapping (on the currently bound texture object)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
   }
   else
   {
     std::cout << "Failed to load texture" << std::endl;
   }
-  stbi_image_free(data);
+  FreeImage(image);
   return texture;
 }
@@ -0,0 +1,57 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#include "cpu_profiler.h"
+
+namespace gpr5300
+{
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+{
+  workers_.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; i++)
+  {
+    workers_.emplace_back([this] { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::scoped_lock lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_all();
+  for (std::thread& worker : workers_)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::WorkerLoop()
+{
+  GlobalCpuProfiler().SetThreadName("Worker");
+  while (true)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock lock(mutex_);
+      condition_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      //pending jobs are still drained on shutdown so no future is left broken
+      if (jobs_.empty())
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    job();
+  }
+}
+
+ThreadPool& LoaderPool()
+{
+  static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+  return pool;
+}
+
+} // namespace gpr5300